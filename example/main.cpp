@@ -4,7 +4,17 @@
 #include <gloops/Shader.hpp>
 #include <gloops/Texture.hpp>
 #include <gloops/Utils.hpp>
-
+#include <gloops/Denoising.hpp>
+#include <gloops/MacroCells.hpp>
+#include <gloops/VolumeRaymarching.hpp>
+#include <gloops/DistanceField.hpp>
+#include <gloops/Voxelization.hpp>
+#include <gloops/EnvironmentLight.hpp>
+#include <gloops/Reprojection.hpp>
+#include <gloops/Scheduler.hpp>
+#include <gloops/SparseVolume.hpp>
+
+#include <chrono>
 #include <map>
 #include <limits>
 
@@ -239,14 +249,22 @@ SubWindow mesh_modes_subwin()
 {
 	static int precision = 25;
 
-	auto apple_banana = Mesh::loadMeshes(gloops_demo_meshes_folder + "AppleBanana.obj").at(0).setScaling(1 / 20.0f).setTranslation(v3f(-10, 5, -5)).extractComponents();
+	//vertices are split along uv and normal seams, the banana is the largest piece and the apple the other ones
+	auto apple_banana = Mesh::loadMeshes(gloops_demo_meshes_folder + "AppleBanana.obj").at(0).setScaling(1 / 20.0f).setTranslation(v3f(-10, 5, -5)).extractComponents(true);
+	std::sort(apple_banana.begin(), apple_banana.end(), [](const Mesh& a, const Mesh& b) {
+		return a.getVertices().size() > b.getVertices().size();
+	});
+	Mesh apple_pieces;
+	for (size_t i = 1; i < apple_banana.size(); ++i) {
+		apple_pieces = apple_pieces ? apple_pieces.merge(apple_banana[i]) : apple_banana[i];
+	}
 	
 	static MeshGL meshA = Mesh::getTorus(3, 1, precision),
 		meshB = Mesh::getTorus(3, 1, precision).setTranslation(3 * v3f::UnitY()).setRotation(v3f(0, pi<float>() / 2, 0)),
 		meshC = Mesh::getSphere(precision).setScaling(3).setTranslation(-8 * v3f(0, 1, 0)),
 		meshD = Mesh::getCube().setScaling(2).setTranslation(v3f(-5, -5, 5)).setRotation(v3f(1, 1, 1)),
 		banana = apple_banana.at(0),
-		apple = apple_banana.at(1).merge(apple_banana.at(2)).merge(apple_banana.at(3)),
+		apple = apple_pieces,
 		groundPlane = MeshGL::quad({ -20,0,0 }, { 0,100,0 }, { 0, 0,100 });
 	groundPlane.backface_culling = false;
 
@@ -263,8 +281,9 @@ SubWindow mesh_modes_subwin()
 		float tesselationLevel = 2.0f;
 		bool showGeometricNormals = false, showVertexNormals = false, displacement = false;
 	};
-	static bool showAllBB = false;
+	static bool showAllBB = false, skyAmbient = false;
 	static float displacement_scaling = 5.0f;
+	static const SHCoefficients skySH = diffuseSH(EnvironmentLight::fromPathCube(gloops_demo_textures_folder + "sky.png").projectSH());
 
 	static std::map<int, ModeMesh> meshes =
 	{
@@ -298,6 +317,8 @@ SubWindow mesh_modes_subwin()
 	sub.setGuiFunction([&] {
 		ImGui::Checkbox("Show AABBs", &showAllBB);
 		ImGui::SameLine();
+		ImGui::Checkbox("Sky ambient", &skyAmbient);
+		ImGui::SameLine();
 		ImGui::colPicker("Background", bgColor);
 		ImGui::SameLine();
 		ImGui::colPicker("Clear", bgColor);
@@ -495,7 +516,11 @@ SubWindow mesh_modes_subwin()
 			{
 			case Mode::PHONG: {
 				mesh.mode = GL_FILL;
-				shaders.renderPhongMesh(eye, mesh);
+				if (skyAmbient) {
+					shaders.renderPhongMesh(eye, eye.position(), mesh, skySH);
+				} else {
+					shaders.renderPhongMesh(eye, mesh);
+				}
 				break;
 			}
 			case Mode::UVS: {
@@ -592,15 +617,23 @@ SubWindow rayTracingWin()
 	static Raycaster raycaster;
 	raycaster.addMesh(outerBox, innerBoxA, innerBoxB);
 
-	static Image1b hits;
-	static auto hitMask = [&](int x, int y) { return (bool)hits.at(x, y); };
+	static Image3f currentSamplesAverage, primaryNormals, previousNormals, denoised;
+	static Image1f sampleCounts, primaryDepth, previousDepth;
+	static auto hitMask = [&](int x, int y) { return primaryDepth.at(x, y) > 0; };
 
 	static Trackballf tb = Trackballf::fromMeshComputingRaycaster(outerBox).setLookAt(v3f(0.8f, 0.5f, 2.3f), v3f::Zero());
 	static RaycastingCameraf currentCam, previousCam;
 
-	static Image3f currentSamplesAverage;
 	static Texture tex;
 
+	static ATrousDenoiser denoiser;
+	static ATrousParams denoiserParams;
+	static bool denoise = true;
+
+	static TemporalReprojection reprojection;
+	static ReprojectionParams reprojectionParams;
+	static bool reproject = true;
+
 	enum class Mode { COLOR, NORMAL, POSITION, DEPTH };
 	static const std::map<Mode, std::string> modes = {
 		{ Mode::DEPTH, "Depth" },
@@ -613,7 +646,14 @@ SubWindow rayTracingWin()
 	static int numBounces = 2, maxNumSamples = 8, samplesPerPixel = 1, currentNumSamples = 0, maxNumThreads = 4;
 	static bool resetRayCasting = true, useMT = false;
 
-	static const int w = 128, h = 128;
+	//denoising is a post process, changing it only re-runs it on the current accumulation
+	static bool redenoise = false;
+
+	//progressive refinement, 1/2^level of the target resolution, coarsest while the camera moves
+	static int targetHeight = 512, coarsestLevel = 3, level = 0;
+	static bool progressive = true;
+	static v2i targetRes = v2i(0, 0);
+	static int w = 128, h = 128;
 	
 	SubWindow sub = SubWindow("Ray tracing", v2i(600, 600));
 
@@ -633,6 +673,7 @@ SubWindow rayTracingWin()
 		ImGui::ItemWithSize(150, [] {
 			resetRayCasting |= ImGui::SliderInt("num bounces", &numBounces, 1, 3);
 			resetRayCasting |= ImGui::SliderInt("max samples per pixel", &maxNumSamples, 1, 256);
+			resetRayCasting |= ImGui::SliderInt("target height", &targetHeight, 64, 1080);
 
 			resetRayCasting |= ImGui::Checkbox(
 				("use multi-threading, " + std::to_string(std::thread::hardware_concurrency()) + " available cores").c_str(),
@@ -646,172 +687,331 @@ SubWindow rayTracingWin()
 			}
 		});
 
+		ImGui::Separator();
+		redenoise |= ImGui::Checkbox("a-trous denoiser", &denoise);
+		if (denoise) {
+			ImGui::ItemWithSize(150, [] {
+				redenoise |= ImGui::SliderInt("iterations", &denoiserParams.iterations, 1, 6);
+				redenoise |= ImGui::SliderFloat("sigma color", &denoiserParams.sigmaColor, 0.01f, 2.0f);
+				redenoise |= ImGui::SliderFloat("sigma normal", &denoiserParams.sigmaNormal, 0.01f, 1.0f);
+				redenoise |= ImGui::SliderFloat("sigma depth", &denoiserParams.sigmaDepth, 0.001f, 0.5f);
+			});
+		}
+
+		ImGui::Separator();
+		resetRayCasting |= ImGui::Checkbox("progressive refinement", &progressive);
+		if (progressive) {
+			ImGui::SameLine();
+			ImGui::ItemWithSize(100, [] {
+				resetRayCasting |= ImGui::SliderInt("coarsest level", &coarsestLevel, 1, 4);
+			});
+		}
+
+		ImGui::Separator();
+		ImGui::Checkbox("temporal reprojection", &reproject);
+		if (reproject) {
+			ImGui::ItemWithSize(150, [] {
+				ImGui::SliderFloat("depth tolerance", &reprojectionParams.depthTolerance, 0.001f, 0.2f);
+				ImGui::SliderFloat("normal tolerance", &reprojectionParams.normalTolerance, 0.0f, 1.0f);
+				ImGui::SliderFloat("max history", &reprojectionParams.maxHistory, 1.0f, 256.0f);
+			});
+		}
+
 		std::stringstream s;
-		s << "current num samples per pixel : " << currentNumSamples << " / " << maxNumSamples;
+		s << "resolution : " << w << " x " << h << ", min num samples per pixel : " << currentNumSamples << " / " << maxNumSamples;
 		ImGui::Text(s);
 	});
 
-	static v2i clicked;
-	static bool gatherPaths = false, showPaths = false;
-	static std::vector<v3f> paths, colors, normals;
+	static v2d clicked;
+	static v2i clickedPix;
+	static bool gatherPaths = false, showPaths = false, clearPaths = false;
+	static std::vector<v3f> paths, colors, normals, gatheredPaths, gatheredColors, gatheredNormals;
 
-	sub.setUpdateFunction([&](const Input& i) {
-		tb.update(i);
+	//rows are traced in the background, a primary hits pass then a shading pass per resolution level
+	enum class Pass { GUIDE, SHADE };
+	static Pass pass = Pass::GUIDE;
+	static bool reprojectNext = false;
+	static ProgressiveTask rayTracingTask;
 
-		if (i.keyActive(GLFW_KEY_LEFT_ALT) && i.buttonClicked(GLFW_MOUSE_BUTTON_LEFT)) {
-			if (!gatherPaths) {
-				v2d uvs = i.mousePosition().cwiseQuotient(i.viewport().diagonal());
-				uvs.y() = 1.0 - uvs.y();
-				clicked = uvs.cwiseProduct(v2d(w, h)).template cast<int>();
-				paths.resize(0);
-				normals.resize(0); 
-				colors.resize(0);
-				gatherPaths = true;
-				showPaths = true;
-				resetRayCasting = true;
-			} else {
-				showPaths = false;
-				gatherPaths = false;
-			}
+	//copied when a level starts, the GUI may change the originals while rows are traced
+	struct RenderSettings {
+		int numBounces, maxNumSamples, maxNumThreads;
+		Mode mode;
+	};
+	static RenderSettings settings;
+
+	//last full resolution accumulation, resampled into the finest level once refinement gets back to it
+	struct History {
+		RaycastingCameraf cam;
+		Image1f depth, counts;
+		Image3f normals, color;
+		bool valid = false;
+	};
+	static History fullResHistory;
+
+	//primary hits at pixel centers, guiding both reprojection and denoising
+	static auto guideRow = [&](int i) {
+		for (int j = 0; j < w; ++j) {
+			const Hit hit = raycaster.intersect(currentCam.getRay(v2f(j + 0.5f, h - 0.5f - i)), 0.001f);
+			primaryDepth.at(j, i) = hit.successful() ? hit.distance() : -1.0f;
+			primaryNormals.pixel(j, i) = hit.successful() ? raycaster.interpolate(hit, &Mesh::getNormals).normalized() : v3f::Zero();
 		}
+	};
 
-		hits.resize(w, h);
-		currentSamplesAverage.resize(w, h);
-
-		currentCam = RaycastingCameraf(tb.getCamera(), w, h);
-		const bool sameCam = (previousCam == currentCam);
-		resetRayCasting |= (!sameCam);
-		gatherPaths &= sameCam;
-
-		if (resetRayCasting) {
-			currentNumSamples = 0;
-			currentSamplesAverage.setTo(v3f(0, 0, 0));
-			hits.setTo(Vec<uchar, 1>(1));
-			resetRayCasting = false;
-		}
+	static auto shadeRow = [&](int i) {
+		for (int j = 0; j < w; ++j) {
+			float& numSamples = sampleCounts.at(j, i);
+			if (numSamples >= settings.maxNumSamples) {
+				continue;
+			}
 
-		auto rowJob = [&](int i) {
-			for (int j = 0; j < w; ++j) {
-				int numSamples = currentNumSamples;
+			for (int s = 0; s < samplesPerPixel; ++s) {
+				Ray ray = currentCam.getRay(v2f(j, h - 1 - i) + 0.5 * (randomVec<float, 2>() + v2f(1, 1)));
 
-				for (int s = 0; s < samplesPerPixel; ++s) {
-					Ray ray = currentCam.getRay(v2f(j, h - 1 - i) + 0.5 * (randomVec<float, 2>() + v2f(1, 1)));
+				bool continueRT = true;
+				v3f sampleColor = v3f::Zero();
+				v3f color = v3f::Ones();
 
-					bool continueRT = true;
-					v3f sampleColor = v3f::Zero();
-					v3f color = v3f::Ones();
+				for (int b = 0; (b < settings.numBounces) && continueRT; ++b) {
 
-					for (int b = 0; (b < numBounces) && continueRT; ++b) {
+					const Hit hit = raycaster.intersect(ray, 0.001f);
+					const bool successful = hit.successful();
 
-						const Hit hit = raycaster.intersect(ray, 0.001f);
-						const bool successful = hit.successful();
+					if (!successful) {
+						continueRT = false; continue;
+					}
 
-						hits.at(j, i) |= (uchar)successful;
-						if (!successful) {
-							continueRT = false; continue;
-						}
+					float d = hit.distance();
+					const v3f p = ray.pointAt(d);
+					const v3f n = raycaster.interpolate(hit, &Mesh::getNormals).normalized();
+					const v3f col = raycaster.interpolate(hit, &Mesh::getColors);
 
-						float d = hit.distance();
-						const v3f p = ray.pointAt(d);
-						const v3f n = raycaster.interpolate(hit, &Mesh::getNormals).normalized();
-						const v3f col = raycaster.interpolate(hit, &Mesh::getColors);
+					switch (settings.mode) {
+					case Mode::DEPTH: {
+						sampleColor = v3f(d, d, d);
+						continueRT = false; continue;
+					}
+					case Mode::POSITION: {
+						sampleColor = p;
+						continueRT = false; continue;
+					}
+					case Mode::NORMAL: {
+						sampleColor = n;
+						continueRT = false; continue;
+					}
+					default: {
 
-						switch (mode) {
-						case Mode::DEPTH: {
-							sampleColor = v3f(d, d, d);
+						if ((p - lightPosition).cwiseAbs().maxCoeff() < lightSize) {
+							sampleColor = lightColor;
 							continueRT = false; continue;
 						}
-						case Mode::POSITION: {
-							sampleColor = p;
-							continueRT = false; continue;
-						}
-						case Mode::NORMAL: {
-							sampleColor = n;
-							continueRT = false; continue;
-						}
-						default: {
-
-							if ((p - lightPosition).cwiseAbs().maxCoeff() < lightSize) {
-								sampleColor = lightColor;
-								continueRT = false; continue;
-							}
 
-							color = 0.9 * color.cwiseProduct(col);
+						color = 0.9 * color.cwiseProduct(col);
 
-							const v3f randomLightPos = surfaceLightPosition();
-							float distToLight = (randomLightPos - p).norm();
+						const v3f randomLightPos = surfaceLightPosition();
+						float distToLight = (randomLightPos - p).norm();
 
-							v3f dir = (randomLightPos - p) / distToLight;
-							if (!raycaster.occlusion(Ray(p, dir), 0.001f * distToLight, 0.999f * distToLight)) {
-								const float diffuse = std::max(dir.dot(n), 0.0f);
-								const float attenuation = std::clamp<float>(1.0f - (distToLight * distToLight) / (2.5f * 2.5f), 0, 1);
+						v3f dir = (randomLightPos - p) / distToLight;
+						if (!raycaster.occlusion(Ray(p, dir), 0.001f * distToLight, 0.999f * distToLight)) {
+							const float diffuse = std::max(dir.dot(n), 0.0f);
+							const float attenuation = std::clamp<float>(1.0f - (distToLight * distToLight) / (2.5f * 2.5f), 0, 1);
 
-								v3f illumination = (diffuse * attenuation) * lightColor;
+							v3f illumination = (diffuse * attenuation) * lightColor;
 
-								//sampleColor += color.cwiseProduct(illumination);
+							//sampleColor += color.cwiseProduct(illumination);
 
-								sampleColor += color.cwiseProduct(lightColor) * diffuse;
+							sampleColor += color.cwiseProduct(lightColor) * diffuse;
 
-								if (gatherPaths && j == clicked[0] && i == clicked[1]) {
-									paths.push_back(ray.origin());
-									paths.push_back(p);
-									normals.push_back(p);
-									normals.push_back(p + 0.1 * n);
-									colors.push_back(color.cwiseProduct(lightColor) * diffuse);
-									colors.push_back(color.cwiseProduct(lightColor) * diffuse);
-								}
+							if (gatherPaths && j == clickedPix[0] && i == clickedPix[1]) {
+								gatheredPaths.push_back(ray.origin());
+								gatheredPaths.push_back(p);
+								gatheredNormals.push_back(p);
+								gatheredNormals.push_back(p + 0.1 * n);
+								gatheredColors.push_back(color.cwiseProduct(lightColor) * diffuse);
+								gatheredColors.push_back(color.cwiseProduct(lightColor) * diffuse);
 							}
 						}
-						}
-
-						if (b < (numBounces - 1) && continueRT) {
-							ray = Ray(p, (n + randomUnit<float, 3>()).normalized());
-						}
+					}
 					}
 
-					numSamples += 1;
-					currentSamplesAverage.pixel(j, i) += (sampleColor - currentSamplesAverage.pixel(j, i)) / numSamples;
+					if (b < (settings.numBounces - 1) && continueRT) {
+						ray = Ray(p, (n + randomUnit<float, 3>()).normalized());
+					}
 				}
-			}
-		};
 
-		if (currentNumSamples < maxNumSamples) {
-			raycaster.checkScene();
-			if (useMT) {
-				parallelForEach(0, h, [&](int i) {
-					rowJob(i);
-				}, maxNumThreads);
-			} else {
-				for (int i = 0; i < h; ++i) {
-					rowJob(i);
-				}
+				numSamples += 1;
+				currentSamplesAverage.pixel(j, i) += (sampleColor - currentSamplesAverage.pixel(j, i)) / numSamples;
 			}
+		}
+	};
 
-			currentNumSamples += samplesPerPixel;
-			previousCam = currentCam;
+	static auto publish = [&] {
+		float minNumSamples = static_cast<float>(settings.maxNumSamples);
+		for (int i = 0; i < h; ++i) {
+			for (int j = 0; j < w; ++j) {
+				minNumSamples = std::min(minNumSamples, sampleCounts.at(j, i));
+			}
+		}
+		currentNumSamples = static_cast<int>(minNumSamples);
 
-			Image3b img;
-			switch (mode)
-			{
-			case Mode::COLOR: {
+		Image3b img;
+		switch (settings.mode)
+		{
+		case Mode::COLOR: {
+			if (denoise) {
+				denoiserParams.maxNumThreads = settings.maxNumThreads;
+				denoiser.denoise(currentSamplesAverage, primaryDepth, primaryNormals, denoised, denoiserParams);
+				img = denoised.convert<uchar>(255, 0);
+			} else {
 				img = currentSamplesAverage.convert<uchar>(255, 0);
-				break;
 			}
-			case Mode::DEPTH: {
-				img = currentSamplesAverage.normalized<uchar>(0, 255, hitMask, 255);
-				break;
-			}
-			default:
-				img = currentSamplesAverage.convert<uchar>(128, 128, hitMask, 255);
+			break;
+		}
+		case Mode::DEPTH: {
+			img = currentSamplesAverage.normalized<uchar>(0, 255, hitMask, 255);
+			break;
+		}
+		default:
+			img = currentSamplesAverage.convert<uchar>(128, 128, hitMask, 255);
+		}
+
+		tex.update2D(img);
+	};
+
+	static auto startLevel = [&](int l, const Cameraf& cam) {
+		settings = { numBounces, maxNumSamples, maxNumThreads, mode };
+		level = l;
+		w = std::max(1, targetRes[0] >> level);
+		h = std::max(1, targetRes[1] >> level);
+		clickedPix = clicked.cwiseProduct(v2d(w, h)).template cast<int>();
+
+		currentCam = RaycastingCameraf(cam, w, h);
+		primaryDepth.resize(w, h);
+		primaryNormals.resize(w, h);
+
+		raycaster.checkScene();
+		pass = Pass::GUIDE;
+		rayTracingTask.start(h);
+	};
+
+	rayTracingTask.setUnitFunction([&](int i) {
+		if (pass == Pass::GUIDE) {
+			guideRow(i);
+		} else {
+			shadeRow(i);
+		}
+	});
+
+	//main thread, once all rows of a pass are done
+	rayTracingTask.setPassFunction([&] {
+		if (pass == Pass::GUIDE) {
+			if (reprojectNext) {
+				//keep room for new samples, otherwise the resampled history would never be refined
+				ReprojectionParams params = reprojectionParams;
+				params.maxHistory = std::min<float>(params.maxHistory, std::max(settings.maxNumSamples - samplesPerPixel, 0));
+				params.maxNumThreads = settings.maxNumThreads;
+				reprojection.reproject(previousCam, previousDepth, previousNormals, currentCam, primaryDepth, primaryNormals, currentSamplesAverage, sampleCounts, params);
+				publish();
+			} else {
+				//a coarser level is not worth resampling, it stays displayed until the finer pass replaces it
+				currentSamplesAverage.resize(w, h);
+				sampleCounts.resize(w, h);
+				currentSamplesAverage.setTo(v3f(0, 0, 0));
+				sampleCounts.setTo(Image1f::Pixel(0));
 			}
 
-			tex.update2D(img);
+			previousCam = currentCam;
+			previousDepth = primaryDepth;
+			previousNormals = primaryNormals;
+
+			pass = Pass::SHADE;
+			rayTracingTask.start(h);
+			return;
+		}
+
+		publish();
+		if (gatherPaths) {
+			paths = gatheredPaths;
+			colors = gatheredColors;
+			normals = gatheredNormals;
+		}
+
+		if (level > 0) {
+			//coarser levels are not worth resampling, the full resolution history is
+			reprojectNext = reproject && level == 1 && fullResHistory.valid;
+			if (reprojectNext) {
+				previousCam = fullResHistory.cam;
+				previousDepth = fullResHistory.depth;
+				previousNormals = fullResHistory.normals;
+				currentSamplesAverage = fullResHistory.color;
+				sampleCounts = fullResHistory.counts;
+			}
+			startLevel(level - 1, currentCam);
+		} else if (currentNumSamples < settings.maxNumSamples) {
+			rayTracingTask.start(h);
 		} else {
 			gatherPaths = false;
 		}
+	});
+
+	sub.setUpdateFunction([&](const Input& i) {
+		tb.update(i);
+
+		if (i.keyActive(GLFW_KEY_LEFT_ALT) && i.buttonClicked(GLFW_MOUSE_BUTTON_LEFT)) {
+			if (!gatherPaths) {
+				v2d uvs = i.mousePosition().cwiseQuotient(i.viewport().diagonal());
+				uvs.y() = 1.0 - uvs.y();
+				clicked = uvs;
+				clearPaths = true;
+				gatherPaths = true;
+				showPaths = true;
+				resetRayCasting = true;
+			} else {
+				showPaths = false;
+				gatherPaths = false;
+			}
+		}
 
+		Scheduler::getMain().setNumWorkers(useMT ? maxNumThreads : 0);
+
+		const v2d viewport = i.viewport().diagonal();
+		const v2i res = v2i(std::max(1, static_cast<int>(targetHeight * viewport.x() / viewport.y())), targetHeight);
+		resetRayCasting |= (res != targetRes);
+
+		//pose only, resolution changes are handled by the refinement
+		const bool sameCam = (currentCam == tb.getCamera());
+		gatherPaths &= sameCam;
+
+		if (resetRayCasting || !sameCam) {
+			//waits for the rows in flight, buffers are then safe to modify
+			rayTracingTask.stop();
+
+			if (clearPaths) {
+				for (auto* v : { &paths, &colors, &normals, &gatheredPaths, &gatheredColors, &gatheredNormals }) {
+					v->clear();
+				}
+				clearPaths = false;
+			}
+
+			if (resetRayCasting) {
+				fullResHistory.valid = false;
+			} else if (level == 0 && pass == Pass::SHADE) {
+				fullResHistory = { currentCam, primaryDepth, sampleCounts, primaryNormals, currentSamplesAverage, true };
+			}
+
+			targetRes = res;
+			reprojectNext = reproject && !resetRayCasting;
+			startLevel(progressive ? coarsestLevel : 0, tb.getCamera());
+			resetRayCasting = false;
+		} else if (redenoise && !rayTracingTask.running()) {
+			//converged, no pass left to publish the new parameters, workers are idle
+			publish();
+		}
+		redenoise = false;
 	});
 
+	sub.setProgressiveTask(rayTracingTask, 8.0);
+
 	sub.setRenderingFunction([&](Framebuffer& dst) {
 		if (gatherPaths) {
 			ImGui::BeginTooltip();
@@ -819,7 +1019,7 @@ SubWindow rayTracingWin()
 			ImGui::EndTooltip();
 		}
 
-		dst.blitFrom(tex);
+		dst.blitFrom(tex, GL_COLOR_ATTACHMENT0, GL_LINEAR);
 		if (showPaths) {		
 			auto meshPaths = MeshGL::fromEndPoints(paths);
 			meshPaths.setColors(colors);
@@ -857,16 +1057,19 @@ SubWindow raymarching_win()
 	static MeshGL unitCube = gloops::Mesh::getCube();
 	unitCube.backface_culling = false;
 
-	static ShaderProgram shaderRaymarching, shaderSlice, shaderSDF;
+	static ShaderProgram shaderRaymarching, shaderSlice, shaderSDF, shaderSparseSDF;
 	static Uniform<v3f> eye_pos = { "eye_pos" }, bmax = { "bmax", 0.5*v3f(1,1,1) }, bmin = { "bmin", 0.5*v3f(-1,-1,-1) };
 	static Uniform<v3i> gridSize = { "gridSize", 256 * v3i(1,1,1) };
 	static Uniform<float> intensity = { "intensity" , 3.0f }, sdf_offset = { "sdf_offset", 0.5f };
+	static Uniform<bool> useMacroCells = { "use_macro_cells", true };
+	static Uniform<int> macroCellSize = { "macro_cell_size", 8 };
+	static Uniform<v3i> macroVolumeSize = { "macro_volume_size" };
 	
 	shaderRaymarching.init(
 		gloops::ShaderCollection::vertexMeshInterface(), 
 		gloops::loadFile(gloops_demo_shaders_folder + "voxel_grid_raymarching.frag")
 	);
-	shaderRaymarching.addUniforms(shaders.vp, shaders.model, eye_pos, bmin, bmax, gridSize, intensity);
+	shaderRaymarching.addUniforms(shaders.vp, shaders.model, eye_pos, bmin, bmax, gridSize, intensity, useMacroCells, macroCellSize, macroVolumeSize);
 
 	shaderSlice.init(
 		gloops::ShaderCollection::vertexMeshInterface(),
@@ -878,7 +1081,40 @@ SubWindow raymarching_win()
 		gloops::ShaderCollection::vertexMeshInterface(),
 		gloops::loadFile(gloops_demo_shaders_folder + "texture3D_sdf.frag")
 	);
-	shaderSDF.addUniforms(shaders.vp, shaders.model, eye_pos, bmin, bmax, gridSize, sdf_offset);
+	shaderSDF.addUniforms(shaders.vp, shaders.model, eye_pos, bmin, bmax, gridSize, sdf_offset, useMacroCells, macroCellSize, macroVolumeSize);
+
+	// same iso-surface shader, reading from the sparse volume
+	std::string sparseSDF = gloops::loadFile(gloops_demo_shaders_folder + "texture3D_sdf.frag");
+	sparseSDF.insert(sparseSDF.find('\n') + 1, SparseVolumeGL::glslSampling());
+	const std::string denseLookup = "texture(tex, (pos - bmin)/(bmax-bmin)).x", sparseLookup = "sampleSparse((pos - bmin)/(bmax-bmin))";
+	sparseSDF.replace(sparseSDF.find(denseLookup), denseLookup.size(), sparseLookup);
+	shaderSparseSDF.init(gloops::ShaderCollection::vertexMeshInterface(), sparseSDF);
+	shaderSparseSDF.addUniforms(shaders.vp, shaders.model, eye_pos, bmin, bmax, gridSize, sdf_offset, useMacroCells, macroCellSize, macroVolumeSize);
+
+	enum class Source { GAUSSIAN, TORUS_SDF, TORUS_VOXELS, SPARSE_TORUS };
+	static const std::map<Source, std::string> sources = {
+		{ Source::GAUSSIAN, "Gaussian" },
+		{ Source::TORUS_SDF, "Torus SDF" },
+		{ Source::TORUS_VOXELS, "Torus voxels" },
+		{ Source::SPARSE_TORUS, "Sparse torus" },
+	};
+	static Source source = Source::GAUSSIAN;
+
+	// empty space skipping grids of each source, and their volumes in the unit cube for the CPU reference
+	struct MacroCellsGL {
+		Texture tex;
+		v3i volumeSize;
+		Volume1b volume;
+	};
+	static std::map<Source, MacroCellsGL> macroCells;
+	auto setupMacroCells = [&](Source src, const Volume1b& vol) {
+		MacroCellParams macroParams;
+		macroParams.cellSize = macroCellSize;
+		macroCells[src].tex.update3D(buildMacroCells(vol, macroParams));
+		macroCells[src].volumeSize = vol.size();
+		macroCells[src].volume = vol;
+		macroCells[src].volume.setBox(BBox3f(bmin.get(), bmax.get()));
+	};
 
 	const int a = 64;
 	const int w = a, h = a, d = a;
@@ -886,27 +1122,72 @@ SubWindow raymarching_win()
 	params.setTarget(GL_TEXTURE_3D).setFormat(GL_RED).setInternalFormat(GL_R8).setWrapAll(GL_CLAMP_TO_BORDER);
 	
 	static Texture density = Texture(w, h, d, 1, params);
-	std::vector<uchar> voxelData(w * h * d, 0);
+	Volume1b voxelData(w, h, d, 0);
 	for (int i = 0; i < d; ++i) {
 		for (int j = 0; j < h; ++j) {
 			for (int k = 0; k < w; ++k) {
 				float x = 1.0f + 0.75f * (randomVec<float, 1>().x());
 				float di = i - d / 2.0f, dj = j - h / 2.0f, dk = k - w / 2.0f;
 				float diff = exp(-(di * di + dj * dj + dk * dk)/(2*a));
-				voxelData[k + w * (j + h * i)] = saturate_cast<uchar>(255.0f * diff * x);
+				voxelData.at(k, j, i) = saturate_cast<uchar>(255.0f * diff * x);
 			}
 		}
 	}
 	density.updloadToGPU3D(0, 0, 0, 0, w, h, d, voxelData.data());
+	setupMacroCells(Source::GAUSSIAN, voxelData);
+
+	// torus distance field, mapped so that 0.5 is the surface and the volume border is at distance +-1/4 of the box side
+	static Texture torusSDF;
+	static SparseVolumeGL sparseTorus;
+	{
+		SDFParams sdfParams;
+		sdfParams.resolution = 128;
+		const Volume1f sdf = meshToSDF(Mesh::getTorus(3, 1), sdfParams);
+		const double range = 0.25 * sdf.box().sizes()[0];
+		const Volume1b torusData = sdf.convert<uchar>(-127.5 / range, 127.5);
+		torusSDF.update3D(torusData);
+		setupMacroCells(Source::TORUS_SDF, torusData);
+
+		// narrow band of 4 voxels, so that bricks away from the surface are empty
+		const double bandRange = 4 * sdf.cellSize()[0];
+		const Volume1b band = sdf.convert<uchar>(-127.5 / bandRange, 127.5);
+		const SparseVolume sparse = SparseVolume::fromDense(band);
+		if (!sparse) {
+			addToLogs(LogType::ERROR, "sparse torus could not be built");
+		}
+		setupMacroCells(Source::SPARSE_TORUS, band);
+		sparseTorus.upload(sparse);
+		sparseTorus.addUniformsTo(shaderSparseSDF);
+		addToLogs(LogType::LOG, "sparse torus : " + std::to_string(sparse.numStoredBricks()) + " / " + std::to_string(sparse.numBricks().prod()) + " bricks");
+	}
+
+	// solid torus density, 2x2x2 subvoxels
+	static Texture torusVoxels;
+	{
+		VoxelizationParams voxParams;
+		voxParams.resolution = 64;
+		voxParams.solid = true;
+		voxParams.supersampling = 2;
+		const Volume1b torusData = voxelizeDensity(Mesh::getTorus(3, 1), voxParams);
+		torusVoxels.update3D(torusData);
+		setupMacroCells(Source::TORUS_VOXELS, torusData);
+	}
 
 	static bool slice = false;
 	static float slice_range = 0;
 
+	static RaycastingCameraf lastEye;
+	static Texture cpuReference;
+
 	win.setGuiFunction([&] {
 		int mode_id = 0;
 		for (const auto& imode : modes) {
 			if (ImGui::RadioButton((imode.second).c_str(), mode == imode.first)) {
 				mode = imode.first;
+				// only the iso-surface shader reads the sparse volume
+				if (mode != Mode::ISOSURFACE && source == Source::SPARSE_TORUS) {
+					source = Source::TORUS_SDF;
+				}
 			}
 			if (mode_id != ((int)modes.size() - 1)) {
 				ImGui::SameLine();
@@ -918,6 +1199,23 @@ SubWindow raymarching_win()
 			gridSize = gridSize.get()[0] * v3i(1, 1, 1);
 		}
 
+		ImGui::SameLine();
+		ImGui::Checkbox("empty space skipping", &useMacroCells.get());
+
+		int source_id = 0;
+		for (const auto& isource : sources) {
+			if (ImGui::RadioButton((isource.second).c_str(), source == isource.first)) {
+				source = isource.first;
+				if (source == Source::SPARSE_TORUS) {
+					mode = Mode::ISOSURFACE;
+				}
+			}
+			if (source_id != ((int)sources.size() - 1)) {
+				ImGui::SameLine();
+			}
+			++source_id;
+		}
+
 		switch (mode)
 		{
 		case Mode::SLICE:
@@ -927,10 +1225,30 @@ SubWindow raymarching_win()
 		default:
 			ImGui::SliderFloat("intensity", &intensity.get(), 2, 4);
 		}
+
+		// same traversal on the CPU, with the volume grid as grid size
+		if (mode != Mode::SLICE && ImGui::Button("CPU reference")) {
+			VolumeRaymarchingParams cpuParams;
+			cpuParams.mode = (mode == Mode::ISOSURFACE ? VolumeRenderMode::ISOSURFACE : VolumeRenderMode::DENSITY);
+			cpuParams.intensity = intensity;
+			cpuParams.sdfOffset = sdf_offset;
+			cpuParams.useMacroCells = useMacroCells;
+
+			VolumeRaymarcher raymarcher(macroCells.at(source).volume);
+			const auto start = std::chrono::steady_clock::now();
+			const Image4f img = raymarcher.render(lastEye, cpuParams);
+			const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			cpuReference.update2D(img.convert<uchar>(255, 0), DefaultTexParams<Image4b>().disableMipmap());
+			addToLogs(LogType::LOG, "CPU reference : " + std::to_string(ms) + " ms, " + std::to_string(raymarcher.numSamples()) + " samples");
+		}
+		if (cpuReference.w() > 0) {
+			ImGui::Image((ImTextureID)cpuReference.getId(), { 200.0f, 200.0f * cpuReference.h() / cpuReference.w() }, { 0,1 }, { 1,0 });
+		}
 	});
 
 	win.setRenderingFunction([&](Framebuffer& dst) {
 		const RaycastingCameraf eye = RaycastingCameraf(tb.getCamera(), v2i(dst.w(), dst.h()));
+		lastEye = eye;
 			
 		glEnable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -945,7 +1263,20 @@ SubWindow raymarching_win()
 		shaders.vp = eye.viewProj();
 		shaders.model = m4f::Identity();
 
-		density.bindSlot(GL_TEXTURE0);
+		macroCells.at(source).tex.bindSlot(GL_TEXTURE3);
+		macroVolumeSize = macroCells.at(source).volumeSize;
+
+		switch (source)
+		{
+		case Source::SPARSE_TORUS:
+			sparseTorus.bind(); break;
+		case Source::TORUS_SDF:
+			torusSDF.bindSlot(GL_TEXTURE0); break;
+		case Source::TORUS_VOXELS:
+			torusVoxels.bindSlot(GL_TEXTURE0); break;
+		default:
+			density.bindSlot(GL_TEXTURE0);
+		}
 
 		switch (mode)
 		{
@@ -955,7 +1286,7 @@ SubWindow raymarching_win()
 			break;
 		}
 		case Mode::ISOSURFACE: {
-			shaderSDF.use();
+			(source == Source::SPARSE_TORUS ? shaderSparseSDF : shaderSDF).use();
 			unitCube.draw();
 			break;
 		}
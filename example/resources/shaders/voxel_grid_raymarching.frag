@@ -12,6 +12,12 @@ uniform vec3 eye_pos, bmin, bmax;
 uniform ivec3 gridSize;
 uniform float intensity;
 
+// min max macro cells, see gloops::buildMacroCells
+layout(binding = 3) uniform sampler3D macro_cells;
+uniform bool use_macro_cells = false;
+uniform int macro_cell_size = 8;
+uniform ivec3 macro_volume_size;
+
 vec4 sampleTex(ivec3 cell) {
 	return texture(tex, (vec3(cell) + 0.5)/vec3(gridSize));
 }
@@ -37,6 +43,35 @@ ivec3 getCell(vec3 p){
 	return ivec3(floor(vec3(gridSize) * uv));
 }
 
+bool insideBox(vec3 p){
+	return all(greaterThanEqual(p, bmin)) && all(greaterThanEqual(bmax, p));
+}
+
+// distance along dir to leave the macro cell containing p if its max is at most threshold, 0 otherwise
+float macroCellSkip(vec3 p, vec3 dir, float threshold) {
+	if (!use_macro_cells) {
+		return 0.0;
+	}
+	vec3 volumeSize = vec3(macro_volume_size);
+	ivec3 macro = min(ivec3(clamp((p - bmin)/(bmax - bmin), 0.0, 1.0) * volumeSize), macro_volume_size - 1) / macro_cell_size;
+	if (texelFetch(macro_cells, macro, 0).y > threshold) {
+		return 0.0;
+	}
+	vec3 lo = bmin + (bmax - bmin) * min(vec3(macro * macro_cell_size) / volumeSize, 1.0);
+	vec3 hi = bmin + (bmax - bmin) * min(vec3((macro + 1) * macro_cell_size) / volumeSize, 1.0);
+	return max(0.0, minCoef(max((lo - p)/dir, (hi - p)/dir)));
+}
+
+// cell containing p and absolute t of the next cell boundaries along each axis
+void setupTraversal(vec3 start, float t, vec3 dir, vec3 cellSize, vec3 deltas, out ivec3 cell, out vec3 ts) {
+	vec3 p = clamp(start + t*dir, bmin, bmax - 0.001*cellSize);
+	cell = getCell(p);
+	vec3 fracs = fract((p - bmin)/cellSize);
+	for(int k=0; k<3; ++k){
+		ts[k] = t + deltas[k] * (dir[k] >= 0 ? 1.0 - fracs[k] : fracs[k]);
+	}
+}
+
 float boxIntersection(vec3 rayDir) {
 	vec3 minTs = (bmin - eye_pos)/rayDir;
 	vec3 maxTs = (bmax - eye_pos)/rayDir;
@@ -67,23 +102,35 @@ void main(){
 
 	vec3 cellSize = (bmax - bmin)/vec3(gridSize); 
 	start = clamp(start, bmin, bmax - 0.001*cellSize);
-	ivec3 currentCell = getCell(start);
 
 	//setup raymarching
 	vec3 deltas = cellSize / abs(dir);
-	vec3 fracs = fract((start - bmin)/cellSize);			
 	vec3 ts;
-	ivec3 finalCell, steps;
+	ivec3 currentCell, finalCell, steps;
+	setupTraversal(start, 0.0, dir, cellSize, deltas, currentCell, ts);
 	for(int k=0; k<3; ++k){
 		steps[k] = (dir[k] >= 0 ? 1 : -1);
-		ts[k] = deltas[k] * (dir[k] >= 0 ? 1.0 - fracs[k] : fracs[k]);
 		finalCell[k] = (dir[k] >= 0 ? gridSize[k] : -1);
 	}
 
+	// the output no longer changes past this opacity
+	float saturation = max(0.2, 1.0 / max(intensity, 1e-3));
+
 	float t = 0, alpha = 0;
 
 	//actual raymarching
 	do {
+		// leap over empty macro cells
+		float skip = macroCellSkip(start + t*dir, dir, 0.0);
+		if (skip > 0.0) {
+			t += skip + 0.001*minCoef(cellSize);
+			if (!insideBox(start + t*dir)) {
+				break;
+			}
+			setupTraversal(start, t, dir, cellSize, deltas, currentCell, ts);
+			continue;
+		}
+
 		int c = getMinIndex(ts);
 		currentCell[c] += steps[c];
 
@@ -94,8 +141,12 @@ void main(){
 		
 		alpha += delta_t * sampleTex(currentCell).x;
 		//delta_t * sampleTex(start + (t - 0.5*delta_t)*dir).x;
+
+		if (alpha >= saturation) {
+			break;
+		}
 	
 	} while (all(notEqual(currentCell, finalCell)));
 			
-	outColor = vec4(mix(vec3(1,1,0),vec3(1), intensity*alpha),  min(5*alpha, 1.0));
+	outColor = vec4(mix(vec3(1,1,0),vec3(1), min(intensity*alpha, 1.0)),  min(5*alpha, 1.0));
 }
\ No newline at end of file
@@ -0,0 +1,381 @@
+#include "Baking.hpp"
+#include "Utils.hpp"
+
+#include <random>
+
+namespace gloops {
+
+	namespace {
+
+		using Ray = RayT<float>;
+
+		// Duff et al. 2017, building an orthonormal basis, revisited
+		void orthonormalBasis(const v3f& n, v3f& t, v3f& b)
+		{
+			const float sign = std::copysign(1.0f, n[2]);
+			const float a = -1.0f / (sign + n[2]);
+			const float c = n[0] * n[1] * a;
+			t = v3f(1 + sign * n[0] * n[0] * a, sign * c, -sign * n[0]);
+			b = v3f(c, sign + n[1] * n[1] * a, -n[1]);
+		}
+
+		v3f cosineSample(const v3f& n, const v3f& t, const v3f& b, float u, float v)
+		{
+			const float r = std::sqrt(u), phi = 2 * pi<float>() * v;
+			return r * std::cos(phi) * t + r * std::sin(phi) * b + std::sqrt(std::max(0.0f, 1 - u)) * n;
+		}
+
+		// world space positions and area weighted normals
+		void worldSpaceVertices(const Mesh& mesh, std::vector<v3f>& positions, std::vector<v3f>& normals)
+		{
+			const auto& verts = mesh.getVertices();
+			const auto& tris = mesh.getTriangles();
+			const m4f& model = mesh.model();
+			const m3f normalMatrix = model.block<3, 3>(0, 0).inverse().transpose();
+
+			positions.resize(verts.size());
+			for (size_t i = 0; i < verts.size(); ++i) {
+				positions[i] = (model * verts[i].homogeneous()).hnormalized();
+			}
+
+			normals.assign(verts.size(), v3f::Zero());
+			if (mesh.getNormals().size() == verts.size()) {
+				for (size_t i = 0; i < verts.size(); ++i) {
+					normals[i] = (normalMatrix * mesh.getNormals()[i]).normalized();
+				}
+				return;
+			}
+
+			for (const auto& tri : tris) {
+				const v3f n = (positions[tri[1]] - positions[tri[0]]).cross(positions[tri[2]] - positions[tri[0]]);
+				for (int k = 0; k < 3; ++k) {
+					normals[tri[k]] += n;
+				}
+			}
+			for (auto& n : normals) {
+				n.normalize();
+			}
+		}
+	}
+
+	AmbientOcclusionBaker::AmbientOcclusionBaker(const Raycaster& raycaster, const Mesh& mesh)
+		: raycaster(raycaster), mesh(mesh), baseColors(mesh.getColors())
+	{
+		reset();
+	}
+
+	void AmbientOcclusionBaker::bake(int numSamples, const AOBakingParams& params)
+	{
+		if (numSamples <= 0) {
+			return;
+		}
+
+		std::vector<v3f> positions, normals;
+		worldSpaceVertices(mesh, positions, normals);
+		ao.resize(positions.size(), 1.0f);
+
+		// scene updates are not thread safe
+		raycaster.checkScene();
+
+		constexpr uint N = 8;
+		const int blockSize = 64;
+		const int numVertices = static_cast<int>(positions.size());
+		const int numBlocks = (numVertices + blockSize - 1) / blockSize;
+
+		parallelForEach(0, numBlocks, [&](int block) {
+			std::mt19937 generator(static_cast<uint>(block * 7919 + samples * 104729));
+			std::uniform_real_distribution<float> distribution(0, 1);
+
+			std::array<Ray, N> rays;
+			std::array<int32_t, N> valids;
+
+			for (int v = block * blockSize; v < std::min(numVertices, (block + 1) * blockSize); ++v) {
+				const v3f& n = normals[v];
+				if (!n.allFinite() || n.isZero()) {
+					continue;
+				}
+
+				v3f t, b;
+				orthonormalBasis(n, t, b);
+				const v3f origin = positions[v] + params.bias * n;
+
+				int unoccluded = 0;
+				for (int s = 0; s < numSamples; s += N) {
+					for (uint k = 0; k < N; ++k) {
+						valids[k] = (s + static_cast<int>(k) < numSamples) ? -1 : 0;
+						rays[k] = Ray(origin, cosineSample(n, t, b, distribution(generator), distribution(generator)));
+					}
+
+					const std::array<bool, N> occluded = raycaster.occlusion<N>(rays, valids, 0.0f, params.maxDistance);
+					for (uint k = 0; k < N; ++k) {
+						unoccluded += (valids[k] && !occluded[k]) ? 1 : 0;
+					}
+				}
+
+				ao[v] = (ao[v] * samples + unoccluded) / float(samples + numSamples);
+			}
+		}, params.maxNumThreads);
+
+		samples += numSamples;
+	}
+
+	void AmbientOcclusionBaker::reset()
+	{
+		ao.assign(mesh.getVertices().size(), 1.0f);
+		samples = 0;
+	}
+
+	const std::vector<float>& AmbientOcclusionBaker::values() const
+	{
+		return ao;
+	}
+
+	int AmbientOcclusionBaker::numSamples() const
+	{
+		return samples;
+	}
+
+	void AmbientOcclusionBaker::storeAsAttribute(Mesh& dst, const std::string& name) const
+	{
+		dst.setCPUattribute(name, ao);
+	}
+
+	void AmbientOcclusionBaker::storeAsColors(Mesh& dst) const
+	{
+		// from the colors at construction, so that storing again does not darken them twice
+		Mesh::Colors colors = baseColors;
+		if (colors.size() != ao.size()) {
+			colors.assign(ao.size(), v3f::Ones());
+		}
+		for (size_t i = 0; i < ao.size(); ++i) {
+			colors[i] *= ao[i];
+		}
+		dst.setColors(colors);
+	}
+
+	LightmapBaker::LightmapBaker(const Raycaster& raycaster, const Mesh& mesh)
+		: raycaster(raycaster), mesh(mesh)
+	{
+	}
+
+	Image3f LightmapBaker::bake(const LightmapParams& params)
+	{
+		const int w = std::max(params.w, 1), h = std::max(params.h, 1);
+
+		Image3f out(w, h);
+		out.setTo(v3f::Zero());
+		_coverage.resize(w, h);
+		_coverage.setTo(Image1b::Pixel(0));
+
+		const auto& uvs = mesh.getUVs();
+		const auto& tris = mesh.getTriangles();
+		if (uvs.size() != mesh.getVertices().size()) {
+			addToLogs(LogType::ERROR, "lightmap baking requires per vertex uvs");
+			return out;
+		}
+
+		std::vector<v3f> positions, normals;
+		worldSpaceVertices(mesh, positions, normals);
+
+		// scene updates are not thread safe
+		raycaster.checkScene();
+
+		// triangles binned per tile, using their texel bounding boxes expanded by one texel for conservativeness
+		const int tileSize = std::max(params.tileSize, 8);
+		const int tilesX = (w + tileSize - 1) / tileSize, tilesY = (h + tileSize - 1) / tileSize;
+		std::vector<std::vector<uint>> bins(tilesX * static_cast<size_t>(tilesY));
+
+		const v2f res = v2f(w, h);
+		for (uint t = 0; t < tris.size(); ++t) {
+			const v2f a = uvs[tris[t][0]].cwiseProduct(res), b = uvs[tris[t][1]].cwiseProduct(res), c = uvs[tris[t][2]].cwiseProduct(res);
+			const v2f bmin = a.cwiseMin(b).cwiseMin(c) - v2f(1, 1), bmax = a.cwiseMax(b).cwiseMax(c) + v2f(1, 1);
+			const int tx0 = std::clamp(static_cast<int>(std::floor(bmin[0])) / tileSize, 0, tilesX - 1);
+			const int ty0 = std::clamp(static_cast<int>(std::floor(bmin[1])) / tileSize, 0, tilesY - 1);
+			const int tx1 = std::clamp(static_cast<int>(std::floor(bmax[0])) / tileSize, 0, tilesX - 1);
+			const int ty1 = std::clamp(static_cast<int>(std::floor(bmax[1])) / tileSize, 0, tilesY - 1);
+			if (bmax[0] < 0 || bmax[1] < 0 || bmin[0] >= w || bmin[1] >= h) {
+				continue;
+			}
+			for (int ty = ty0; ty <= ty1; ++ty) {
+				for (int tx = tx0; tx <= tx1; ++tx) {
+					bins[ty * tilesX + tx].push_back(t);
+				}
+			}
+		}
+
+		constexpr uint N = 8;
+		const int numSamples = std::max(params.numSamples, 1);
+
+		auto shade = [&](const v3f& p, const v3f& n, std::mt19937& generator) -> v3f {
+			const v3f origin = p + params.bias * n;
+			std::array<Ray, N> rays;
+			std::array<int32_t, N> valids;
+			v3f sum = v3f::Zero();
+
+			if (params.mode == LightmapMode::DIRECT) {
+				const int numLights = static_cast<int>(params.lights.size());
+				for (int l = 0; l < numLights; l += N) {
+					for (uint k = 0; k < N; ++k) {
+						const bool valid = l + static_cast<int>(k) < numLights && (params.lights[l + k].position - origin).dot(n) > 0;
+						valids[k] = valid ? -1 : 0;
+						// unnormalized directions, the light is at t = 1
+						rays[k] = Ray(origin, valid ? v3f(params.lights[l + k].position - origin) : n);
+					}
+
+					const std::array<bool, N> occluded = raycaster.occlusion<N>(rays, valids, 0.0f, 0.999f);
+					for (uint k = 0; k < N; ++k) {
+						if (valids[k] && !occluded[k]) {
+							sum += rays[k].direction().normalized().dot(n) * params.lights[l + k].color;
+						}
+					}
+				}
+				return sum;
+			}
+
+			v3f t, b;
+			orthonormalBasis(n, t, b);
+			std::uniform_real_distribution<float> distribution(0, 1);
+			const bool useEnvironment = params.mode == LightmapMode::IRRADIANCE && !params.environment.empty();
+
+			for (int s = 0; s < numSamples; s += N) {
+				for (uint k = 0; k < N; ++k) {
+					valids[k] = (s + static_cast<int>(k) < numSamples) ? -1 : 0;
+					rays[k] = Ray(origin, cosineSample(n, t, b, distribution(generator), distribution(generator)));
+				}
+
+				const std::array<bool, N> occluded = raycaster.occlusion<N>(rays, valids, 0.0f, params.maxDistance);
+				for (uint k = 0; k < N; ++k) {
+					if (valids[k] && !occluded[k]) {
+						sum += useEnvironment ? params.environment.eval(rays[k].direction()) : v3f::Ones();
+					}
+				}
+			}
+			return sum / float(numSamples);
+		};
+
+		parallelForEach(0, tilesX * tilesY, [&](int tile) {
+			const int x0 = (tile % tilesX) * tileSize, y0 = (tile / tilesX) * tileSize;
+			const int tileW = std::min(tileSize, w - x0), tileH = std::min(tileSize, h - y0);
+
+			std::vector<TexelSample> samples;
+			rasterizeTile(bins[tile], x0, y0, tileW, tileH, params, samples);
+
+			std::mt19937 generator(static_cast<uint>(tile * 7919 + 1));
+			for (int y = 0; y < tileH; ++y) {
+				for (int x = 0; x < tileW; ++x) {
+					const TexelSample& sample = samples[y * tileW + x];
+					if (sample.triangle < 0) {
+						continue;
+					}
+
+					const Mesh::Tri& tri = tris[sample.triangle];
+					const v3f& c = sample.coords;
+					const v3f p = c[0] * positions[tri[0]] + c[1] * positions[tri[1]] + c[2] * positions[tri[2]];
+					v3f n = (c[0] * normals[tri[0]] + c[1] * normals[tri[1]] + c[2] * normals[tri[2]]).normalized();
+					if (!n.allFinite()) {
+						n = (positions[tri[1]] - positions[tri[0]]).cross(positions[tri[2]] - positions[tri[0]]).normalized();
+					}
+					if (!n.allFinite()) {
+						continue;
+					}
+
+					out.pixel(x0 + x, y0 + y) = shade(p, n, generator);
+					_coverage.at(x0 + x, y0 + y) = 255;
+				}
+			}
+		}, params.maxNumThreads);
+
+		dilate(out, params.gutter, params.maxNumThreads);
+
+		return out;
+	}
+
+	const Image1b& LightmapBaker::coverage() const
+	{
+		return _coverage;
+	}
+
+	void LightmapBaker::rasterizeTile(const std::vector<uint>& triangles, int x0, int y0, int tileW, int tileH, const LightmapParams& params, std::vector<TexelSample>& samples) const
+	{
+		samples.assign(tileW * static_cast<size_t>(tileH), TexelSample());
+
+		// a texel overlaps the triangle if its center is within half a diagonal of it
+		static const float halfDiagonal = std::sqrt(2.0f) / 2;
+
+		const auto& uvs = mesh.getUVs();
+		const auto& tris = mesh.getTriangles();
+		const v2f res = v2f(params.w, params.h);
+
+		auto cross = [](const v2f& a, const v2f& b) {
+			return a[0] * b[1] - a[1] * b[0];
+		};
+
+		for (uint t : triangles) {
+			const v2f p0 = uvs[tris[t][0]].cwiseProduct(res), p1 = uvs[tris[t][1]].cwiseProduct(res), p2 = uvs[tris[t][2]].cwiseProduct(res);
+			const float area2 = cross(p1 - p0, p2 - p0);
+			if (std::abs(area2) < 1e-12f) {
+				continue;
+			}
+			const v3f invLengths = v3f((p2 - p1).norm(), (p0 - p2).norm(), (p1 - p0).norm()).cwiseInverse() * std::abs(area2);
+
+			const v2f bmin = p0.cwiseMin(p1).cwiseMin(p2), bmax = p0.cwiseMax(p1).cwiseMax(p2);
+			const int xMin = std::max(x0, static_cast<int>(std::floor(bmin[0] - 1))), xMax = std::min(x0 + tileW - 1, static_cast<int>(std::ceil(bmax[0] + 1)));
+			const int yMin = std::max(y0, static_cast<int>(std::floor(bmin[1] - 1))), yMax = std::min(y0 + tileH - 1, static_cast<int>(std::ceil(bmax[1] + 1)));
+
+			for (int y = yMin; y <= yMax; ++y) {
+				for (int x = xMin; x <= xMax; ++x) {
+					const v2f c(x + 0.5f, y + 0.5f);
+					const v3f coords = v3f(cross(p2 - p1, c - p1), cross(p0 - p2, c - p2), cross(p1 - p0, c - p0)) / area2;
+
+					// signed distances to the edges, in texels
+					const float score = coords.cwiseProduct(invLengths).minCoeff();
+					TexelSample& sample = samples[(y - y0) * tileW + (x - x0)];
+					if (score < -halfDiagonal || score <= sample.score) {
+						continue;
+					}
+
+					const v3f clamped = coords.cwiseMax(0.0f);
+					sample.triangle = static_cast<int>(t);
+					sample.coords = clamped / clamped.sum();
+					sample.score = score;
+				}
+			}
+		}
+	}
+
+	void LightmapBaker::dilate(Image3f& lightmap, int iterations, int numThreads) const
+	{
+		Image1b mask = _coverage, previousMask;
+		Image3f previous;
+
+		for (int it = 0; it < iterations; ++it) {
+			previous = lightmap;
+			previousMask = mask;
+
+			parallelForEach(0, lightmap.h(), [&](int y) {
+				for (int x = 0; x < lightmap.w(); ++x) {
+					if (previousMask.at(x, y)) {
+						continue;
+					}
+
+					v3f sum = v3f::Zero();
+					int count = 0;
+					for (int dy = -1; dy <= 1; ++dy) {
+						for (int dx = -1; dx <= 1; ++dx) {
+							if (previousMask.boundsCheck(x + dx, y + dy) && previousMask.at(x + dx, y + dy)) {
+								sum += previous.pixel(x + dx, y + dy);
+								++count;
+							}
+						}
+					}
+
+					if (count > 0) {
+						lightmap.pixel(x, y) = sum / float(count);
+						mask.at(x, y) = 255;
+					}
+				}
+			}, numThreads);
+		}
+	}
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "config.hpp"
+#include "Image.hpp"
+#include "EnvironmentLight.hpp"
+#include "Mesh.hpp"
+#include "Raycasting.hpp"
+
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace gloops {
+
+	struct AOBakingParams {
+		float maxDistance = std::numeric_limits<float>::infinity();
+		float bias = 1e-3f;		// ray origins offset along the normal, in world units
+		int maxNumThreads = 256;
+	};
+
+	// progressive per vertex ambient occlusion, cosine weighted occlusion rays traced by packets
+	// values are in [0,1], 1 meaning unoccluded
+	class AmbientOcclusionBaker {
+
+	public:
+		AmbientOcclusionBaker(const Raycaster& raycaster, const Mesh& mesh);
+
+		// numSamples more rays per vertex, accumulated with the previous calls
+		void bake(int numSamples, const AOBakingParams& params = {});
+		void reset();
+
+		const std::vector<float>& values() const;
+		int numSamples() const;
+
+		void storeAsAttribute(Mesh& mesh, const std::string& name = "ao") const;
+
+		// modulates the per vertex colors the mesh had when the baker was built, grey levels otherwise
+		void storeAsColors(Mesh& mesh) const;
+
+	protected:
+		Raycaster raycaster;
+		Mesh mesh;
+		Mesh::Colors baseColors;
+		std::vector<float> ao;
+		int samples = 0;
+	};
+
+	// all modes are normalized so that an unoccluded white sky, or a light facing the surface, gives 1
+	// AO: sky visibility, DIRECT: sum of the point lights diffuse terms with shadows,
+	// IRRADIANCE: environment radiance times visibility, cosine weighted
+	enum class LightmapMode { AO, DIRECT, IRRADIANCE };
+
+	struct PointLight {
+		v3f position = v3f::Zero(), color = v3f::Ones();
+	};
+
+	struct LightmapParams {
+		int w = 1024, h = 1024;
+		LightmapMode mode = LightmapMode::AO;
+		int numSamples = 64;		// hemisphere rays per texel, AO and IRRADIANCE
+		float maxDistance = std::numeric_limits<float>::infinity();
+		float bias = 1e-3f;
+		int gutter = 2;				// dilation iterations around uv charts, against bilinear bleeding
+		int tileSize = 64;
+		std::vector<PointLight> lights;
+		EnvironmentLight environment;	// white sky if empty
+		int maxNumThreads = 256;
+	};
+
+	// bakes lighting at the texel centers of the mesh uv layout, row y of the result is at v = (y + 0.5) / h,
+	// as expected by Texture::update2D, convert<uchar>(255, 0) gives an Image3b
+	// triangles are conservatively rasterized per tile, texels covered by several triangles go to the one containing their center
+	class LightmapBaker {
+
+	public:
+		LightmapBaker(const Raycaster& raycaster, const Mesh& mesh);
+
+		Image3f bake(const LightmapParams& params = {});
+
+		// 255 for texels covered by a triangle, before dilation
+		const Image1b& coverage() const;
+
+	protected:
+		struct TexelSample {
+			int triangle = -1;
+			v3f coords = v3f::Zero();
+			float score = -std::numeric_limits<float>::infinity();
+		};
+
+		void rasterizeTile(const std::vector<uint>& triangles, int x0, int y0, int tileW, int tileH, const LightmapParams& params, std::vector<TexelSample>& samples) const;
+		void dilate(Image3f& lightmap, int iterations, int numThreads) const;
+
+		Raycaster raycaster;
+		Mesh mesh;
+		Image1b _coverage;
+	};
+
+}
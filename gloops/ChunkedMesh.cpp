@@ -0,0 +1,628 @@
+#include "ChunkedMesh.hpp"
+#include "Debug.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <queue>
+
+namespace gloops {
+
+	namespace {
+
+		constexpr char Magic[4] = { 'G', 'L', 'C', 'K' };
+		constexpr uint64_t Alignment = 64;
+
+		struct Header {
+			char magic[4];
+			uint32_t version;
+			uint32_t numChunks, numNodes;
+			uint64_t numTriangles;
+			uint64_t nodesOffset, chunksOffset;
+		};
+
+		uint64_t align(uint64_t offset) {
+			return (offset + Alignment - 1) / Alignment * Alignment;
+		}
+
+		template<typename T>
+		Mesh::Box toBox(const T& record) {
+			return Mesh::Box(v3f(record.min[0], record.min[1], record.min[2]), v3f(record.max[0], record.max[1], record.max[2]));
+		}
+
+		template<typename T>
+		void fromBox(const Mesh::Box& box, T& record) {
+			for (int k = 0; k < 3; ++k) {
+				record.min[k] = box.min()[k];
+				record.max[k] = box.max()[k];
+			}
+		}
+	}
+
+	bool ChunkedMesh::build(const std::string& path, const MeshCache& source, int mesh, const ChunkedMeshParams& params)
+	{
+		if (mesh < 0 || mesh >= source.numMeshes()) {
+			return false;
+		}
+
+		Source arrays;
+		arrays.triangles = source.triangles(mesh).data;
+		arrays.numTriangles = source.triangles(mesh).size();
+		arrays.vertices = source.vertices(mesh).data;
+		arrays.numVertices = source.vertices(mesh).size();
+		if (source.normals(mesh).size() == arrays.numVertices) {
+			arrays.normals = source.normals(mesh).data;
+		}
+		if (source.colors(mesh).size() == arrays.numVertices) {
+			arrays.colors = source.colors(mesh).data;
+		}
+		if (source.uvs(mesh).size() == arrays.numVertices) {
+			arrays.uvs = source.uvs(mesh).data;
+		}
+		return build(path, arrays, params);
+	}
+
+	bool ChunkedMesh::build(const std::string& path, const Mesh& mesh, const ChunkedMeshParams& params)
+	{
+		Source arrays;
+		arrays.triangles = mesh.getTriangles().data();
+		arrays.numTriangles = mesh.getTriangles().size();
+		arrays.vertices = mesh.getVertices().data();
+		arrays.numVertices = mesh.getVertices().size();
+		if (mesh.getNormals().size() == arrays.numVertices) {
+			arrays.normals = mesh.getNormals().data();
+		}
+		if (mesh.getColors().size() == arrays.numVertices) {
+			arrays.colors = mesh.getColors().data();
+		}
+		if (mesh.getUVs().size() == arrays.numVertices) {
+			arrays.uvs = mesh.getUVs().data();
+		}
+		return build(path, arrays, params);
+	}
+
+	bool ChunkedMesh::build(const std::string& path, const Source& source, const ChunkedMeshParams& params)
+	{
+		// triangles with invalid indices are dropped
+		std::vector<uint> order;
+		order.reserve(source.numTriangles);
+		for (size_t t = 0; t < source.numTriangles; ++t) {
+			const Mesh::Tri& tri = source.triangles[t];
+			if (tri[0] < source.numVertices && tri[1] < source.numVertices && tri[2] < source.numVertices) {
+				order.push_back(static_cast<uint>(t));
+			}
+		}
+
+		// three times the centroid, enough for comparisons
+		auto centroid = [&](uint t) -> v3f {
+			const Mesh::Tri& tri = source.triangles[t];
+			return source.vertices[tri[0]] + source.vertices[tri[1]] + source.vertices[tri[2]];
+		};
+
+		struct BuildNode {
+			size_t begin, end;
+			int left = -1, right = -1, chunk = -1;
+		};
+
+		// breadth first median splits along the largest extent of the centroids, children always come after their parent
+		const size_t maxTriangles = static_cast<size_t>(std::max(params.maxTrianglesPerChunk, 1));
+		std::vector<BuildNode> tree = { BuildNode{ 0, order.size() } };
+		for (size_t i = 0; i < tree.size(); ++i) {
+			const size_t begin = tree[i].begin, end = tree[i].end;
+			if (end - begin <= maxTriangles) {
+				continue;
+			}
+
+			Mesh::Box bounds;
+			bounds.setEmpty();
+			for (size_t j = begin; j < end; ++j) {
+				bounds.extend(centroid(order[j]));
+			}
+			int axis;
+			bounds.sizes().maxCoeff(&axis);
+
+			const size_t mid = begin + (end - begin) / 2;
+			std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](uint a, uint b) {
+				return centroid(a)[axis] < centroid(b)[axis];
+			});
+
+			tree[i].left = static_cast<int>(tree.size());
+			tree[i].right = static_cast<int>(tree.size() + 1);
+			tree.push_back(BuildNode{ begin, mid });
+			tree.push_back(BuildNode{ mid, end });
+		}
+
+		// chunks in depth first order, so that neighbors are close in the file
+		std::vector<int> leaves, stack = { 0 };
+		while (!stack.empty()) {
+			const int i = stack.back();
+			stack.pop_back();
+			if (tree[i].left < 0) {
+				tree[i].chunk = static_cast<int>(leaves.size());
+				leaves.push_back(i);
+			} else {
+				stack.push_back(tree[i].right);
+				stack.push_back(tree[i].left);
+			}
+		}
+
+		const std::string tmpPath = path + ".tmp";
+		std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!out) {
+			return false;
+		}
+
+		Header header = {};
+		std::memcpy(header.magic, Magic, sizeof(Magic));
+		header.version = Version;
+		header.numChunks = static_cast<uint32_t>(leaves.size());
+		header.numNodes = static_cast<uint32_t>(tree.size());
+		header.numTriangles = order.size();
+		out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+		uint64_t position = sizeof(Header);
+		auto write = [&](const void* data, size_t numBytes) -> uint64_t {
+			if (numBytes == 0) {
+				return 0;
+			}
+			const char zeros[Alignment] = {};
+			const uint64_t offset = align(position);
+			out.write(zeros, offset - position);
+			out.write(static_cast<const char*>(data), numBytes);
+			position = offset + numBytes;
+			return offset;
+		};
+
+		struct Gathered {
+			Mesh::Triangles triangles;
+			Mesh::Vertices vertices;
+			Mesh::Normals normals;
+			Mesh::Colors colors;
+			Mesh::UVs uvs;
+			Mesh::Box box;
+		};
+
+		// chunks are gathered in parallel by batches, so that only a few of them are in memory at once
+		constexpr int batchSize = 64;
+		std::vector<Chunk> records(leaves.size());
+		for (size_t first = 0; first < leaves.size(); first += batchSize) {
+			const int count = static_cast<int>(std::min<size_t>(batchSize, leaves.size() - first));
+			std::vector<Gathered> gathered(count);
+
+			parallelForEach(0, count, [&](int b) {
+				const BuildNode& node = tree[leaves[first + b]];
+				Gathered& chunk = gathered[b];
+
+				// sorted global ids of the chunk vertices, local ids are their ranks
+				std::vector<uint> ids;
+				ids.reserve(3 * (node.end - node.begin));
+				for (size_t j = node.begin; j < node.end; ++j) {
+					const Mesh::Tri& tri = source.triangles[order[j]];
+					ids.insert(ids.end(), { tri[0], tri[1], tri[2] });
+				}
+				std::sort(ids.begin(), ids.end());
+				ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+				chunk.triangles.resize(node.end - node.begin);
+				for (size_t j = node.begin; j < node.end; ++j) {
+					const Mesh::Tri& tri = source.triangles[order[j]];
+					for (int k = 0; k < 3; ++k) {
+						chunk.triangles[j - node.begin][k] = static_cast<uint>(std::lower_bound(ids.begin(), ids.end(), tri[k]) - ids.begin());
+					}
+				}
+
+				chunk.box.setEmpty();
+				chunk.vertices.resize(ids.size());
+				for (size_t v = 0; v < ids.size(); ++v) {
+					chunk.vertices[v] = source.vertices[ids[v]];
+					chunk.box.extend(chunk.vertices[v]);
+				}
+				auto gather = [&](const auto* src, auto& dst) {
+					if (src) {
+						dst.resize(ids.size());
+						for (size_t v = 0; v < ids.size(); ++v) {
+							dst[v] = src[ids[v]];
+						}
+					}
+				};
+				gather(source.normals, chunk.normals);
+				gather(source.colors, chunk.colors);
+				gather(source.uvs, chunk.uvs);
+			}, params.maxNumThreads);
+
+			for (int b = 0; b < count; ++b) {
+				const Gathered& chunk = gathered[b];
+				Chunk& record = records[first + b];
+				fromBox(chunk.box, record);
+				record.numVertices = static_cast<uint32_t>(chunk.vertices.size());
+				record.numTriangles = static_cast<uint32_t>(chunk.triangles.size());
+				record.triangles = write(chunk.triangles.data(), chunk.triangles.size() * sizeof(Mesh::Tri));
+				record.vertices = write(chunk.vertices.data(), chunk.vertices.size() * sizeof(Mesh::Vert));
+				record.normals = write(chunk.normals.data(), chunk.normals.size() * sizeof(v3f));
+				record.colors = write(chunk.colors.data(), chunk.colors.size() * sizeof(v3f));
+				record.uvs = write(chunk.uvs.data(), chunk.uvs.size() * sizeof(v2f));
+			}
+		}
+
+		// node boxes bottom up
+		std::vector<Mesh::Box> boxes(tree.size());
+		std::vector<Node> nodeRecords(tree.size());
+		for (size_t i = tree.size(); i-- > 0;) {
+			const BuildNode& node = tree[i];
+			if (node.chunk >= 0) {
+				boxes[i] = toBox(records[node.chunk]);
+			} else {
+				boxes[i] = boxes[node.left].merged(boxes[node.right]);
+			}
+			Node& record = nodeRecords[i];
+			fromBox(boxes[i], record);
+			record.left = node.left;
+			record.right = node.right;
+			record.chunk = node.chunk;
+			record.padding = 0;
+		}
+
+		header.nodesOffset = write(nodeRecords.data(), nodeRecords.size() * sizeof(Node));
+		header.chunksOffset = write(records.data(), records.size() * sizeof(Chunk));
+		out.seekp(0);
+		out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		out.close();
+		if (!out) {
+			return false;
+		}
+
+		// written aside then renamed, so that readers never see partial files
+		std::error_code error;
+		std::filesystem::rename(tmpPath, path, error);
+		if (error) {
+			std::filesystem::remove(tmpPath, error);
+			return false;
+		}
+		return true;
+	}
+
+	ChunkedMesh::ChunkedMesh(size_t memoryBudget)
+		: _cache([this](int chunk) { return loadChunk(chunk); }, [](int, const Mesh& mesh) { return sizeOf(mesh); }, memoryBudget)
+	{
+		box.setEmpty();
+	}
+
+	bool ChunkedMesh::open(const std::string& path)
+	{
+		_cache.clear();
+		nodes = nullptr;
+		chunks = nullptr;
+		_numChunks = 0;
+		_numTriangles = 0;
+		box.setEmpty();
+
+		if (!file.open(path) || file.size() < sizeof(Header)) {
+			file.close();
+			return false;
+		}
+
+		Header header;
+		std::memcpy(&header, file.data(), sizeof(Header));
+		const uint64_t size = file.size();
+		bool valid = std::memcmp(header.magic, Magic, sizeof(Magic)) == 0 && header.version == Version && header.numNodes > 0 &&
+			header.nodesOffset % Alignment == 0 && header.nodesOffset + uint64_t(header.numNodes) * sizeof(Node) <= size &&
+			header.chunksOffset % Alignment == 0 && header.chunksOffset + uint64_t(header.numChunks) * sizeof(Chunk) <= size;
+
+		const Node* nodeTable = valid ? reinterpret_cast<const Node*>(file.data() + header.nodesOffset) : nullptr;
+		const Chunk* chunkTable = valid ? reinterpret_cast<const Chunk*>(file.data() + header.chunksOffset) : nullptr;
+		for (uint32_t n = 0; valid && n < header.numNodes; ++n) {
+			const Node& node = nodeTable[n];
+			valid = node.chunk >= 0
+				? uint32_t(node.chunk) < header.numChunks
+				: (node.left > int32_t(n) && uint32_t(node.left) < header.numNodes && node.right > int32_t(n) && uint32_t(node.right) < header.numNodes);
+		}
+		for (uint32_t c = 0; valid && c < header.numChunks; ++c) {
+			const Chunk& chunk = chunkTable[c];
+			auto fits = [&](uint64_t offset, uint64_t numBytes) {
+				return offset == 0 || (offset % Alignment == 0 && offset + numBytes <= size);
+			};
+			valid = fits(chunk.triangles, chunk.numTriangles * sizeof(Mesh::Tri)) && fits(chunk.vertices, chunk.numVertices * sizeof(Mesh::Vert)) &&
+				fits(chunk.normals, chunk.numVertices * sizeof(v3f)) && fits(chunk.colors, chunk.numVertices * sizeof(v3f)) &&
+				fits(chunk.uvs, chunk.numVertices * sizeof(v2f));
+		}
+		if (!valid) {
+			file.close();
+			return false;
+		}
+
+		nodes = nodeTable;
+		chunks = chunkTable;
+		_numChunks = header.numChunks;
+		_numTriangles = header.numTriangles;
+		box = toBox(nodes[0]);
+		return true;
+	}
+
+	int ChunkedMesh::numChunks() const
+	{
+		return static_cast<int>(_numChunks);
+	}
+
+	size_t ChunkedMesh::numTriangles() const
+	{
+		return static_cast<size_t>(_numTriangles);
+	}
+
+	const Mesh::Box& ChunkedMesh::boundingBox() const
+	{
+		return box;
+	}
+
+	Mesh::Box ChunkedMesh::chunkBox(int chunk) const
+	{
+		return toBox(chunks[chunk]);
+	}
+
+	size_t ChunkedMesh::chunkNumTriangles(int chunk) const
+	{
+		return chunks[chunk].numTriangles;
+	}
+
+	size_t ChunkedMesh::chunkNumVertices(int chunk) const
+	{
+		return chunks[chunk].numVertices;
+	}
+
+	Mesh ChunkedMesh::loadChunk(int chunk) const
+	{
+		const Chunk& record = chunks[chunk];
+		auto copy = [&](uint64_t offset, size_t count, auto& dst) {
+			dst.resize(offset ? count : 0);
+			if (!dst.empty()) {
+				std::memcpy(reinterpret_cast<char*>(dst.data()), file.data() + offset, count * sizeof(dst[0]));
+			}
+		};
+
+		Mesh::Triangles triangles;
+		Mesh::Vertices vertices;
+		Mesh::Normals normals;
+		Mesh::Colors colors;
+		Mesh::UVs uvs;
+		copy(record.triangles, record.numTriangles, triangles);
+		copy(record.vertices, record.numVertices, vertices);
+		copy(record.normals, record.numVertices, normals);
+		copy(record.colors, record.numVertices, colors);
+		copy(record.uvs, record.numVertices, uvs);
+
+		Mesh out;
+		out.setTriangles(std::move(triangles));
+		out.setVertices(std::move(vertices));
+		if (!normals.empty()) {
+			out.setNormals(std::move(normals));
+		}
+		if (!colors.empty()) {
+			out.setColors(std::move(colors));
+		}
+		if (!uvs.empty()) {
+			out.setUVs(std::move(uvs));
+		}
+		return out;
+	}
+
+	std::shared_ptr<Mesh> ChunkedMesh::chunk(int chunk)
+	{
+		return _cache.get(chunk);
+	}
+
+	ChunkCache<Mesh>& ChunkedMesh::cache()
+	{
+		return _cache;
+	}
+
+	void ChunkedMesh::traverse(const Ray& ray, float near, float far, const std::function<float(int chunk, float far)>& f) const
+	{
+		if (!nodes) {
+			return;
+		}
+
+		// slabs test, nan products from zero direction components are ignored by the min and max
+		const v3f invDir = ray.direction().cwiseInverse();
+		auto entry = [&](const Node& node, float& t) {
+			float t0 = near, t1 = far;
+			for (int k = 0; k < 3; ++k) {
+				float a = (node.min[k] - ray.origin()[k]) * invDir[k];
+				float b = (node.max[k] - ray.origin()[k]) * invDir[k];
+				if (a > b) {
+					std::swap(a, b);
+				}
+				t0 = std::max(t0, a);
+				t1 = std::min(t1, b);
+			}
+			t = t0;
+			return t0 <= t1;
+		};
+
+		using Candidate = std::pair<float, int>;
+		std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+		float t;
+		if (entry(nodes[0], t)) {
+			candidates.emplace(t, 0);
+		}
+
+		while (!candidates.empty()) {
+			const Candidate candidate = candidates.top();
+			candidates.pop();
+			if (candidate.first > far) {
+				break;
+			}
+
+			const Node& node = nodes[candidate.second];
+			if (node.chunk >= 0) {
+				far = f(node.chunk, far);
+				continue;
+			}
+			for (int child : { node.left, node.right }) {
+				if (entry(nodes[child], t)) {
+					candidates.emplace(t, child);
+				}
+			}
+		}
+	}
+
+	std::vector<int> ChunkedMesh::chunksInFrustum(const m4f& viewProj, const v3f& eye) const
+	{
+		std::vector<int> out;
+		if (!nodes) {
+			return out;
+		}
+
+		// culled when all the box corners are beyond a same clipping plane
+		auto outside = [&](const Node& node) {
+			std::array<v4f, 8> corners;
+			for (int i = 0; i < 8; ++i) {
+				corners[i] = viewProj * v4f(node.min[0], node.min[1], node.min[2], 1.0f);
+				for (int k = 0; k < 3; ++k) {
+					if (i & (1 << k)) {
+						corners[i] += viewProj.col(k) * (node.max[k] - node.min[k]);
+					}
+				}
+			}
+			for (int plane = 0; plane < 6; ++plane) {
+				const int axis = plane / 2;
+				const float sign = plane % 2 ? 1.0f : -1.0f;
+				if (std::all_of(corners.begin(), corners.end(), [&](const v4f& c) { return sign * c[axis] > c[3]; })) {
+					return true;
+				}
+			}
+			return false;
+		};
+
+		std::vector<int> stack = { 0 };
+		while (!stack.empty()) {
+			const Node& node = nodes[stack.back()];
+			stack.pop_back();
+			if (outside(node)) {
+				continue;
+			}
+			if (node.chunk >= 0) {
+				out.push_back(node.chunk);
+			} else {
+				stack.push_back(node.left);
+				stack.push_back(node.right);
+			}
+		}
+
+		std::vector<float> distances(_numChunks);
+		for (int chunk : out) {
+			distances[chunk] = chunkBox(chunk).squaredExteriorDistance(eye);
+		}
+		std::sort(out.begin(), out.end(), [&](int a, int b) {
+			return distances[a] < distances[b];
+		});
+		return out;
+	}
+
+	size_t ChunkedMesh::sizeOf(const Mesh& mesh)
+	{
+		return mesh.getTriangles().size() * sizeof(Mesh::Tri) + mesh.getVertices().size() * sizeof(Mesh::Vert) +
+			mesh.getNormals().size() * sizeof(v3f) + mesh.getColors().size() * sizeof(v3f) + mesh.getUVs().size() * sizeof(v2f);
+	}
+
+	ChunkedRaycaster::ChunkedRaycaster(const ChunkedMesh& chunks, size_t memoryBudget)
+		: chunks(chunks), _cache(
+			[&chunks](int chunk) {
+				// positions only, scenes are committed here so that concurrent rays never build them
+				const Mesh full = chunks.loadChunk(chunk);
+				Mesh geometry;
+				geometry.setTriangles(full.getTriangles());
+				geometry.setVertices(full.getVertices());
+				Raycaster raycaster;
+				raycaster.addMesh(geometry);
+				raycaster.checkScene();
+				return raycaster;
+			},
+			[&chunks](int chunk, const Raycaster&) {
+				// the mesh, the Embree copy of its buffers and about 64 bytes of BVH per triangle
+				const size_t numTriangles = chunks.chunkNumTriangles(chunk), numVertices = chunks.chunkNumVertices(chunk);
+				return 2 * (numTriangles * sizeof(Mesh::Tri) + numVertices * sizeof(Mesh::Vert)) + 64 * numTriangles;
+			},
+			memoryBudget)
+	{
+	}
+
+	ChunkedHit ChunkedRaycaster::intersect(const Ray& ray, float near, float far) const
+	{
+		ChunkedHit out;
+		chunks.traverse(ray, near, far, [&](int chunk, float currentFar) {
+			const Hit hit = _cache.get(chunk)->intersect(ray, near, currentFar);
+			if (hit.successful() && hit.distance() < currentFar) {
+				out.chunk = chunk;
+				out.hit = hit;
+				return hit.distance();
+			}
+			return currentFar;
+		});
+		return out;
+	}
+
+	bool ChunkedRaycaster::occlusion(const Ray& ray, float near, float far) const
+	{
+		bool occluded = false;
+		chunks.traverse(ray, near, far, [&](int chunk, float currentFar) {
+			occluded = _cache.get(chunk)->occlusion(ray, near, currentFar);
+			return occluded ? -std::numeric_limits<float>::infinity() : currentFar;
+		});
+		return occluded;
+	}
+
+	const ChunkCache<Raycaster>& ChunkedRaycaster::cache() const
+	{
+		return _cache;
+	}
+
+	ChunkedMeshGL::ChunkedMeshGL(const ChunkedMesh& chunks, size_t memoryBudget)
+		: chunks(chunks), _cache(
+			[&chunks](int chunk) { return MeshGL(chunks.loadChunk(chunk)); },
+			// GPU buffers and the CPU copy kept by MeshGL
+			[](int, const MeshGL& mesh) { return 2 * ChunkedMesh::sizeOf(mesh); },
+			memoryBudget)
+	{
+	}
+
+	void ChunkedMeshGL::draw(const m4f& viewProj, const v3f& eye, const ChunkedDrawingParams& params)
+	{
+		drawn = missing = 0;
+		int uploads = 0;
+		for (int chunk : chunks.chunksInFrustum(viewProj, eye)) {
+			std::shared_ptr<MeshGL> mesh = _cache.find(chunk);
+			if (!mesh && uploads < params.maxUploadsPerFrame) {
+				mesh = _cache.get(chunk);
+				++uploads;
+			}
+			if (!mesh) {
+				++missing;
+				continue;
+			}
+			mesh->mode = mode;
+			mesh->backface_culling = backface_culling;
+			mesh->depth_test = depth_test;
+			mesh->draw();
+			++drawn;
+		}
+	}
+
+	int ChunkedMeshGL::numDrawnChunks() const
+	{
+		return drawn;
+	}
+
+	int ChunkedMeshGL::numMissingChunks() const
+	{
+		return missing;
+	}
+
+	const ChunkCache<MeshGL>& ChunkedMeshGL::cache() const
+	{
+		return _cache;
+	}
+
+}
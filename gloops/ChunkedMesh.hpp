@@ -0,0 +1,308 @@
+#pragma once
+
+#include "config.hpp"
+#include "Mesh.hpp"
+#include "MeshCache.hpp"
+#include "MappedFile.hpp"
+#include "Raycasting.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gloops {
+
+	// least recently used set of chunks under a memory budget, values are loaded on demand
+	// evicted values stay valid for the callers still holding them
+	template<typename T>
+	class ChunkCache {
+
+	public:
+		using Loader = std::function<T(int chunk)>;
+		using Sizer = std::function<size_t(int chunk, const T& value)>;
+
+		ChunkCache(const Loader& loader, const Sizer& sizer, size_t budget);
+
+		// thread safe, loading happens outside the lock so that several chunks can be loaded concurrently
+		std::shared_ptr<T> get(int chunk);
+
+		// null if the chunk is not resident, without loading it
+		std::shared_ptr<T> find(int chunk);
+
+		bool isResident(int chunk) const;
+		size_t usage() const;
+		size_t budget() const;
+		void setBudget(size_t bytes);
+		int numLoads() const;
+		void clear();
+
+	protected:
+		struct Entry {
+			std::shared_ptr<T> value;
+			size_t size = 0;
+			std::list<int>::iterator position;
+		};
+
+		// lock held, the most recent chunk is always kept
+		void evict();
+
+		Loader loader;
+		Sizer sizer;
+		std::unordered_map<int, Entry> entries;
+		std::list<int> recents;
+		size_t _budget, _usage = 0;
+		int loads = 0;
+		mutable std::mutex mutex;
+	};
+
+	struct ChunkedMeshParams {
+		int maxTrianglesPerChunk = 1 << 16;
+		int maxNumThreads = 256;
+	};
+
+	// mesh partitioned in spatially coherent chunks stored in a mapped file, for models larger than memory
+	// chunks are the leaves of a kd-tree built by median splits of the triangle centroids,
+	// chunk() pages them in on demand and evicts the least recently used ones once over the memory budget
+	class ChunkedMesh {
+
+	public:
+		using Ray = RayT<float>;
+
+		static constexpr uint32_t Version = 1;
+
+		// sources are only read, views on a mapped MeshCache keep the build out of core:
+		// it needs 4 bytes per triangle plus the chunks being written
+		static bool build(const std::string& path, const MeshCache& source, int mesh = 0, const ChunkedMeshParams& params = {});
+		static bool build(const std::string& path, const Mesh& mesh, const ChunkedMeshParams& params = {});
+
+		ChunkedMesh(size_t memoryBudget = size_t(1) << 30);
+
+		// false if the file is missing, truncated or from another version
+		bool open(const std::string& path);
+
+		int numChunks() const;
+		size_t numTriangles() const;
+		const Mesh::Box& boundingBox() const;
+		Mesh::Box chunkBox(int chunk) const;
+		size_t chunkNumTriangles(int chunk) const;
+		size_t chunkNumVertices(int chunk) const;
+
+		// copy of a chunk from the mapping, thread safe and not cached
+		Mesh loadChunk(int chunk) const;
+
+		// cached copy, see ChunkCache
+		std::shared_ptr<Mesh> chunk(int chunk);
+		ChunkCache<Mesh>& cache();
+
+		// chunks whose box is crossed by the ray, closest first, f(chunk, far) returns the new far distance
+		// the traversal stops once the next box starts beyond far
+		void traverse(const Ray& ray, float near, float far, const std::function<float(int chunk, float far)>& f) const;
+
+		// chunks whose box overlaps the view frustum, sorted by distance to the eye
+		std::vector<int> chunksInFrustum(const m4f& viewProj, const v3f& eye) const;
+
+		// bytes of the arrays of a mesh, used for the budgets
+		static size_t sizeOf(const Mesh& mesh);
+
+	protected:
+		struct Source {
+			const Mesh::Tri* triangles = nullptr;
+			const Mesh::Vert* vertices = nullptr;
+			const v3f* normals = nullptr;
+			const v3f* colors = nullptr;
+			const v2f* uvs = nullptr;
+			size_t numTriangles = 0, numVertices = 0;
+		};
+
+		struct Node {
+			float min[3], max[3];
+			int32_t left, right;
+			int32_t chunk;		// leaves only, -1 otherwise
+			int32_t padding;
+		};
+
+		struct Chunk {
+			float min[3], max[3];
+			uint32_t numVertices, numTriangles;
+			uint64_t triangles, vertices, normals, colors, uvs;		// offsets, 0 for missing arrays
+		};
+
+		static bool build(const std::string& path, const Source& source, const ChunkedMeshParams& params);
+
+		MappedFile file;
+		const Node* nodes = nullptr;
+		const Chunk* chunks = nullptr;
+		uint32_t _numChunks = 0;
+		uint64_t _numTriangles = 0;
+		Mesh::Box box;
+		ChunkCache<Mesh> _cache;
+	};
+
+	struct ChunkedHit {
+		int chunk = -1;
+		Hit hit;		// triangle ids are local to the chunk
+
+		bool successful() const {
+			return chunk >= 0;
+		}
+	};
+
+	// raycasting of a ChunkedMesh with one Embree scene per resident chunk, built on demand under a memory budget
+	// rays visit the chunk boxes front to back and stop once the closest hit is nearer than the next box
+	// the ChunkedMesh must outlive the raycaster
+	class ChunkedRaycaster {
+
+	public:
+		using Ray = RayT<float>;
+
+		ChunkedRaycaster(const ChunkedMesh& chunks, size_t memoryBudget = size_t(1) << 30);
+
+		// thread safe
+		ChunkedHit intersect(const Ray& ray, float near = 0.0f, float far = std::numeric_limits<float>::infinity()) const;
+		bool occlusion(const Ray& ray, float near = 0.0f, float far = std::numeric_limits<float>::infinity()) const;
+
+		const ChunkCache<Raycaster>& cache() const;
+
+	protected:
+		const ChunkedMesh& chunks;
+		mutable ChunkCache<Raycaster> _cache;
+	};
+
+	struct ChunkedDrawingParams {
+		int maxUploadsPerFrame = 8;		// missing chunks are uploaded over the next frames
+	};
+
+	// draws the chunks of a ChunkedMesh in the view frustum, front to back, streaming them to the GPU under a memory budget
+	// the budget should hold the chunks visible in a frame, otherwise they are evicted and uploaded again every frame
+	// the ChunkedMesh must outlive the renderer
+	class ChunkedMeshGL {
+
+	public:
+		ChunkedMeshGL(const ChunkedMesh& chunks, size_t memoryBudget = size_t(512) << 20);
+
+		// with the shader already bound, chunks are drawn without model transformation
+		void draw(const m4f& viewProj, const v3f& eye, const ChunkedDrawingParams& params = {});
+
+		// during the last draw
+		int numDrawnChunks() const;
+		int numMissingChunks() const;
+
+		const ChunkCache<MeshGL>& cache() const;
+
+		GLenum mode = GL_FILL;
+		bool backface_culling = true;
+		bool depth_test = true;
+
+	protected:
+		const ChunkedMesh& chunks;
+		ChunkCache<MeshGL> _cache;
+		int drawn = 0, missing = 0;
+	};
+
+	template<typename T>
+	inline ChunkCache<T>::ChunkCache(const Loader& loader, const Sizer& sizer, size_t budget)
+		: loader(loader), sizer(sizer), _budget(budget)
+	{
+	}
+
+	template<typename T>
+	inline std::shared_ptr<T> ChunkCache<T>::get(int chunk)
+	{
+		if (std::shared_ptr<T> value = find(chunk)) {
+			return value;
+		}
+
+		std::shared_ptr<T> value = std::make_shared<T>(loader(chunk));
+		const size_t size = sizer(chunk, *value);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto it = entries.find(chunk);
+		if (it != entries.end()) {
+			// loaded concurrently by another thread
+			recents.splice(recents.begin(), recents, it->second.position);
+			return it->second.value;
+		}
+
+		recents.push_front(chunk);
+		entries[chunk] = Entry{ value, size, recents.begin() };
+		_usage += size;
+		++loads;
+		evict();
+		return value;
+	}
+
+	template<typename T>
+	inline std::shared_ptr<T> ChunkCache<T>::find(int chunk)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto it = entries.find(chunk);
+		if (it == entries.end()) {
+			return nullptr;
+		}
+		recents.splice(recents.begin(), recents, it->second.position);
+		return it->second.value;
+	}
+
+	template<typename T>
+	inline bool ChunkCache<T>::isResident(int chunk) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return entries.count(chunk) > 0;
+	}
+
+	template<typename T>
+	inline size_t ChunkCache<T>::usage() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return _usage;
+	}
+
+	template<typename T>
+	inline size_t ChunkCache<T>::budget() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return _budget;
+	}
+
+	template<typename T>
+	inline void ChunkCache<T>::setBudget(size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		_budget = bytes;
+		evict();
+	}
+
+	template<typename T>
+	inline int ChunkCache<T>::numLoads() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return loads;
+	}
+
+	template<typename T>
+	inline void ChunkCache<T>::clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.clear();
+		recents.clear();
+		_usage = 0;
+	}
+
+	template<typename T>
+	inline void ChunkCache<T>::evict()
+	{
+		while (_usage > _budget && recents.size() > 1) {
+			const auto it = entries.find(recents.back());
+			_usage -= it->second.size;
+			entries.erase(it);
+			recents.pop_back();
+		}
+	}
+
+}
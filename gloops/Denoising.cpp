@@ -0,0 +1,152 @@
+#include "Denoising.hpp"
+#include "Utils.hpp"
+
+namespace gloops {
+
+	void ATrousDenoiser::denoise(const Image3f& color, const Image1f& depth, const Image3f& normals, Image3f& out, const ATrousParams& params)
+	{
+		const int iterations = std::clamp(params.iterations, 1, 8);
+
+		resize(color.w(), color.h(), iterations);
+		out.resize(_w, _h);
+		if (_w == 0 || _h == 0) {
+			return;
+		}
+
+		const int rowsPerJob = 8;
+		const int numJobs = (_h + rowsPerJob - 1) / rowsPerJob;
+		setupPlanes(color, depth, normals, params.maxNumThreads);
+
+		float sigmaColor = params.sigmaColor;
+		const float invSigmaNormal2 = 1.0f / std::max(params.sigmaNormal * params.sigmaNormal, 1e-8f);
+		const float invSigmaDepth2 = 1.0f / std::max(params.sigmaDepth * params.sigmaDepth, 1e-8f);
+
+		for (int it = 0; it < iterations; ++it) {
+			const float invSigmaColor2 = 1.0f / std::max(sigmaColor * sigmaColor, 1e-8f);
+			const int step = 1 << it;
+
+			parallelForEach(0, numJobs, [&](int job) {
+				filterRows(job * rowsPerJob, std::min((job + 1) * rowsPerJob, _h), step, invSigmaColor2, invSigmaNormal2, invSigmaDepth2);
+			}, params.maxNumThreads);
+
+			std::swap(src, dst);
+			sigmaColor /= 2;
+		}
+
+		parallelForEach(0, _h, [&](int y) {
+			for (int x = 0; x < _w; ++x) {
+				const size_t p = index(x, y);
+				out.pixel(x, y) = v3f(src[p], src[planeSize + p], src[2 * planeSize + p]);
+			}
+		}, params.maxNumThreads);
+	}
+
+	Image3f ATrousDenoiser::denoise(const Image3f& color, const Image1f& depth, const Image3f& normals, const ATrousParams& params)
+	{
+		Image3f out;
+		denoise(color, depth, normals, out, params);
+		return out;
+	}
+
+	void ATrousDenoiser::resize(int w, int h, int iterations)
+	{
+		const int p = 1 << iterations;
+		if (w == _w && h == _h && p == padding) {
+			return;
+		}
+
+		_w = w;
+		_h = h;
+		padding = p;
+		stride = _w + 2 * padding;
+		paddedH = _h + 2 * padding;
+		planeSize = static_cast<size_t>(stride) * paddedH;
+
+		// padding is never written afterwards, class -1 gives it a null weight
+		guides.assign(NUM_GUIDES * planeSize, 0.0f);
+		std::fill(guides.begin() + CLASS * planeSize, guides.begin() + (CLASS + 1) * planeSize, -1.0f);
+		src.assign(3 * planeSize, 0.0f);
+		dst.assign(3 * planeSize, 0.0f);
+	}
+
+	void ATrousDenoiser::setupPlanes(const Image3f& color, const Image1f& depth, const Image3f& normals, int numThreads)
+	{
+		parallelForEach(0, _h, [&](int y) {
+			for (int x = 0; x < _w; ++x) {
+				const size_t p = index(x, y);
+				const v3f& c = color.pixel(x, y);
+				const float d = depth.at(x, y);
+				const bool hit = d > 0;
+
+				for (int k = 0; k < 3; ++k) {
+					src[k * planeSize + p] = c[k];
+					guides[(NX + k) * planeSize + p] = hit ? normals.pixel(x, y)[k] : 0.0f;
+				}
+				guides[LOG_DEPTH * planeSize + p] = hit ? std::log(d) : 0.0f;
+				guides[CLASS * planeSize + p] = hit ? 1.0f : 0.0f;
+			}
+		}, numThreads);
+	}
+
+	void ATrousDenoiser::filterRows(int from, int to, int step, float invSigmaColor2, float invSigmaNormal2, float invSigmaDepth2)
+	{
+		using Row = Eigen::Map<const Eigen::ArrayXf>;
+		using Array = Eigen::ArrayXf;
+
+		static const float kernel[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+
+		// classes mismatch goes in the exponent rather than as a mask, so that the whole weight stays vectorized
+		static const float classPenalty = 1e4f;
+
+		Array sumW(_w), sumR(_w), sumG(_w), sumB(_w), weights(_w);
+
+		auto row = [&](const std::vector<float>& planes, int plane, size_t offset) {
+			return Row(planes.data() + plane * planeSize + offset, _w);
+		};
+
+		for (int y = from; y < to; ++y) {
+			const size_t p = index(0, y);
+
+			const Row pr = row(src, 0, p), pg = row(src, 1, p), pb = row(src, 2, p);
+			const Row pnx = row(guides, NX, p), pny = row(guides, NY, p), pnz = row(guides, NZ, p);
+			const Row pz = row(guides, LOG_DEPTH, p), pc = row(guides, CLASS, p);
+
+			sumW.setZero();
+			sumR.setZero();
+			sumG.setZero();
+			sumB.setZero();
+
+			for (int ky = -2; ky <= 2; ++ky) {
+				for (int kx = -2; kx <= 2; ++kx) {
+					const size_t q = p + static_cast<std::ptrdiff_t>(ky * step) * stride + kx * step;
+					const float h = kernel[ky + 2] * kernel[kx + 2];
+
+					const Row qr = row(src, 0, q), qg = row(src, 1, q), qb = row(src, 2, q);
+
+					weights = (
+						-invSigmaColor2 * ((qr - pr).square() + (qg - pg).square() + (qb - pb).square())
+						- invSigmaNormal2 * ((row(guides, NX, q) - pnx).square() + (row(guides, NY, q) - pny).square() + (row(guides, NZ, q) - pnz).square())
+						- invSigmaDepth2 * (row(guides, LOG_DEPTH, q) - pz).square()
+						- classPenalty * (row(guides, CLASS, q) - pc).square()
+						).exp() * h;
+
+					sumW += weights;
+					sumR += weights * qr;
+					sumG += weights * qg;
+					sumB += weights * qb;
+				}
+			}
+
+			// the center tap always has a positive weight
+			Eigen::Map<Array>(dst.data() + p, _w) = sumR / sumW;
+			Eigen::Map<Array>(dst.data() + planeSize + p, _w) = sumG / sumW;
+			Eigen::Map<Array>(dst.data() + 2 * planeSize + p, _w) = sumB / sumW;
+		}
+	}
+
+	size_t ATrousDenoiser::index(int x, int y) const
+	{
+		return static_cast<size_t>(y + padding) * stride + x + padding;
+	}
+
+}
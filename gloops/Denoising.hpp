@@ -0,0 +1,41 @@
+#pragma once
+
+#include "config.hpp"
+#include "Image.hpp"
+
+namespace gloops {
+
+	struct ATrousParams {
+		int iterations = 5;
+		float sigmaColor = 0.6f, sigmaNormal = 0.3f, sigmaDepth = 0.05f;
+		int maxNumThreads = 256;
+	};
+
+	// edge-avoiding a-trous wavelet filter, Dammertz et al. 2010
+	// guided by the primary hits depth and normals, meant for low sample count images
+	class ATrousDenoiser {
+
+	public:
+		ATrousDenoiser() = default;
+
+		// pixels with depth <= 0 (no primary hit) are only averaged with each other
+		void denoise(const Image3f& color, const Image1f& depth, const Image3f& normals, Image3f& out, const ATrousParams& params = {});
+
+		Image3f denoise(const Image3f& color, const Image1f& depth, const Image3f& normals, const ATrousParams& params = {});
+
+	protected:
+		void resize(int w, int h, int iterations);
+		void setupPlanes(const Image3f& color, const Image1f& depth, const Image3f& normals, int numThreads);
+		void filterRows(int from, int to, int step, float invSigmaColor2, float invSigmaNormal2, float invSigmaDepth2);
+
+		size_t index(int x, int y) const;
+
+		// planar padded buffers, so that rows can be processed as contiguous arrays
+		enum Guide { NX, NY, NZ, LOG_DEPTH, CLASS, NUM_GUIDES };
+
+		std::vector<float> guides, src, dst;
+		int _w = 0, _h = 0, padding = 0, stride = 0, paddedH = 0;
+		size_t planeSize = 0;
+	};
+
+}
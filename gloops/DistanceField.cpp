@@ -0,0 +1,197 @@
+#include "DistanceField.hpp"
+#include "Utils.hpp"
+
+namespace gloops {
+
+	float pointTriangleSquaredDistance(const v3f& p, const v3f& a, const v3f& b, const v3f& c)
+	{
+		// Ericson 2004, closest point on triangle, region tests with barycentric coordinates
+		const v3f ab = b - a, ac = c - a, ap = p - a;
+		const float d1 = ab.dot(ap), d2 = ac.dot(ap);
+		if (d1 <= 0 && d2 <= 0) {
+			return ap.squaredNorm();
+		}
+
+		const v3f bp = p - b;
+		const float d3 = ab.dot(bp), d4 = ac.dot(bp);
+		if (d3 >= 0 && d4 <= d3) {
+			return bp.squaredNorm();
+		}
+
+		const float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+			return (ap - (d1 / (d1 - d3)) * ab).squaredNorm();
+		}
+
+		const v3f cp = p - c;
+		const float d5 = ab.dot(cp), d6 = ac.dot(cp);
+		if (d6 >= 0 && d5 <= d6) {
+			return cp.squaredNorm();
+		}
+
+		const float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+			return (ap - (d2 / (d2 - d6)) * ac).squaredNorm();
+		}
+
+		const float va = d3 * d6 - d5 * d4;
+		if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+			return (bp - ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b)).squaredNorm();
+		}
+
+		const float denom = 1.0f / (va + vb + vc);
+		return (ap - (vb * denom) * ab - (vc * denom) * ac).squaredNorm();
+	}
+
+	Volume1f meshToSDF(const Mesh& mesh, const SDFParams& params)
+	{
+		const int n = std::max(params.resolution, 2);
+		Volume1f sdf(n, n, n, std::numeric_limits<float>::max());
+
+		const auto& tris = mesh.getTriangles();
+		if (mesh.getVertices().empty() || tris.empty()) {
+			addToLogs(LogType::WARNING, "cant compute the distance field of an empty mesh");
+			return sdf;
+		}
+
+		std::vector<v3f> positions(mesh.getVertices().size());
+		BBox3f meshBox;
+		for (size_t i = 0; i < positions.size(); ++i) {
+			positions[i] = (mesh.model() * mesh.getVertices()[i].homogeneous()).hnormalized();
+			meshBox.extend(positions[i]);
+		}
+
+		const float halfSide = 0.5f * meshBox.sizes().maxCoeff() * (1 + 2 * params.padding);
+		const v3f halfDiag = v3f::Constant(std::max(halfSide, 1e-6f));
+		sdf.setBox(BBox3f(meshBox.center() - halfDiag, meshBox.center() + halfDiag));
+
+		const int numTris = static_cast<int>(tris.size());
+
+		// continuous voxel ranges of the triangles
+		std::vector<v3f> triMin(numTris), triMax(numTris);
+		for (int t = 0; t < numTris; ++t) {
+			const v3f a = sdf.worldToGrid(positions[tris[t][0]]), b = sdf.worldToGrid(positions[tris[t][1]]), c = sdf.worldToGrid(positions[tris[t][2]]);
+			triMin[t] = a.cwiseMin(b).cwiseMin(c);
+			triMax[t] = a.cwiseMax(b).cwiseMax(c);
+		}
+
+		auto binBySlices = [&](float margin) {
+			std::vector<std::vector<int>> slices(n);
+			for (int t = 0; t < numTris; ++t) {
+				const int z0 = std::max(0, static_cast<int>(std::ceil(triMin[t][2] - margin)));
+				const int z1 = std::min(n - 1, static_cast<int>(std::floor(triMax[t][2] + margin)));
+				for (int z = z0; z <= z1; ++z) {
+					slices[z].push_back(t);
+				}
+			}
+			return slices;
+		};
+
+		auto distance = [&](int x, int y, int z, int t) {
+			return std::sqrt(pointTriangleSquaredDistance(sdf.voxelCenter(x, y, z), positions[tris[t][0]], positions[tris[t][1]], positions[tris[t][2]]));
+		};
+
+		// exact distances in a narrow band around each triangle
+		Volume<int> closest(n, n, n, -1);
+		const float band = static_cast<float>(std::max(params.band, 1));
+		const std::vector<std::vector<int>> bandSlices = binBySlices(band);
+
+		parallelForEach(0, n, [&](int z) {
+			for (int t : bandSlices[z]) {
+				const int x0 = std::max(0, static_cast<int>(std::ceil(triMin[t][0] - band))), x1 = std::min(n - 1, static_cast<int>(std::floor(triMax[t][0] + band)));
+				const int y0 = std::max(0, static_cast<int>(std::ceil(triMin[t][1] - band))), y1 = std::min(n - 1, static_cast<int>(std::floor(triMax[t][1] + band)));
+				for (int y = y0; y <= y1; ++y) {
+					for (int x = x0; x <= x1; ++x) {
+						const float d = distance(x, y, z, t);
+						if (d < sdf.at(x, y, z)) {
+							sdf.at(x, y, z) = d;
+							closest.at(x, y, z) = t;
+						}
+					}
+				}
+			}
+		}, params.maxNumThreads);
+
+		// closest triangles propagated along each axis, lines are independent
+		auto sweepLine = [&](int x, int y, int z, const v3i& step, int length) {
+			for (int dir = 1; dir >= -1; dir -= 2) {
+				v3i prev = v3i(x, y, z) + (dir > 0 ? 0 : length - 1) * step;
+				for (int i = 1; i < length; ++i) {
+					const v3i cur = prev + dir * step;
+					const int t = closest.at(prev);
+					if (t >= 0 && t != closest.at(cur)) {
+						const float d = distance(cur[0], cur[1], cur[2], t);
+						if (d < sdf.at(cur)) {
+							sdf.at(cur) = d;
+							closest.at(cur) = t;
+						}
+					}
+					prev = cur;
+				}
+			}
+		};
+
+		for (int s = 0; s < params.numSweeps; ++s) {
+			parallelForEach(0, n, [&](int z) {
+				for (int y = 0; y < n; ++y) {
+					sweepLine(0, y, z, v3i(1, 0, 0), n);
+				}
+				for (int x = 0; x < n; ++x) {
+					sweepLine(x, 0, z, v3i(0, 1, 0), n);
+				}
+			}, params.maxNumThreads);
+			parallelForEach(0, n, [&](int y) {
+				for (int x = 0; x < n; ++x) {
+					sweepLine(x, y, 0, v3i(0, 0, 1), n);
+				}
+			}, params.maxNumThreads);
+		}
+
+		if (!params.signedDistance) {
+			return sdf;
+		}
+
+		// inside voxels have an odd number of crossings before them along +x
+		const std::vector<std::vector<int>> slices = binBySlices(1);
+		parallelForEach(0, n, [&](int z) {
+			std::vector<int> crossings(n * static_cast<size_t>(n + 1), 0);
+			for (int t : slices[z]) {
+				const v3f a = sdf.worldToGrid(positions[tris[t][0]]), b = sdf.worldToGrid(positions[tris[t][1]]), c = sdf.worldToGrid(positions[tris[t][2]]);
+				const int y0 = std::max(0, static_cast<int>(std::ceil(triMin[t][1] - 1))), y1 = std::min(n - 1, static_cast<int>(std::floor(triMax[t][1])));
+
+				// barycentric coordinates of the line (y, z) in the yz projection
+				const float area = (b[1] - a[1]) * (c[2] - a[2]) - (c[1] - a[1]) * (b[2] - a[2]);
+				if (area == 0) {
+					continue;
+				}
+				for (int y = y0; y <= y1; ++y) {
+					// slightly shifted lines, so that they do not go through shared edges and vertices
+					const float ly = y + 1.3e-4f, lz = z + 0.7e-4f;
+					const float wa = ((b[1] - ly) * (c[2] - lz) - (c[1] - ly) * (b[2] - lz)) / area;
+					const float wb = ((c[1] - ly) * (a[2] - lz) - (a[1] - ly) * (c[2] - lz)) / area;
+					const float wc = 1 - wa - wb;
+					if (wa < 0 || wb < 0 || wc < 0) {
+						continue;
+					}
+
+					const float x = wa * a[0] + wb * b[0] + wc * c[0];
+					const int first = std::clamp(static_cast<int>(std::floor(x)) + 1, 0, n);
+					++crossings[y * static_cast<size_t>(n + 1) + first];
+				}
+			}
+
+			for (int y = 0; y < n; ++y) {
+				int count = 0;
+				for (int x = 0; x < n; ++x) {
+					count += crossings[y * static_cast<size_t>(n + 1) + x];
+					if (count % 2) {
+						sdf.at(x, y, z) = -sdf.at(x, y, z);
+					}
+				}
+			}
+		}, params.maxNumThreads);
+
+		return sdf;
+	}
+
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "config.hpp"
+#include "Mesh.hpp"
+#include "Volume.hpp"
+
+namespace gloops {
+
+	struct SDFParams {
+		int resolution = 128;		// voxels along each axis, cells are cubic
+		float padding = 0.1f;		// margin around the mesh bounding box, relative to its largest side
+		int band = 1;				// voxels around each triangle that get exact distances before propagation
+		int numSweeps = 2;
+		bool signedDistance = true;	// sign from ray parity along x, expects closed meshes
+		int maxNumThreads = 256;
+	};
+
+	// distances in world units, using the mesh model matrix, negative inside
+	// exact distances near the surface are propagated by separable sweeps of the closest triangles
+	Volume1f meshToSDF(const Mesh& mesh, const SDFParams& params = {});
+
+	// squared distance from p to triangle (a, b, c)
+	float pointTriangleSquaredDistance(const v3f& p, const v3f& a, const v3f& b, const v3f& c);
+
+}
@@ -0,0 +1,327 @@
+#include "EnvironmentLight.hpp"
+#include "Utils.hpp"
+
+namespace gloops {
+
+	v3f cubeFaceDir(int face, const v2f& uv)
+	{
+		const float a = 2 * uv[0] - 1, b = 2 * uv[1] - 1;
+		switch (face) {
+		case POSITIVE_X: return v3f(1, -b, -a);
+		case NEGATIVE_X: return v3f(-1, -b, a);
+		case POSITIVE_Y: return v3f(a, 1, b);
+		case NEGATIVE_Y: return v3f(a, -1, -b);
+		case POSITIVE_Z: return v3f(a, -b, 1);
+		default: return v3f(-a, -b, -1);
+		}
+	}
+
+	int dirToCubeFace(const v3f& dir, v2f& uv)
+	{
+		const v3f absDir = dir.cwiseAbs();
+		int face;
+		float sc, tc, ma;
+		if (absDir[0] >= absDir[1] && absDir[0] >= absDir[2]) {
+			face = dir[0] >= 0 ? POSITIVE_X : NEGATIVE_X;
+			sc = dir[0] >= 0 ? -dir[2] : dir[2];
+			tc = -dir[1];
+			ma = absDir[0];
+		} else if (absDir[1] >= absDir[2]) {
+			face = dir[1] >= 0 ? POSITIVE_Y : NEGATIVE_Y;
+			sc = dir[0];
+			tc = dir[1] >= 0 ? dir[2] : -dir[2];
+			ma = absDir[1];
+		} else {
+			face = dir[2] >= 0 ? POSITIVE_Z : NEGATIVE_Z;
+			sc = dir[2] >= 0 ? dir[0] : -dir[0];
+			tc = -dir[1];
+			ma = absDir[2];
+		}
+		ma = std::max(ma, 1e-20f);
+		uv = v2f(sc / ma + 1, tc / ma + 1) / 2;
+		return face;
+	}
+
+	v2i cubeCrossOffset(int face)
+	{
+		static const v2i offsets[NUM_CUBE_FACES] = { {2, 1}, {0, 1}, {1, 0}, {1, 2}, {1, 1}, {3, 1} };
+		return offsets[face];
+	}
+
+	float cubeTexelSolidAngle(int x, int y, int size)
+	{
+		auto areaElement = [](float a, float b) {
+			return std::atan2(a * b, std::sqrt(a * a + b * b + 1));
+		};
+
+		const float a0 = 2 * x / float(size) - 1, a1 = 2 * (x + 1) / float(size) - 1;
+		const float b0 = 2 * y / float(size) - 1, b1 = 2 * (y + 1) / float(size) - 1;
+		return areaElement(a0, b0) - areaElement(a0, b1) - areaElement(a1, b0) + areaElement(a1, b1);
+	}
+
+	AliasTable::AliasTable(const std::vector<float>& weights)
+	{
+		const int n = static_cast<int>(weights.size());
+		probs.resize(n);
+		thresholds.resize(n);
+		aliases.resize(n);
+
+		total = 0;
+		for (float w : weights) {
+			total += std::max(w, 0.0f);
+		}
+
+		std::vector<int> small, large;
+		for (int i = 0; i < n; ++i) {
+			probs[i] = total > 0 ? std::max(weights[i], 0.0f) / total : 1.0f / n;
+			thresholds[i] = n * probs[i];
+			aliases[i] = i;
+			(thresholds[i] < 1 ? small : large).push_back(i);
+		}
+
+		while (!small.empty() && !large.empty()) {
+			const int s = small.back(), l = large.back();
+			small.pop_back();
+			aliases[s] = l;
+			thresholds[l] -= 1 - thresholds[s];
+			if (thresholds[l] < 1) {
+				large.pop_back();
+				small.push_back(l);
+			}
+		}
+
+		// leftovers only differ from 1 by rounding errors
+		for (int i : small) {
+			thresholds[i] = 1;
+		}
+		for (int i : large) {
+			thresholds[i] = 1;
+		}
+	}
+
+	int AliasTable::sample(float u, float& remapped) const
+	{
+		const float x = u * size();
+		const int i = std::clamp(static_cast<int>(x), 0, size() - 1);
+		const float coin = std::clamp(x - i, 0.0f, 1.0f);
+		static const float belowOne = std::nextafter(1.0f, 0.0f);
+
+		if (coin < thresholds[i]) {
+			remapped = std::min(coin / thresholds[i], belowOne);
+			return i;
+		}
+		remapped = std::min((coin - thresholds[i]) / (1 - thresholds[i]), belowOne);
+		return aliases[i];
+	}
+
+	int AliasTable::sample(float u) const
+	{
+		float remapped;
+		return sample(u, remapped);
+	}
+
+	float AliasTable::probability(int i) const
+	{
+		return probs[i];
+	}
+
+	int AliasTable::size() const
+	{
+		return static_cast<int>(probs.size());
+	}
+
+	float AliasTable::totalWeight() const
+	{
+		return total;
+	}
+
+	float powerHeuristic(float pdf, float otherPdf)
+	{
+		const float a = pdf * pdf, b = otherPdf * otherPdf;
+		return a + b > 0 ? a / (a + b) : 0.0f;
+	}
+
+	namespace {
+		Image3f srgbToLinear(const Image3b& img)
+		{
+			Image3f out(img.w(), img.h());
+			parallelForEach(0, img.h(), [&](int y) {
+				for (int x = 0; x < img.w(); ++x) {
+					out.pixel(x, y) = img.pixel(x, y).cast<float>().unaryExpr([](float c) { return std::pow(c / 255.0f, 2.2f); });
+				}
+			});
+			return out;
+		}
+	}
+
+	EnvironmentLight EnvironmentLight::fromLatLong(const Image3f& img)
+	{
+		EnvironmentLight light;
+		light._layout = Layout::LAT_LONG;
+		light.texels = img;
+		light.buildDistribution();
+		return light;
+	}
+
+	EnvironmentLight EnvironmentLight::fromLatLong(const Image3b& img)
+	{
+		return fromLatLong(srgbToLinear(img));
+	}
+
+	EnvironmentLight EnvironmentLight::fromCubeCross(const Image3f& img)
+	{
+		EnvironmentLight light;
+		light._layout = Layout::CUBE;
+		light.faceSize = std::min(img.w() / 4, img.h() / 3);
+
+		const int s = light.faceSize;
+		light.texels.resize(NUM_CUBE_FACES * s, s);
+		for (int f = 0; f < NUM_CUBE_FACES; ++f) {
+			const v2i offset = s * cubeCrossOffset(f);
+			for (int y = 0; y < s; ++y) {
+				for (int x = 0; x < s; ++x) {
+					light.texels.pixel(f * s + x, y) = img.pixel(offset[0] + x, offset[1] + y);
+				}
+			}
+		}
+		light.buildDistribution();
+		return light;
+	}
+
+	EnvironmentLight EnvironmentLight::fromCubeCross(const Image3b& img)
+	{
+		return fromCubeCross(srgbToLinear(img));
+	}
+
+	EnvironmentLight EnvironmentLight::fromPathCube(const std::string& path)
+	{
+		Image3b img;
+		img.load(path);
+		return fromCubeCross(img);
+	}
+
+	EnvironmentLight::Sample EnvironmentLight::sample(const v2f& u) const
+	{
+		Sample out;
+		if (empty()) {
+			return out;
+		}
+
+		float r;
+		const int i = distribution.sample(u[0], r);
+		const int x = i % texels.w(), y = i / texels.w();
+
+		if (_layout == Layout::LAT_LONG) {
+			const v2f param((x + r) / texels.w(), (y + u[1]) / texels.h());
+			out.dir = sphericalDir<float>(2 * pi<float>() * param[0], pi<float>() * param[1]);
+			out.pdf = distribution.probability(i) * texels.w() * texels.h() * invJacobian(param);
+		} else {
+			const int face = x / faceSize;
+			const v2f param((x - face * faceSize + r) / faceSize, (y + u[1]) / faceSize);
+			out.dir = cubeFaceDir(face, param).normalized();
+			out.pdf = distribution.probability(i) * faceSize * faceSize * invJacobian(param);
+		}
+		out.radiance = texels.pixel(x, y);
+		return out;
+	}
+
+	float EnvironmentLight::pdf(const v3f& dir) const
+	{
+		if (empty()) {
+			return 0;
+		}
+
+		v2f param;
+		const int i = texel(dir, param);
+		const int numParamTexels = _layout == Layout::LAT_LONG ? texels.w() * texels.h() : faceSize * faceSize;
+		return distribution.probability(i) * numParamTexels * invJacobian(param);
+	}
+
+	v3f EnvironmentLight::eval(const v3f& dir) const
+	{
+		if (empty()) {
+			return v3f::Zero();
+		}
+
+		v2f param;
+		const int i = texel(dir, param);
+		return texels.pixel(i % texels.w(), i / texels.w());
+	}
+
+	bool EnvironmentLight::empty() const
+	{
+		return distribution.size() == 0;
+	}
+
+	EnvironmentLight::Layout EnvironmentLight::layout() const
+	{
+		return _layout;
+	}
+
+	SHCoefficients EnvironmentLight::projectSH(const SHProjectionParams& params) const
+	{
+		return _layout == Layout::LAT_LONG ? projectLatLongSH(texels, params) : projectCubeStripSH(texels, params);
+	}
+
+	void EnvironmentLight::buildDistribution()
+	{
+		const int w = texels.w(), h = texels.h();
+		if (w == 0 || h == 0) {
+			distribution = AliasTable();
+			return;
+		}
+
+		std::vector<float> solidAngles(w * static_cast<size_t>(h)), weights(solidAngles.size());
+		parallelForEach(0, h, [&](int y) {
+			for (int x = 0; x < w; ++x) {
+				const size_t i = y * static_cast<size_t>(w) + x;
+				if (_layout == Layout::LAT_LONG) {
+					const float theta = pi<float>() * (y + 0.5f) / h;
+					solidAngles[i] = 2 * pi<float>() * pi<float>() * std::sin(theta) / (w * h);
+				} else {
+					solidAngles[i] = cubeTexelSolidAngle(x % faceSize, y, faceSize);
+				}
+				const v3f& c = texels.pixel(x, y);
+				const float luminance = 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2];
+				weights[i] = std::max(luminance, 0.0f) * solidAngles[i];
+			}
+		});
+
+		distribution = AliasTable(weights);
+		if (distribution.totalWeight() <= 0) {
+			// black environment, still provide valid directions
+			distribution = AliasTable(solidAngles);
+		}
+	}
+
+	int EnvironmentLight::texel(const v3f& dir, v2f& param) const
+	{
+		int x, y;
+		if (_layout == Layout::LAT_LONG) {
+			const v3f d = dir.normalized();
+			float phi = std::atan2(d[1], d[0]);
+			if (phi < 0) {
+				phi += 2 * pi<float>();
+			}
+			param = v2f(phi / (2 * pi<float>()), std::acos(std::clamp(d[2], -1.0f, 1.0f)) / pi<float>());
+			x = std::min(static_cast<int>(param[0] * texels.w()), texels.w() - 1);
+			y = std::min(static_cast<int>(param[1] * texels.h()), texels.h() - 1);
+		} else {
+			const int face = dirToCubeFace(dir, param);
+			x = face * faceSize + std::clamp(static_cast<int>(param[0] * faceSize), 0, faceSize - 1);
+			y = std::clamp(static_cast<int>(param[1] * faceSize), 0, faceSize - 1);
+		}
+		return y * texels.w() + x;
+	}
+
+	float EnvironmentLight::invJacobian(const v2f& param) const
+	{
+		if (_layout == Layout::LAT_LONG) {
+			const float sinTheta = std::sin(pi<float>() * param[1]);
+			return sinTheta > 0 ? 1.0f / (2 * pi<float>() * pi<float>() * sinTheta) : 0.0f;
+		}
+		const float a = 2 * param[0] - 1, b = 2 * param[1] - 1;
+		return std::pow(1 + a * a + b * b, 1.5f) / 4;
+	}
+
+}
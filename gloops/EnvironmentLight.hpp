@@ -0,0 +1,99 @@
+#pragma once
+
+#include "config.hpp"
+#include "Image.hpp"
+#include "SphericalHarmonics.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gloops {
+
+	// same order and (s, t) conventions as GL_TEXTURE_CUBE_MAP_POSITIVE_X + face
+	enum CubeFace { POSITIVE_X, NEGATIVE_X, POSITIVE_Y, NEGATIVE_Y, POSITIVE_Z, NEGATIVE_Z, NUM_CUBE_FACES };
+
+	// uv in [0,1]x[0,1], t = 0 being the first row of the face image, returned dir is not normalized
+	v3f cubeFaceDir(int face, const v2f& uv);
+	int dirToCubeFace(const v3f& dir, v2f& uv);
+
+	// face position, in face size units, in the horizontal cross layout read by Texture::fromPathCube
+	v2i cubeCrossOffset(int face);
+
+	// solid angle of texel (x, y) of a size x size face
+	float cubeTexelSolidAngle(int x, int y, int size);
+
+	// Walker alias method, O(1) sampling of a discrete distribution
+	class AliasTable {
+
+	public:
+		AliasTable() = default;
+		AliasTable(const std::vector<float>& weights);
+
+		// u in [0,1), remapped is a fresh uniform number in [0,1) left from the choice
+		int sample(float u, float& remapped) const;
+		int sample(float u) const;
+
+		float probability(int i) const;
+		int size() const;
+		float totalWeight() const;
+
+	protected:
+		std::vector<float> probs, thresholds;
+		std::vector<int> aliases;
+		float total = 0;
+	};
+
+	// beta = 2, one sample from each strategy
+	float powerHeuristic(float pdf, float otherPdf);
+
+	// distant lighting from a lat-long or cube map, texels are sampled proportionally to luminance times solid angle
+	class EnvironmentLight {
+
+	public:
+		enum class Layout { LAT_LONG, CUBE };
+
+		struct Sample {
+			v3f dir = v3f::Zero();
+			v3f radiance = v3f::Zero();
+			float pdf = 0;
+		};
+
+		EnvironmentLight() = default;
+
+		// lat-long maps follow sphericalDirUV, z up and first row at theta = 0
+		// 8 bits images are assumed to be sRGB encoded
+		static EnvironmentLight fromLatLong(const Image3f& img);
+		static EnvironmentLight fromLatLong(const Image3b& img);
+
+		static EnvironmentLight fromCubeCross(const Image3f& img);
+		static EnvironmentLight fromCubeCross(const Image3b& img);
+		static EnvironmentLight fromPathCube(const std::string& path);
+
+		// u uniform in [0,1)x[0,1), pdf is with respect to solid angle
+		Sample sample(const v2f& u) const;
+		float pdf(const v3f& dir) const;
+		v3f eval(const v3f& dir) const;
+
+		bool empty() const;
+		Layout layout() const;
+
+		// radiance projection, see diffuseSH for ambient lighting
+		SHCoefficients projectSH(const SHProjectionParams& params = {}) const;
+
+	protected:
+		void buildDistribution();
+
+		// texel index and position in [0,1]x[0,1] parameter space
+		int texel(const v3f& dir, v2f& param) const;
+
+		// inverse of the solid angle per unit of parameter space area
+		float invJacobian(const v2f& param) const;
+
+		// faces side by side for cube maps
+		Image3f texels;
+		AliasTable distribution;
+		Layout _layout = Layout::LAT_LONG;
+		int faceSize = 0;
+	};
+
+}
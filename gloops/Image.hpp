@@ -354,6 +354,7 @@ namespace gloops {
 	using Image1f = Image<float, 1>;
 	using Image2f = Image<float, 2>;
 	using Image3f = Image<float, 3>;
+	using Image4f = Image<float, 4>;
 
 	Image3b checkersTexture(int w, int h, int size);
 	Image1f perlinNoise(int w, int h, int size = 5, int levels = 1);
@@ -0,0 +1,182 @@
+#include "Isosurface.hpp"
+#include "Utils.hpp"
+
+#include <unordered_map>
+
+namespace gloops {
+
+	namespace {
+
+		struct Slab {
+			std::unordered_map<size_t, uint> cellToVertex;
+			std::vector<std::pair<v3i, uchar>> cells;	// crossing the iso-value, with their corners inside mask
+			Mesh::Vertices vertices;
+			Mesh::Normals normals;
+			Mesh::Triangles triangles;
+			uint offset = 0;
+		};
+
+		template<typename T>
+		Mesh extract(const Volume<T>& vol, const IsosurfaceParams& params)
+		{
+			const int w = vol.w(), h = vol.h(), d = vol.d();
+			if (std::min({ w, h, d }) < 2) {
+				return Mesh();
+			}
+
+			// cells have voxel centers as corners
+			const v3i numCells(w - 1, h - 1, d - 1);
+			const int slabSize = std::max(params.slabSize, 1);
+			const int numSlabs = (numCells[2] + slabSize - 1) / slabSize;
+			const float iso = params.isoValue;
+			const float outwards = params.insideBelow ? 1.0f : -1.0f;
+			const v3f cellSize = vol.cellSize();
+			const v3f origin = vol.box().min() + 0.5f * cellSize;
+
+			auto inside = [&](float v) {
+				return params.insideBelow ? v < iso : v > iso;
+			};
+			auto cellId = [&](int x, int y, int z) {
+				return (static_cast<size_t>(z) * numCells[1] + y) * numCells[0] + x;
+			};
+
+			static const int edges[12][2] = {
+				{ 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 },
+				{ 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 },
+				{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 },
+			};
+
+			std::vector<Slab> slabs(numSlabs);
+
+			// cell vertices, rows of cells are scanned with the inside flags of their 4 rows of voxels
+			parallelForEach(0, numSlabs, [&](int s) {
+				Slab& slab = slabs[s];
+				const int zEnd = std::min((s + 1) * slabSize, numCells[2]);
+				std::vector<uchar> columns(w);
+				float corners[8];
+				for (int z = s * slabSize; z < zEnd; ++z) {
+					for (int y = 0; y < numCells[1]; ++y) {
+						const T* rows[4] = { &vol.at(0, y, z), &vol.at(0, y + 1, z), &vol.at(0, y, z + 1), &vol.at(0, y + 1, z + 1) };
+						for (int x = 0; x < w; ++x) {
+							// corner c is at (c & 1, (c >> 1) & 1, c >> 2), a column holds the corners with c & 1 == 0
+							columns[x] = 
+								inside(static_cast<float>(rows[0][x])) | inside(static_cast<float>(rows[1][x])) << 2 |
+								inside(static_cast<float>(rows[2][x])) << 4 | inside(static_cast<float>(rows[3][x])) << 6;
+						}
+
+						for (int x = 0; x < numCells[0]; ++x) {
+							const int mask = columns[x] | columns[x + 1] << 1;
+							if (mask == 0 || mask == 255) {
+								continue;
+							}
+
+							for (int c = 0; c < 8; ++c) {
+								corners[c] = static_cast<float>(rows[c >> 1][x + (c & 1)]);
+							}
+
+							v3f mean = v3f::Zero();
+							int numCrossings = 0;
+							for (const auto& e : edges) {
+								if (((mask >> e[0]) & 1) == ((mask >> e[1]) & 1)) {
+									continue;
+								}
+								const float t = (iso - corners[e[0]]) / (corners[e[1]] - corners[e[0]]);
+								const v3f a(e[0] & 1, (e[0] >> 1) & 1, e[0] >> 2), b(e[1] & 1, (e[1] >> 1) & 1, e[1] >> 2);
+								mean += a + t * (b - a);
+								++numCrossings;
+							}
+
+							const v3f g = v3f(x, y, z) + mean / static_cast<float>(numCrossings);
+							const v3f p = origin + g.cwiseProduct(cellSize);
+
+							// central differences of the trilinear interpolation, one voxel apart
+							v3f grad;
+							for (int k = 0; k < 3; ++k) {
+								const v3f dp = cellSize[k] * v3f::Unit(k);
+								grad[k] = (static_cast<float>(vol.sample(p + dp)) - static_cast<float>(vol.sample(p - dp))) / cellSize[k];
+							}
+							if (grad.isZero()) {
+								grad = v3f::UnitZ();
+							}
+
+							slab.cellToVertex[cellId(x, y, z)] = static_cast<uint>(slab.vertices.size());
+							slab.cells.emplace_back(v3i(x, y, z), static_cast<uchar>(mask));
+							slab.vertices.push_back(p);
+							slab.normals.push_back(outwards * grad.normalized());
+						}
+					}
+				}
+			}, params.maxNumThreads);
+
+			uint numVertices = 0;
+			for (Slab& slab : slabs) {
+				slab.offset = numVertices;
+				numVertices += static_cast<uint>(slab.vertices.size());
+			}
+
+			auto vertexId = [&](const v3i& cell) {
+				const Slab& slab = slabs[cell[2] / slabSize];
+				return slab.offset + slab.cellToVertex.at(cellId(cell[0], cell[1], cell[2]));
+			};
+
+			// each voxel edge crossing the iso-value is shared by 4 cells, and handled by the one having its first voxel as corner 0
+			// the quad cells are ordered counterclockwise around the edge axis a, then facing outwards
+			parallelForEach(0, numSlabs, [&](int s) {
+				Slab& slab = slabs[s];
+				for (const auto& cell : slab.cells) {
+					const v3i& p = cell.first;
+					const int mask = cell.second;
+					for (int a = 0; a < 3; ++a) {
+						const int b = (a + 1) % 3, c = (a + 2) % 3;
+						const bool in = mask & 1;
+						if (p[b] < 1 || p[c] < 1 || in == static_cast<bool>((mask >> (1 << a)) & 1)) {
+							continue;
+						}
+
+						uint ids[4];
+						const int offsets[4][2] = { { -1, -1 }, { 0, -1 }, { 0, 0 }, { -1, 0 } };
+						for (int i = 0; i < 4; ++i) {
+							v3i q = p;
+							q[b] += offsets[i][0];
+							q[c] += offsets[i][1];
+							ids[i] = vertexId(q);
+						}
+						if (!in) {
+							std::swap(ids[1], ids[3]);
+						}
+						slab.triangles.emplace_back(ids[0], ids[1], ids[2]);
+						slab.triangles.emplace_back(ids[0], ids[2], ids[3]);
+					}
+				}
+			}, params.maxNumThreads);
+
+			Mesh::Vertices vertices;
+			Mesh::Normals normals;
+			Mesh::Triangles triangles;
+			vertices.reserve(numVertices);
+			normals.reserve(numVertices);
+			for (const Slab& slab : slabs) {
+				vertices.insert(vertices.end(), slab.vertices.begin(), slab.vertices.end());
+				normals.insert(normals.end(), slab.normals.begin(), slab.normals.end());
+				triangles.insert(triangles.end(), slab.triangles.begin(), slab.triangles.end());
+			}
+
+			Mesh mesh;
+			mesh.setVertices(std::move(vertices));
+			mesh.setTriangles(std::move(triangles));
+			mesh.setNormals(std::move(normals));
+			return mesh;
+		}
+	}
+
+	Mesh extractIsosurface(const Volume1f& vol, const IsosurfaceParams& params)
+	{
+		return extract(vol, params);
+	}
+
+	Mesh extractIsosurface(const Volume1b& vol, const IsosurfaceParams& params)
+	{
+		return extract(vol, params);
+	}
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "config.hpp"
+#include "Mesh.hpp"
+#include "Volume.hpp"
+
+namespace gloops {
+
+	struct IsosurfaceParams {
+		float isoValue = 0.0f;			// in volume units, e.g. 127.5 for the uchar SDFs of the demo
+		bool insideBelow = true;		// as signed distances, false for densities
+		int slabSize = 8;				// cell layers along z per parallel job
+		int maxNumThreads = 256;
+	};
+
+	// dual contouring without normal constraints (surface nets): one vertex per cell of 2x2x2 voxel centers crossing
+	// the iso-value, at the mean of its edge crossings, and one quad per voxel edge crossing it
+	// the mesh is welded, watertight away from the volume border, with outward normals from the volume gradient
+	// slabs are processed in parallel, cell vertices being shared between slabs through per slab hash maps
+	Mesh extractIsosurface(const Volume1f& vol, const IsosurfaceParams& params = {});
+	Mesh extractIsosurface(const Volume1b& vol, const IsosurfaceParams& params = {});
+
+}
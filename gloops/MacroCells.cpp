@@ -0,0 +1,42 @@
+#include "MacroCells.hpp"
+#include "Utils.hpp"
+
+namespace gloops {
+
+	Volume<v2b> buildMacroCells(const Volume1b& vol, const MacroCellParams& params)
+	{
+		const int c = std::max(params.cellSize, 1);
+		const v3i size = (vol.size() + v3i::Constant(c - 1)) / c;
+
+		Volume<v2b> out(size[0], size[1], size[2], v2b(255, 0));
+		out.setBox(BBox3f(vol.box().min(), vol.box().min() + (c * size).cast<float>().cwiseProduct(vol.cellSize())));
+
+		if (vol.size().minCoeff() <= 0) {
+			return out;
+		}
+
+		parallelForEach(0, size[2], [&](int k) {
+			for (int j = 0; j < size[1]; ++j) {
+				for (int i = 0; i < size[0]; ++i) {
+					const v3i vmin = (c * v3i(i, j, k) - v3i::Ones()).cwiseMax(v3i::Zero());
+					const v3i vmax = (c * v3i(i + 1, j + 1, k + 1)).cwiseMin(vol.size() - v3i::Ones());
+
+					uchar lo = 255, hi = 0;
+					for (int z = vmin[2]; z <= vmax[2]; ++z) {
+						for (int y = vmin[1]; y <= vmax[1]; ++y) {
+							for (int x = vmin[0]; x <= vmax[0]; ++x) {
+								const uchar v = vol.at(x, y, z);
+								lo = std::min(lo, v);
+								hi = std::max(hi, v);
+							}
+						}
+					}
+					out.at(i, j, k) = v2b(lo, hi);
+				}
+			}
+		}, params.maxNumThreads);
+
+		return out;
+	}
+
+}
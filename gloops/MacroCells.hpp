@@ -0,0 +1,18 @@
+#pragma once
+
+#include "config.hpp"
+#include "Volume.hpp"
+
+namespace gloops {
+
+	struct MacroCellParams {
+		int cellSize = 8;		// voxels per macro cell side
+		int maxNumThreads = 256;
+	};
+
+	// min and max of each cellSize^3 block of voxels, extended by one voxel on each side so that they also
+	// bound the trilinear interpolation anywhere within the macro cell
+	// macro cell (i, j, k) covers voxels [i, i + 1) * cellSize, the last ones may be partial
+	Volume<v2b> buildMacroCells(const Volume1b& vol, const MacroCellParams& params = {});
+
+}
@@ -0,0 +1,165 @@
+#include "MappedFile.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gloops {
+
+	MappedFile::MappedFile(const std::string& path)
+	{
+		open(path);
+	}
+
+	MappedFile::MappedFile(MappedFile&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other) {
+			close();
+			std::swap(_data, other._data);
+			std::swap(_size, other._size);
+#ifdef _WIN32
+			std::swap(file, other.file);
+			std::swap(mapping, other.mapping);
+#endif
+		}
+		return *this;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		close();
+	}
+
+#ifdef _WIN32
+
+	bool MappedFile::open(const std::string& path)
+	{
+		close();
+
+		HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (handle == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		file = handle;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(handle, &size)) {
+			close();
+			return false;
+		}
+		_size = static_cast<size_t>(size.QuadPart);
+		if (_size == 0) {
+			return true;
+		}
+
+		mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping) {
+			close();
+			return false;
+		}
+		_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!_data) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+		if (_data) {
+			UnmapViewOfFile(_data);
+		}
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		if (file) {
+			CloseHandle(file);
+		}
+		_data = nullptr;
+		_size = 0;
+		mapping = nullptr;
+		file = nullptr;
+	}
+
+	bool MappedFile::isOpen() const
+	{
+		return file != nullptr;
+	}
+
+#else
+
+	bool MappedFile::open(const std::string& path)
+	{
+		close();
+
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+
+		struct stat infos;
+		if (::fstat(fd, &infos) != 0) {
+			::close(fd);
+			return false;
+		}
+
+		_size = static_cast<size_t>(infos.st_size);
+		if (_size > 0) {
+			void* ptr = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr == MAP_FAILED) {
+				::close(fd);
+				_size = 0;
+				return false;
+			}
+			_data = static_cast<const char*>(ptr);
+		} else {
+			// a valid pointer for empty files
+			_data = "";
+		}
+
+		// the mapping outlives the descriptor
+		::close(fd);
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+		if (_data && _size > 0) {
+			::munmap(const_cast<char*>(_data), _size);
+		}
+		_data = nullptr;
+		_size = 0;
+	}
+
+	bool MappedFile::isOpen() const
+	{
+		return _data != nullptr;
+	}
+
+#endif
+
+	const char* MappedFile::data() const
+	{
+		return _data;
+	}
+
+	size_t MappedFile::size() const
+	{
+		return _size;
+	}
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "config.hpp"
+
+#include <string>
+
+namespace gloops {
+
+	// read only memory mapping of a whole file, move only
+	class MappedFile {
+
+	public:
+		MappedFile() = default;
+		MappedFile(const std::string& path);
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile();
+
+		// false if the file cannot be opened, empty files are not mapped
+		bool open(const std::string& path);
+		void close();
+
+		bool isOpen() const;
+		const char* data() const;
+		size_t size() const;
+
+	protected:
+		const char* _data = nullptr;
+		size_t _size = 0;
+#ifdef _WIN32
+		void* file = nullptr;
+		void* mapping = nullptr;
+#endif
+	};
+
+}
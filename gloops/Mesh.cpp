@@ -1,13 +1,17 @@
 #include "Mesh.hpp"
+#include "MappedFile.hpp"
+#include "MeshAdjacency.hpp"
+#include "MeshCache.hpp"
 #include "Debug.hpp"
 #include "Utils.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <cstring>
 #include <cmath>
-#include <queue>
-
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
+#include <filesystem>
+#include <numeric>
 
 //#include <assimp/Importer.hpp>
 //#include <assimp/scene.h>
@@ -89,82 +93,179 @@ namespace gloops {
 
 	Mesh::Mesh()
 	{
-		triangles = std::make_shared<Triangles>();
-		vertices = std::make_shared<Vertices>();
-		normals = std::make_shared<Normals>();
-		colors = std::make_shared<Colors>();
-		uvs = std::make_shared<UVs>();
-
-		_transform = std::make_shared<Transform4>();
-		modelCallbacks = std::make_shared<Callbacks>();
-		geometryCallbacks = std::make_shared<Callbacks>();
+		data = std::make_shared<Data>();
 	}
 
 	const Mesh::Vertices& Mesh::getVertices() const
 	{
-		return *vertices;
+		return readable(data->vertices);
 	}
 
 	const Mesh::Triangles& Mesh::getTriangles() const
 	{
-		return *triangles;
+		return readable(data->triangles);
 	}
 
 	const Mesh::Normals& Mesh::getNormals() const
 	{
-		return *normals;
+		return readable(data->normals);
 	}
 
 	const Mesh::UVs& Mesh::getUVs() const
 	{
-		return *uvs;
+		return readable(data->uvs);
 	}
 
 	const Mesh::Colors& Mesh::getColors() const
 	{
-		return *colors;
+		return readable(data->colors);
 	}
 
 	const m4f& Mesh::model() const
 	{
-		return _transform->model();
+		return data->transform.model();
 	}
 
 	void Mesh::setTriangles(const Triangles& tris)
 	{
-		*triangles = tris;
-		invalidateGeometry();
+		setTriangles(Triangles(tris));
 	}
 
 	void Mesh::setVertices(const Vertices& verts)
 	{
-		*vertices = verts;
-		invalidateGeometry();
+		setVertices(Vertices(verts));
 	}
 
 	void Mesh::setUVs(const UVs& texCoords)
 	{
-		*uvs = texCoords;
+		setUVs(UVs(texCoords));
 	}
 
 	void Mesh::setNormals(const Normals& norms)
 	{
-		*normals = norms;
+		setNormals(Normals(norms));
 	}
 
 	void Mesh::setColors(const Colors& cols)
 	{
-		*colors = cols;
+		setColors(Colors(cols));
+	}
+
+	void Mesh::setTriangles(Triangles&& tris)
+	{
+		data->triangles = std::make_shared<Triangles>(std::move(tris));
+		invalidateAdjacency();
+		invalidateGeometry();
+		invalidateArrays();
+	}
+
+	void Mesh::setVertices(Vertices&& verts)
+	{
+		if (verts.size() != getVertices().size()) {
+			invalidateAdjacency();
+		}
+		data->vertices = std::make_shared<Vertices>(std::move(verts));
+		invalidateGeometry();
+		invalidateArrays();
+	}
+
+	void Mesh::setUVs(UVs&& texCoords)
+	{
+		data->uvs = std::make_shared<UVs>(std::move(texCoords));
+		invalidateArrays();
+	}
+
+	void Mesh::setNormals(Normals&& norms)
+	{
+		data->normals = std::make_shared<Normals>(std::move(norms));
+		invalidateArrays();
+	}
+
+	void Mesh::setColors(Colors&& cols)
+	{
+		data->colors = std::make_shared<Colors>(std::move(cols));
+		invalidateArrays();
+	}
+
+	Mesh Mesh::clone() const
+	{
+		Mesh out;
+		out.data->triangles = data->triangles;
+		out.data->vertices = data->vertices;
+		out.data->normals = data->normals;
+		out.data->colors = data->colors;
+		out.data->uvs = data->uvs;
+		out.data->attributes = data->attributes;
+		out.data->transform = data->transform;
+		{
+			std::lock_guard<std::mutex> lock(data->adjacency.mutex);
+			out.data->adjacency.adjacency = data->adjacency.adjacency;
+		}
+		return out;
 	}
 
 	Mesh& Mesh::invertFaces()
 	{
-		for (Tri& tri : *triangles) {
-			tri = v3u(tri[0], tri[2], tri[1]);
+		editTriangles([](Span<Tri> tris) {
+			for (Tri& tri : tris) {
+				tri = v3u(tri[0], tri[2], tri[1]);
+			}
+		});
+		return editNormals([](Span<v3f> normals) {
+			for (v3f& normal : normals) {
+				normal = -normal;
+			}
+		});
+	}
+
+	Mesh& Mesh::reorderTriangles(const std::vector<uint>& order)
+	{
+		const Triangles& triangles = getTriangles();
+		Triangles reordered(order.size());
+		for (size_t t = 0; t < order.size(); ++t) {
+			reordered[t] = triangles[order[t]];
+		}
+		setTriangles(std::move(reordered));
+		return *this;
+	}
+
+	Mesh& Mesh::reorderVertices(const std::vector<uint>& order)
+	{
+		const size_t numVertices = getVertices().size();
+		std::vector<uint> newIds(numVertices);
+		for (size_t v = 0; v < numVertices; ++v) {
+			newIds[order[v]] = static_cast<uint>(v);
+		}
+
+		auto gather = [&](const auto& attribute) {
+			std::decay_t<decltype(attribute)> reordered(numVertices);
+			for (size_t v = 0; v < numVertices; ++v) {
+				reordered[v] = attribute[order[v]];
+			}
+			return reordered;
+		};
+
+		Triangles triangles = getTriangles();
+		for (Tri& tri : triangles) {
+			tri = Tri(newIds[tri[0]], newIds[tri[1]], newIds[tri[2]]);
+		}
+
+		setVertices(gather(getVertices()));
+		if (getNormals().size() == numVertices) {
+			setNormals(gather(getNormals()));
 		}
-		for (v3f& normal : *normals) {
-			normal = -normal;
+		if (getUVs().size() == numVertices) {
+			setUVs(gather(getUVs()));
+		}
+		if (getColors().size() == numVertices) {
+			setColors(gather(getColors()));
+		}
+		for (int id = 0; id < data->attributes.size(); ++id) {
+			if (data->attributes.count(id) == numVertices) {
+				data->attributes.reorder(id, order);
+			}
 		}
+		setTriangles(std::move(triangles));
 		return *this;
 	}
 
@@ -184,66 +285,89 @@ namespace gloops {
 			[](GLuint* ptr) { glGenBuffers(1, ptr); },
 			[](const GLuint* ptr) { glDeleteBuffers(1, ptr); }
 		);
-
-		custom_attributes = std::make_shared< std::map<std::string, std::any>>();
 	}
 
 	MeshGL::MeshGL(const Mesh& mesh) : MeshGL()
 	{
-		setTriangles(mesh.getTriangles());
-		setVertices(mesh.getVertices());
-		
-		if (mesh.getUVs().size() > 0) {
-			setUVs(mesh.getUVs());
+		// arrays are copied on write only
+		Mesh::operator=(mesh.clone());
+
+		attributes_mapping["positions"] = VertexAttribute(getVertices(), PositionDefaultLocation);
+		numElements = static_cast<GLsizei>(getVertices().size());
+
+		if (getUVs().size() > 0) {
+			attributes_mapping["uvs"] = VertexAttribute(getUVs(), UVDefaultLocation);
 		}
-		if (mesh.getNormals().size() > 0) {
-			setNormals(mesh.getNormals());
+		if (getNormals().size() > 0) {
+			attributes_mapping["normals"] = VertexAttribute(getNormals(), NormalDefaultLocation);
 		}
-		if (mesh.getColors().size() > 0) {
-			setColors(mesh.getColors());
+		if (getColors().size() > 0) {
+			attributes_mapping["colors"] = VertexAttribute(getColors(), ColorDefaultLocation);
 		}
-	
-		*_transform = mesh.transform();
-
 	}
 
 	void MeshGL::setTriangles(const Triangles& tris)
 	{
-		Mesh::setTriangles(tris);
-		dirtyBuffers = true;
+		setTriangles(Triangles(tris));
 	}
 
 	void MeshGL::setVertices(const Vertices& verts, GLuint location)
 	{
-		Mesh::setVertices(verts);
-		dirtyBuffers = true;
+		setVertices(Vertices(verts), location);
+	}
+
+	void MeshGL::setNormals(const Normals& norms, GLuint location)
+	{
+		setNormals(Normals(norms), location);
+	}
+
+	void MeshGL::setColors(const Colors& cols, GLuint location)
+	{
+		setColors(Colors(cols), location);
+	}
+
+	void MeshGL::setUVs(const UVs& texCoords, GLuint location)
+	{
+		setUVs(UVs(texCoords), location);
+	}
+
+	void MeshGL::setTriangles(Triangles&& tris)
+	{
+		Mesh::setTriangles(std::move(tris));
+	}
+
+	void MeshGL::setVertices(Vertices&& verts, GLuint location)
+	{
+		Mesh::setVertices(std::move(verts));
 		attributes_mapping["positions"] = VertexAttribute(getVertices(), location);
 		if (numElements == 0) {
 			numElements = static_cast<GLsizei>(getVertices().size());
 		}
 	}
 
-	void MeshGL::setNormals(const Normals& norms, GLuint location)
+	void MeshGL::setNormals(Normals&& norms, GLuint location)
 	{
-		Mesh::setNormals(norms);
-		dirtyBuffers = true;
+		Mesh::setNormals(std::move(norms));
 		attributes_mapping["normals"] = VertexAttribute(getNormals(), location);
 	}
 
-	void MeshGL::setColors(const Colors& cols, GLuint location)
+	void MeshGL::setColors(Colors&& cols, GLuint location)
 	{
-		Mesh::setColors(cols);
-		dirtyBuffers = true;
+		Mesh::setColors(std::move(cols));
 		attributes_mapping["colors"] = VertexAttribute(getColors(), location);
 	}
 
-	void MeshGL::setUVs(const UVs& texCoords, GLuint location)
+	void MeshGL::setUVs(UVs&& texCoords, GLuint location)
 	{
-		Mesh::setUVs(texCoords);
-		dirtyBuffers = true;
+		Mesh::setUVs(std::move(texCoords));
 		attributes_mapping["uvs"] = VertexAttribute(getUVs(), location);
 	}
 
+	void MeshGL::invalidateArrays()
+	{
+		dirtyBuffers = true;
+	}
+
 	//void MeshGL::modifyAttributeLocation(GLuint currentLocation, GLuint newLocation)
 	//{
 	//	auto attribute = attributes_mapping.find(currentLocation);
@@ -262,9 +386,9 @@ namespace gloops {
 	//	return out;
 	//}
 
-	std::vector<MeshGL> MeshGL::loadMeshes(const std::string& path)
+	std::vector<MeshGL> MeshGL::loadMeshes(const std::string& path, const MeshLoadingParams& params)
 	{
-		std::vector<Mesh> meshes = Mesh::loadMeshes(path);
+		std::vector<Mesh> meshes = Mesh::loadMeshes(path, params);
 
 		std::vector<MeshGL> out;
 		for (const auto& mesh : meshes) {
@@ -274,10 +398,10 @@ namespace gloops {
 		return out;
 	}
 
-	void MeshGL::computeVertexNormalsFromVertices(GLuint location)
+	void MeshGL::computeVertexNormalsFromVertices(const VertexNormalsParams& params, GLuint location)
 	{
-		Mesh::computeVertexNormalsFromVertices();
-		setNormals(getNormals(), location);
+		Mesh::computeVertexNormalsFromVertices(params);
+		attributes_mapping["normals"] = VertexAttribute(getNormals(), location);
 	}
 
 	void MeshGL::draw() const
@@ -341,8 +465,34 @@ namespace gloops {
 		//glUseProgram(0);
 	}
 
+	void MeshGL::updateArrayPointers() const
+	{
+		auto update = [&](const std::string& name, const auto& values) {
+			auto attribute = attributes_mapping.find(name);
+			if (attribute != attributes_mapping.end()) {
+				attribute->second = VertexAttribute(values, attribute->second.index);
+			}
+		};
+		update("positions", getVertices());
+		update("normals", getNormals());
+		update("colors", getColors());
+		update("uvs", getUVs());
+
+		// GL attributes, their values may have been reset or reordered
+		const MeshAttributes& attributes = getCPUattributes();
+		for (auto& attribute : attributes_mapping) {
+			const int id = attributes.id(attribute.first);
+			if (id >= 0) {
+				attribute.second.pointer = attributes.data(id);
+				attribute.second.total_num_bytes = attributes.count(id) * attributes.elementSize(id);
+			}
+		}
+	}
+
 	void MeshGL::updateBuffers() const
 	{
+		updateArrayPointers();
+
 		glBindVertexArray(vao);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, triangleBuffer);
@@ -382,113 +532,212 @@ namespace gloops {
 		dirtyLocations = false;
 	}
 
-	std::vector<Mesh> Mesh::loadMeshes(const std::string& path)
-	{
-		auto assign3f = [](float& dst, const float& src) {
-			std::memcpy(&dst, &src, 3 * sizeof(float));
-		};
+	namespace {
 
-		auto assign2f = [](float& dst, const float& src) {
-			std::memcpy(&dst, &src, 2 * sizeof(float));
-		};
+		// open addressing from (v, vt, vn) corners to vertices, with linear probing
+		class CornerMap {
+		public:
+			CornerMap(size_t numCorners) {
+				size_t capacity = 16;
+				while (capacity < 2 * numCorners) {
+					capacity *= 2;
+				}
+				keys.resize(capacity);
+				values.assign(capacity, empty);
+				mask = capacity - 1;
+			}
 
-		struct IndexSort {
-			bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const {
-				return a.vertex_index < b.vertex_index;
+			// the vertex of the corner, candidate if the corner is new
+			uint insert(const ObjIndex& key, uint candidate) {
+				size_t slot = hash(key) & mask;
+				while (values[slot] != empty) {
+					if (keys[slot] == key) {
+						return values[slot];
+					}
+					slot = (slot + 1) & mask;
+				}
+				keys[slot] = key;
+				values[slot] = candidate;
+				return candidate;
 			}
-		};
 
-		tinyobj::ObjReader reader;
-		tinyobj::ObjReaderConfig config;
-		config.triangulate = true;
-		config.vertex_color = false;
-	
-		std::cout << "loading " << path << std::flush;
-		if (!reader.ParseFromFile(path, config)) {
-			addToLogs(LogType::ERROR, reader.Error());
-		}
-		if (!reader.Warning().empty()) {
-			addToLogs(LogType::WARNING, reader.Warning());
-		}
+		protected:
+			static size_t hash(const ObjIndex& key) {
+				return hashTriplet(key.v, key.vt, key.vn);
+			}
 
-		std::vector<Mesh> out;
-		
-		const auto& attributes = reader.GetAttrib();
-		const auto& shapes = reader.GetShapes();
+			static constexpr uint empty = std::numeric_limits<uint>::max();
+			std::vector<ObjIndex> keys;
+			std::vector<uint> values;
+			size_t mask;
+		};
 
-		const bool hasColor = !attributes.colors.empty(),
-			hasNormals = !attributes.normals.empty(),
-			hasTexCoords = !attributes.texcoords.empty();
+		std::vector<Mesh> loadObjMeshes(const std::string& path, const ObjParsingParams& params)
+		{
+			MappedFile file;
+			if (!file.open(path)) {
+				addToLogs(LogType::ERROR, "cannot open " + path);
+				return {};
+			}
+			const ObjData obj = parseObj(file.data(), file.size(), params);
+			file.close();
+			if (obj.numInvalidLines > 0) {
+				addToLogs(LogType::WARNING, path + " : " + std::to_string(obj.numInvalidLines) + " invalid lines ignored");
+			}
 
-		for (const auto& shape : shapes) {
-			
-			Mesh mesh;
+			const bool hasColor = !obj.colors.empty(),
+				hasNormals = !obj.normals.empty(),
+				hasTexCoords = !obj.texCoords.empty();
+
+			std::vector<Mesh> out(obj.shapes.size());
+			parallelForEach(0, static_cast<int>(obj.shapes.size()), [&](int s) {
+				const ObjShape& shape = obj.shapes[s];
+				const ObjIndex* corners = obj.corners.data() + 3 * shape.firstTriangle;
+				const size_t numCorners = 3 * shape.numTriangles;
+
+				// distinct normals or uvs of a same position give distinct vertices
+				CornerMap cornerMap(numCorners);
+				std::vector<ObjIndex> uniques;
+				Mesh::Triangles triangles(shape.numTriangles);
+				for (size_t i = 0; i < numCorners; ++i) {
+					const uint id = cornerMap.insert(corners[i], static_cast<uint>(uniques.size()));
+					if (id == uniques.size()) {
+						uniques.push_back(corners[i]);
+					}
+					triangles[i / 3][i % 3] = id;
+				}
 
-			const size_t numIndices = shape.mesh.indices.size();
+				const size_t numVertices = uniques.size();
+				Mesh::Vertices vertices(numVertices, v3f::Zero());
+				Mesh::Colors colors(hasColor ? numVertices : 0, v3f::Ones());
+				Mesh::Normals normals(hasNormals ? numVertices : 0, v3f::Zero());
+				Mesh::UVs texCoords(hasTexCoords ? numVertices : 0, v2f::Zero());
+				for (size_t i = 0; i < numVertices; ++i) {
+					const ObjIndex& index = uniques[i];
+					if (index.v >= 0) {
+						vertices[i] = obj.positions[index.v];
+						if (hasColor) {
+							colors[i] = obj.colors[index.v];
+						}
+					}
+					if (hasNormals && index.vn >= 0) {
+						normals[i] = obj.normals[index.vn];
+					}
+					if (hasTexCoords && index.vt >= 0) {
+						texCoords[i] = obj.texCoords[index.vt];
+					}
+				}
 
-			std::map<tinyobj::index_t, int, IndexSort> tinyobj_to_unique = {};
+				Mesh& mesh = out[s];
+				mesh.setTriangles(std::move(triangles));
+				mesh.setVertices(std::move(vertices));
+				if (hasColor) {
+					mesh.setColors(std::move(colors));
+				}
+				if (hasNormals) {
+					mesh.setNormals(std::move(normals));
+				}
+				if (hasTexCoords) {
+					mesh.setUVs(std::move(texCoords));
+				}
+			}, params.maxNumThreads);
 
-			Mesh::Triangles triangles(numIndices / 3);
-			for (size_t i = 0; i < numIndices; ++i) {
-				
-				const tinyobj::index_t& v_index = shape.mesh.indices[i];
+			size_t numVertices = 0;
+			for (const Mesh& mesh : out) {
+				numVertices += mesh.getVertices().size();
+			}
+			std::cout << ", " << out.size() << " shapes, " << numVertices << " vertices, " << obj.corners.size() / 3 << " triangles";
+			std::cout << (hasColor ? ", colors" : "") << (hasNormals ? ", normals" : "") << (hasTexCoords ? ", texCoords" : "") << std::endl;
 
-				if (tinyobj_to_unique.find(v_index) == tinyobj_to_unique.end()) {
-					tinyobj_to_unique[v_index] = (int)tinyobj_to_unique.size();
-				}
+			return out;
+		}
+	}
 
-				triangles[i / 3][i % 3] = tinyobj_to_unique[v_index];
+	std::vector<Mesh> Mesh::loadMeshes(const std::string& path, const MeshLoadingParams& params)
+	{
+		std::cout << "loading " << path << std::flush;
 
+		// valid if built from this very file, in its current version
+		const MeshCacheKey key = params.useCache ? MeshCacheKey::fromFile(path) : MeshCacheKey();
+		if (params.useCache) {
+			MeshCache cache;
+			if (cache.open(meshCachePath(path)) && cache.key() == key) {
+				std::cout << ", from cache, " << cache.numMeshes() << " shapes" << std::endl;
+				return cache.toMeshes();
 			}
-			mesh.setTriangles(triangles);
-		
-			const size_t numVertices = tinyobj_to_unique.size();
+		}
 
-			std::cout << ", " << numVertices << " vertices " << std::flush;
+		std::string extension = std::filesystem::path(path).extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
 
-			std::vector<v3f> vertices(numVertices);
-			for (const auto& indice : tinyobj_to_unique) {
-				assign3f(vertices[indice.second][0], attributes.vertices[3*indice.first.vertex_index]);
+		std::vector<Mesh> out;
+		if (extension == ".ply" || extension == ".stl") {
+			Mesh mesh = extension == ".ply" ? readPLY(path, params.ply) : readSTL(path, params.stl);
+			if (mesh) {
+				std::cout << ", " << mesh.getVertices().size() << " vertices, " << mesh.getTriangles().size() << " triangles" << std::endl;
+				out.push_back(std::move(mesh));
 			}
-			mesh.setVertices(vertices);
+		} else {
+			out = loadObjMeshes(path, params.obj);
+		}
+
+		if (params.useCache && !out.empty() && !MeshCache::write(meshCachePath(path), out, key)) {
+			addToLogs(LogType::WARNING, "cannot write mesh cache for " + path);
+		}
+
+		return out;
+	}
 
-			if (hasColor) {
-				std::cout << ", colors" << std::flush;
-				std::vector<v3f> colors(numVertices);
-				for (const auto& indice : tinyobj_to_unique) {
-					assign3f(colors[indice.second][0], attributes.colors[3*indice.first.vertex_index]);
+	namespace {
+
+		// lock free union-find, roots are always the smallest vertex of their set
+		class ConcurrentDisjointSets {
+		public:
+			ConcurrentDisjointSets(size_t size) : parents(size) {
+				for (size_t i = 0; i < size; ++i) {
+					parents[i].store(static_cast<uint>(i), std::memory_order_relaxed);
 				}
-				mesh.setColors(colors);
 			}
 
-			if (hasNormals) {
-				std::cout << ", normals" << std::flush;
-				std::vector<v3f> normals(numVertices);
-				for (const auto& indice : tinyobj_to_unique) {
-					assign3f(normals[indice.second][0], attributes.normals[3 * indice.first.normal_index]);
+			// with path halving, concurrent finds only shortcut valid paths
+			uint find(uint x) {
+				while (true) {
+					uint parent = parents[x].load(std::memory_order_relaxed);
+					if (parent == x) {
+						return x;
+					}
+					const uint grandParent = parents[parent].load(std::memory_order_relaxed);
+					if (grandParent != parent) {
+						parents[x].compare_exchange_weak(parent, grandParent, std::memory_order_relaxed);
+					}
+					x = grandParent;
 				}
-			
-				mesh.setNormals(normals);
 			}
 
-			if (hasTexCoords) {
-				std::cout << ", texCoords" << std::flush;
-				std::vector<v2f> texCoords(numVertices);
-				for (const auto& indice : tinyobj_to_unique) {
-					assign2f(texCoords[indice.second][0], attributes.texcoords[2*indice.first.texcoord_index]);
+			// larger roots are linked under smaller ones, so that no cycle can be created
+			void unite(uint a, uint b) {
+				while (true) {
+					a = find(a);
+					b = find(b);
+					if (a == b) {
+						return;
+					}
+					if (a < b) {
+						std::swap(a, b);
+					}
+					uint expected = a;
+					if (parents[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) {
+						return;
+					}
 				}
-				mesh.setUVs(texCoords);
 			}
 
-			std::cout << std::endl;
-
-			out.push_back(std::move(mesh));
-		}
-
-		return out;
+		protected:
+			std::vector<std::atomic<uint>> parents;
+		};
 	}
 
-	std::vector<Mesh> Mesh::extractComponents() const
+	std::vector<Mesh> Mesh::extractComponents(bool connectByPosition) const
 	{
 		std::vector<Mesh> out;
 
@@ -496,94 +745,107 @@ namespace gloops {
 			return out;
 		}
 
-		std::map<size_t, std::vector<size_t>> triangles_map;
+		const Triangles& triangles = getTriangles();
+		const size_t numVertices = getVertices().size(), numTriangles = triangles.size();
 
-		for (size_t t_id = 0; t_id < getTriangles().size(); ++t_id) {
-			for (int i = 0; i < 3; ++i) {
-				triangles_map[getTriangles()[t_id][i]].push_back(t_id);
+		ConcurrentDisjointSets sets(numVertices);
+		forEachRange(numTriangles, [&](size_t from, size_t to) {
+			for (size_t t = from; t < to; ++t) {
+				sets.unite(triangles[t][0], triangles[t][1]);
+				sets.unite(triangles[t][0], triangles[t][2]);
+			}
+		});
+
+		if (connectByPosition) {
+			// runs of equal positions once sorted
+			const Vertices& vertices = getVertices();
+			std::vector<uint> sorted(numVertices);
+			std::iota(sorted.begin(), sorted.end(), 0);
+			auto less = [&](uint a, uint b) {
+				return std::lexicographical_compare(vertices[a].data(), vertices[a].data() + 3, vertices[b].data(), vertices[b].data() + 3);
+			};
+			std::sort(sorted.begin(), sorted.end(), less);
+			for (size_t i = 1; i < numVertices; ++i) {
+				if (vertices[sorted[i]] == vertices[sorted[i - 1]]) {
+					sets.unite(sorted[i], sorted[i - 1]);
+				}
 			}
 		}
 
-		std::vector<int> v_visited(getVertices().size(), false), t_visited(getTriangles().size(), false);
-		std::queue<size_t> queue;
-		for (size_t v_id = 0; v_id < getVertices().size(); ++v_id) {
-			if (v_visited[v_id]) {
-				continue;
+		// components numbered by their smallest vertex, isolated vertices being components on their own
+		std::vector<uint> roots(numVertices);
+		forEachRange(numVertices, [&](size_t from, size_t to) {
+			for (size_t v = from; v < to; ++v) {
+				roots[v] = sets.find(static_cast<uint>(v));
 			}
-			queue.push(v_id);
-			v_visited[v_id] = true;
-
-			std::vector<size_t> currentVertices, currentTriangles;
+		});
 
-			while (!queue.empty()) {
-				const size_t current_v_id = queue.front();
-				queue.pop();	
-				currentVertices.push_back(current_v_id);
+		std::vector<uint> components(numVertices);
+		uint numComponents = 0;
+		for (size_t v = 0; v < numVertices; ++v) {
+			components[v] = roots[v] == v ? numComponents++ : components[roots[v]];
+		}
 
-				for (const auto& tri_id : triangles_map[current_v_id]) {
-					if (!t_visited[tri_id]) {
-						currentTriangles.push_back(tri_id);
-						t_visited[tri_id] = true;
-					}
+		// a single counting sort of the vertices and of the triangles by component, local vertex ids being ranks within it
+		std::vector<size_t> vertexOffsets(numComponents + 1, 0), triangleOffsets(numComponents + 1, 0);
+		for (size_t v = 0; v < numVertices; ++v) {
+			++vertexOffsets[components[v] + 1];
+		}
+		for (size_t t = 0; t < numTriangles; ++t) {
+			++triangleOffsets[components[triangles[t][0]] + 1];
+		}
+		std::partial_sum(vertexOffsets.begin(), vertexOffsets.end(), vertexOffsets.begin());
+		std::partial_sum(triangleOffsets.begin(), triangleOffsets.end(), triangleOffsets.begin());
 
-					for (int i = 0; i < 3; ++i) {
-						const size_t next_v_id = getTriangles()[tri_id][i];
-						if (!v_visited[next_v_id]) {
-							queue.push(next_v_id);
-							v_visited[next_v_id] = true;
-						}
-					}
-				}
+		std::vector<uint> sortedVertices(numVertices), localIds(numVertices), sortedTriangles(numTriangles);
+		{
+			std::vector<size_t> heads(vertexOffsets.begin(), vertexOffsets.end() - 1);
+			for (size_t v = 0; v < numVertices; ++v) {
+				const size_t position = heads[components[v]]++;
+				sortedVertices[position] = static_cast<uint>(v);
+				localIds[v] = static_cast<uint>(position - vertexOffsets[components[v]]);
 			}
-
-			Mesh mesh;
-
-			std::vector<size_t> vs_mapping(getVertices().size());
-
-			Vertices vs(currentVertices.size());
-			for (size_t new_v_id = 0; new_v_id < currentVertices.size(); ++new_v_id) {
-				vs[new_v_id] = getVertices()[currentVertices[new_v_id]];
-				vs_mapping[currentVertices[new_v_id]] = new_v_id;
+		}
+		{
+			std::vector<size_t> heads(triangleOffsets.begin(), triangleOffsets.end() - 1);
+			for (size_t t = 0; t < numTriangles; ++t) {
+				sortedTriangles[heads[components[triangles[t][0]]]++] = static_cast<uint>(t);
 			}
-			mesh.setVertices(vs);
+		}
 
-			Triangles ts(currentTriangles.size());
-			for (size_t new_t_id = 0; new_t_id < currentTriangles.size(); ++new_t_id) {
-				const auto& prev_triangle = getTriangles()[currentTriangles[new_t_id]];
-				for (int i = 0; i < 3; ++i) {
-					ts[new_t_id][i] = (GLuint)vs_mapping[prev_triangle[i]];
+		out.resize(numComponents);
+		parallelForEach(0, static_cast<int>(numComponents), [&](int c) {
+			const uint* vertexIds = sortedVertices.data() + vertexOffsets[c];
+			const size_t numLocalVertices = vertexOffsets[c + 1] - vertexOffsets[c];
+			auto gather = [&](const auto& attribute) {
+				std::decay_t<decltype(attribute)> local(numLocalVertices);
+				for (size_t v = 0; v < numLocalVertices; ++v) {
+					local[v] = attribute[vertexIds[v]];
 				}
+				return local;
+			};
+
+			Triangles ts(triangleOffsets[c + 1] - triangleOffsets[c]);
+			for (size_t t = 0; t < ts.size(); ++t) {
+				const Tri& tri = triangles[sortedTriangles[triangleOffsets[c] + t]];
+				ts[t] = Tri(localIds[tri[0]], localIds[tri[1]], localIds[tri[2]]);
 			}
-			mesh.setTriangles(ts);
-			
+
+			Mesh& mesh = out[c];
+			mesh.setVertices(gather(getVertices()));
+			mesh.setTriangles(std::move(ts));
 			mesh.setTransform(transform());
 
 			if (!getNormals().empty()) {
-				Normals ns(currentVertices.size());
-				for (size_t new_v_id = 0; new_v_id < currentVertices.size(); ++new_v_id) {
-					ns[new_v_id] = getNormals()[currentVertices[new_v_id]];
-				}
-				mesh.setNormals(ns);
+				mesh.setNormals(gather(getNormals()));
 			}
-
 			if (!getUVs().empty()) {
-				UVs uvs(currentVertices.size());
-				for (size_t new_v_id = 0; new_v_id < currentVertices.size(); ++new_v_id) {
-					uvs[new_v_id] = getUVs()[currentVertices[new_v_id]];
-				}
-				mesh.setUVs(uvs);
+				mesh.setUVs(gather(getUVs()));
 			}
-
 			if (!getColors().empty()) {
-				Colors cs(currentVertices.size());
-				for (size_t new_v_id = 0; new_v_id < currentVertices.size(); ++new_v_id) {
-					cs[new_v_id] = getColors()[currentVertices[new_v_id]];
-				}
-				mesh.setColors(cs);
+				mesh.setColors(gather(getColors()));
 			}
-
-			out.push_back(mesh);
-		}
+		});
 
 		return out;
 	}
@@ -600,7 +862,7 @@ namespace gloops {
 
 		Vertices vs(getVertices());
 		vs.insert(vs.end(), other.getVertices().begin(), other.getVertices().end());
-		out.setVertices(vs);
+		out.setVertices(std::move(vs));
 
 		Triangles ts(getTriangles());
 		ts.insert(ts.end(), other.getTriangles().begin(), other.getTriangles().end());
@@ -609,26 +871,26 @@ namespace gloops {
 		for (size_t v_id = 0; v_id < other.getTriangles().size(); ++v_id) {
 			ts[t_size + v_id] += offset;
 		}
-		out.setTriangles(ts);
+		out.setTriangles(std::move(ts));
 
 		out.setTransform(transform());
 
 		if (!getNormals().empty() && !other.getNormals().empty()) {
 			Normals ns(getNormals());
 			ns.insert(ns.end(), other.getNormals().begin(), other.getNormals().end());
-			out.setNormals(ns);
+			out.setNormals(std::move(ns));
 		}
 
 		if (!getUVs().empty() && !other.getUVs().empty()) {
 			UVs uvs(getUVs());
 			uvs.insert(uvs.end(), other.getUVs().begin(), other.getUVs().end());
-			out.setUVs(uvs);
+			out.setUVs(std::move(uvs));
 		}
 
 		if (!getColors().empty() && !other.getColors().empty()) {
 			Colors cs(getColors());
 			cs.insert(cs.end(), other.getColors().begin(), other.getColors().end());
-			out.setColors(cs);
+			out.setColors(std::move(cs));
 		}
 
 		return out;
@@ -671,9 +933,9 @@ namespace gloops {
 	//	}
 	//	//std::cout << num_vertices << " verts, " << num_triangles << " tris loaded" << std::endl;
 
-	//	auto& vs = *vertices;
-	//	auto& ts = *triangles;
-	//	auto& tcs = *uvs;
+	//	auto& vs = data->vertices;
+	//	auto& ts = data->triangles;
+	//	auto& tcs = data->uvs;
 
 	//	vs.resize(num_vertices);
 	//	ts.resize(num_triangles);
@@ -720,40 +982,170 @@ namespace gloops {
 	//	return true;
 	//}
 
-	void Mesh::computeVertexNormalsFromVertices()
-	{
-		struct Vdata {
-			v3f sum_normals = { 0,0,0 };
-			float sum_w = 0;
+	namespace {
+
+		// per triangle data, shared by its three corners
+		struct TriangleNormal {
+			v3f normal;		// unit for ANGLE, twice the area long for AREA
+			v3f angles;
 		};
 
-		const auto& vs = getVertices();
-		std::vector<Vdata> vData(vs.size());
+		TriangleNormal triangleNormal(const Mesh::Vertices& vs, const Mesh::Tri& tri, NormalWeighting weighting)
+		{
+			TriangleNormal out;
+			const v3f& a = vs[tri[0]], & b = vs[tri[1]], & c = vs[tri[2]];
+			out.normal = (b - a).cross(c - a);
+			if (weighting == NormalWeighting::ANGLE) {
+				// needles and collapsed triangles have arbitrary directions but large angles, they are skipped
+				const float norm = out.normal.norm();
+				const float longest = std::max({ (b - a).squaredNorm(), (c - b).squaredNorm(), (a - c).squaredNorm() });
+				if (!(norm > 1e-6f * longest)) {
+					out.normal = out.angles = v3f::Zero();
+					return out;
+				}
+				out.normal /= norm;
+				const v3f ab = (b - a).normalized(), bc = (c - b).normalized(), ca = (a - c).normalized();
+				out.angles = v3f(
+					std::acos(std::clamp(-ca.dot(ab), -1.0f, 1.0f)),
+					std::acos(std::clamp(-ab.dot(bc), -1.0f, 1.0f)),
+					std::acos(std::clamp(-bc.dot(ca), -1.0f, 1.0f))
+				);
+			}
+			return out;
+		}
 
-		for (const auto& tri : getTriangles()) {
-			const Vert& a = vs[tri[0]], b = vs[tri[1]], c = vs[tri[2]];
-			v3f tri_normal = (b - a).cross(c - a);
-			for (uint i : {tri[0], tri[1], tri[2]}) {
-				vData[i].sum_w += tri_normal.norm();
-				vData[i].sum_normals += tri_normal;
+		// sum over the adjacent triangles, given once per corner, vertex repeated in degenerate triangles are counted once
+		template<typename F>
+		v3f gatherNormal(uint v, const MeshAdjacency& adjacency, const Mesh::Triangles& triangles, NormalWeighting weighting, F&& triangleData)
+		{
+			v3f sum = v3f::Zero();
+			uint previous = MeshAdjacency::Invalid;
+			for (uint t : adjacency.vertexTriangles(v)) {
+				if (t == previous) {
+					continue;
+				}
+				previous = t;
+				const TriangleNormal& data = triangleData(t);
+				if (weighting == NormalWeighting::AREA) {
+					sum += data.normal;
+				} else {
+					const int k = triangles[t][0] == v ? 0 : (triangles[t][1] == v ? 1 : 2);
+					sum += data.angles[k] * data.normal;
+				}
 			}
+			return sum;
 		}
+	}
+
+	void Mesh::computeVertexNormalsFromVertices(const VertexNormalsParams& params)
+	{
+		const Vertices& vs = getVertices();
+		const Triangles& ts = getTriangles();
+		const std::shared_ptr<const MeshAdjacency> adjacency = this->adjacency();
+
+		const bool incremental = params.incremental && normalsSnapshot &&
+			normalsSnapshot->adjacency == adjacency && normalsSnapshot->weighting == params.weighting &&
+			readable(normalsSnapshot->vertices).size() == vs.size() && getNormals().size() == vs.size();
 
-		std::vector<v3f> newNormals(vs.size());
-		for (uint i = 0; i < vs.size(); ++i) {
-			newNormals[i] = (vData[i].sum_normals / vData[i].sum_w).normalized();
-			if (newNormals[i].array().isNaN().any()) {
-				std::cout << " normals contains NaN" << std::endl;
-				return;
+		const size_t numVertices = vs.size();
+
+		// vertices whose normal is recomputed, all of them unless only a few moved
+		std::vector<uint> updated;
+		bool all = !incremental;
+		if (incremental) {
+			std::vector<char> moved(numVertices, false);
+			forEachRange(numVertices, [&](size_t from, size_t to) {
+				for (size_t v = from; v < to; ++v) {
+					moved[v] = vs[v] != readable(normalsSnapshot->vertices)[v];
+				}
+			}, params.maxNumThreads);
+
+			// one ring of the moved vertices
+			std::vector<char> touched(numVertices, false);
+			for (uint v = 0; v < numVertices && !all; ++v) {
+				if (!moved[v]) {
+					continue;
+				}
+				for (uint t : adjacency->vertexTriangles(v)) {
+					for (uint w : { ts[t][0], ts[t][1], ts[t][2] }) {
+						if (!touched[w]) {
+							touched[w] = true;
+							updated.push_back(w);
+						}
+					}
+				}
+				all = 4 * updated.size() > numVertices;
 			}
 		}
 
-		setNormals(newNormals);
+		if (all) {
+			Normals newNormals = getNormals().size() == numVertices ? getNormals() : Normals(numVertices, v3f::Zero());
+
+			const size_t numTriangles = ts.size();
+			std::vector<TriangleNormal> triangleNormals(numTriangles);
+			forEachRange(numTriangles, [&](size_t from, size_t to) {
+				for (size_t t = from; t < to; ++t) {
+					triangleNormals[t] = triangleNormal(vs, ts[t], params.weighting);
+				}
+			}, params.maxNumThreads);
+
+			forEachRange(numVertices, [&](size_t from, size_t to) {
+				for (size_t v = from; v < to; ++v) {
+					const v3f sum = gatherNormal(static_cast<uint>(v), *adjacency, ts, params.weighting, [&](uint t) -> const TriangleNormal& {
+						return triangleNormals[t];
+					});
+					const float norm = sum.norm();
+					if (norm > 0) {
+						newNormals[v] = sum / norm;
+					}
+				}
+			}, params.maxNumThreads);
+			setNormals(std::move(newNormals));
+		} else {
+			// triangle normals recomputed on the fly, as only a few vertices are updated
+			editNormals([&](Span<v3f> normals) {
+				forEachRange(updated.size(), [&](size_t from, size_t to) {
+					for (size_t i = from; i < to; ++i) {
+						const uint v = updated[i];
+						TriangleNormal data;
+						const v3f sum = gatherNormal(v, *adjacency, ts, params.weighting, [&](uint t) -> const TriangleNormal& {
+							data = triangleNormal(vs, ts[t], params.weighting);
+							return data;
+						});
+						const float norm = sum.norm();
+						if (norm > 0) {
+							normals[v] = sum / norm;
+						}
+					}
+				}, params.maxNumThreads, 1024);
+			});
+		}
+
+		if (params.incremental) {
+			if (!normalsSnapshot) {
+				normalsSnapshot = std::make_shared<NormalsSnapshot>();
+			}
+			// shared, the next vertex edit copies them
+			normalsSnapshot->vertices = data->vertices;
+			normalsSnapshot->adjacency = adjacency;
+			normalsSnapshot->weighting = params.weighting;
+		} else {
+			normalsSnapshot.reset();
+		}
+	}
+
+	std::shared_ptr<const MeshAdjacency> Mesh::adjacency() const
+	{
+		std::lock_guard<std::mutex> lock(data->adjacency.mutex);
+		if (!data->adjacency.adjacency) {
+			data->adjacency.adjacency = std::make_shared<MeshAdjacency>(getTriangles(), getVertices().size());
+		}
+		return data->adjacency.adjacency;
 	}
 
 	const Mesh::Box& Mesh::getBoundingBox() const
 	{
-		if(dirtyBox || _transform->dirty()){
+		if(dirtyBox || data->transform.dirty()){
 			box.setEmpty();
 			for (const auto& v : getVertices()) {
 				box.extend(applyTransformationMatrix(model(), v));
@@ -763,9 +1155,14 @@ namespace gloops {
 		return box;
 	}
 
+	const MeshAttributes& Mesh::getCPUattributes() const
+	{
+		return data->attributes;
+	}
+
 	const Transform4& Mesh::transform() const
 	{
-		return *_transform;
+		return data->transform;
 	}
 
 	Mesh::operator bool() const
@@ -780,35 +1177,35 @@ namespace gloops {
 
 	Mesh& Mesh::setTranslation(const v3f& translation)
 	{
-		_transform->setTranslation(translation);
+		data->transform.setTranslation(translation);
 		invalidateModel();
 		return *this;
 	}
 
 	Mesh& Mesh::setRotation(const Qf& rotation)
 	{
-		_transform->setRotation(rotation);
+		data->transform.setRotation(rotation);
 		invalidateModel();
 		return *this;
 	}
 
 	Mesh& Mesh::setRotation(const Eigen::AngleAxisf& aa)
 	{
-		_transform->setRotation(aa);
+		data->transform.setRotation(aa);
 		invalidateModel();
 		return *this;
 	}
 
 	Mesh& Mesh::setRotation(const v3f& eulerAngles)
 	{
-		_transform->setEulerAngles(eulerAngles);
+		data->transform.setEulerAngles(eulerAngles);
 		invalidateModel();
 		return *this;
 	}
 
 	Mesh& Mesh::setScaling(const v3f& scaling)
 	{
-		_transform->setScaling(scaling);
+		data->transform.setScaling(scaling);
 		invalidateModel();
 		return *this;
 	}
@@ -820,7 +1217,7 @@ namespace gloops {
 
 	Mesh& Mesh::setTransform(const Transform4& t)
 	{
-		*_transform = t;
+		data->transform = t;
 		invalidateModel();
 		return *this;
 	}
@@ -874,10 +1271,10 @@ namespace gloops {
 		}
 
 		Mesh mesh;
-		mesh.setVertices(vertices);
-		mesh.setTriangles(triangles);
-		mesh.setNormals(normals);
-		mesh.setUVs(uvs);
+		mesh.setVertices(std::move(vertices));
+		mesh.setTriangles(std::move(triangles));
+		mesh.setNormals(std::move(normals));
+		mesh.setUVs(std::move(uvs));
 		return mesh;
 	}
 
@@ -920,10 +1317,10 @@ namespace gloops {
 		}
 
 		Mesh mesh;
-		mesh.setVertices(vertices);
-		mesh.setTriangles(triangles);
-		mesh.setNormals(normals);
-		mesh.setUVs(uvs);
+		mesh.setVertices(std::move(vertices));
+		mesh.setTriangles(std::move(triangles));
+		mesh.setNormals(std::move(normals));
+		mesh.setUVs(std::move(uvs));
 		return mesh;
 	}
 
@@ -959,9 +1356,9 @@ namespace gloops {
 		
 		Mesh out;
 		out.setTriangles(tris);
-		out.setVertices(vertices);
+		out.setVertices(std::move(vertices));
 		out.computeVertexNormalsFromVertices();
-		out.setUVs(uvs);
+		out.setUVs(std::move(uvs));
 
 		return out;
 	}
@@ -974,29 +1371,39 @@ namespace gloops {
 	void Mesh::removeModelCallback(const size_t id)
 	{
 		if (id) {
-			modelCallbacks->erase(id);
+			data->modelCallbacks.erase(id);
 		}
 	}
 
 	void Mesh::removeGeometryCallback(const size_t id)
 	{
 		if (id) {
-			geometryCallbacks->erase(id);
+			data->geometryCallbacks.erase(id);
 		}
 	}
 
 	void Mesh::invalidateModel()
 	{
 		dirtyBox = true;
-		for (const auto& callback : *modelCallbacks) {
+		for (const auto& callback : data->modelCallbacks) {
 			callback.second();
 		}
 	}
 
+	void Mesh::invalidateAdjacency()
+	{
+		std::lock_guard<std::mutex> lock(data->adjacency.mutex);
+		data->adjacency.adjacency.reset();
+	}
+
+	void Mesh::invalidateArrays()
+	{
+	}
+
 	void Mesh::invalidateGeometry()
 	{
 		dirtyBox = true;
-		for (const auto& callback : *geometryCallbacks) {
+		for (const auto& callback : data->geometryCallbacks) {
 			callback.second();
 		}
 	}
@@ -1,9 +1,13 @@
 #pragma once
 
 #include "config.hpp"
+#include "MeshAttributes.hpp"
+#include "ObjParser.hpp"
+#include "MeshReaders.hpp"
 #include <vector>
 #include <map>
-#include <any>
+#include <memory>
+#include <mutex>
 
 namespace gloops {
 
@@ -37,6 +41,53 @@ namespace gloops {
 		mutable bool dirtyModel = true;
 	};
 
+	// format from the file extension, .ply, .stl, OBJ otherwise
+	struct MeshLoadingParams {
+		ObjParsingParams obj;
+		PLYParams ply;
+		STLParams stl;
+		bool useCache = false;		// opt in, writes a binary sidecar next to the source file, see MeshCache
+	};
+
+	class MeshAdjacency;
+
+	// mutable view of a mesh array, see Mesh::editVertices
+	template<typename T>
+	struct Span {
+		T* first = nullptr;
+		T* last = nullptr;
+
+		T* begin() const {
+			return first;
+		}
+		T* end() const {
+			return last;
+		}
+		T* data() const {
+			return first;
+		}
+		size_t size() const {
+			return static_cast<size_t>(last - first);
+		}
+		bool empty() const {
+			return first == last;
+		}
+		T& operator[](size_t i) const {
+			return first[i];
+		}
+	};
+
+	// AREA weights the triangle normals by their area, ANGLE by their angle at the vertex
+	enum class NormalWeighting { AREA, ANGLE };
+
+	struct VertexNormalsParams {
+		NormalWeighting weighting = NormalWeighting::AREA;
+		bool incremental = false;		// only around the vertices moved since the previous incremental call, for deforming meshes
+		int maxNumThreads = 256;
+	};
+
+	// copies of a mesh share everything, setters and edits being seen by all of them
+	// clone() gives an independent mesh, sharing the arrays until either side modifies them
 	class Mesh {
 	public:
 		using Tri = v3u;
@@ -67,17 +118,56 @@ namespace gloops {
 		void setNormals(const Normals& tris);
 		void setColors(const Colors& tris);
 
+		// take the buffers without copying them
+		virtual void setTriangles(Triangles&& tris);
+		void setVertices(Vertices&& verts);
+		void setUVs(UVs&& texCoords);
+		void setNormals(Normals&& norms);
+		void setColors(Colors&& cols);
+
+		// f(Span<T>) modifies the array in place, its size is fixed,
+		// the array is copied first if it is shared with a clone, callbacks are called once f returns
+		template<typename F>
+		Mesh& editTriangles(F&& f);
+		template<typename F>
+		Mesh& editVertices(F&& f);
+		template<typename F>
+		Mesh& editNormals(F&& f);
+		template<typename F>
+		Mesh& editColors(F&& f);
+		template<typename F>
+		Mesh& editUVs(F&& f);
+
+		// same geometry, transform and attributes, but no callbacks and no sharing with this mesh
+		// arrays are copied on first modification only
+		Mesh clone() const;
+
 		Mesh& invertFaces();
 
-		static std::vector<Mesh> loadMeshes(const std::string& path);
+		// triangle i becomes triangle order[i], order may drop or repeat triangles
+		Mesh& reorderTriangles(const std::vector<uint>& order);
+
+		// vertex i becomes vertex order[i], order being a permutation of the vertices
+		// triangles are remapped, and so are the CPU attributes with one value per vertex
+		Mesh& reorderVertices(const std::vector<uint>& order);
+
+		// one mesh per OBJ shape, a single one for PLY and STL files
+		static std::vector<Mesh> loadMeshes(const std::string& path, const MeshLoadingParams& params = {});
 		
-		std::vector<Mesh> extractComponents() const;
+		// connected by triangles, loaders split vertices along uv and normal seams,
+		// connectByPosition also joins the vertices with identical positions
+		std::vector<Mesh> extractComponents(bool connectByPosition = false) const;
 
 		Mesh merge(const Mesh& other) const;
 
 		//virtual bool load(const std::string& path);
 
-		void computeVertexNormalsFromVertices();
+		// gathered in parallel from the adjacent triangles,
+		// vertices without adjacent triangles, or only degenerate ones, keep their current normal
+		void computeVertexNormalsFromVertices(const VertexNormalsParams& params = {});
+
+		// built on first use, see MeshAdjacency, shared by the copies of this mesh until its triangles or number of vertices change
+		std::shared_ptr<const MeshAdjacency> adjacency() const;
 
 		const Box& getBoundingBox() const;
 
@@ -100,12 +190,23 @@ namespace gloops {
 		static Mesh getCube(const Box& box = Box(v3f(-1, -1, -1), v3f(1, 1, 1)));
 		static Mesh getCube(const v3f& center, const v3f& halfDiag);
 
+		// replaces any attribute with the same name
 		template<typename T>
-		void setCPUattribute(const std::string& name, const std::vector<T>& data);
+		AttributeHandle<T> setCPUattribute(const std::string& name, const std::vector<T>& data);
 
+		// throws std::runtime_error if there is no such attribute with type T
 		template<typename T>
 		const std::vector<T>& getAttribute(const std::string& name) const;
 
+		// invalid if there is no such attribute with type T, handles avoid name lookups in inner loops
+		template<typename T>
+		AttributeHandle<T> findAttribute(const std::string& name) const;
+
+		template<typename T>
+		const std::vector<T>& attributeValues(const AttributeHandle<T>& handle) const;
+
+		const MeshAttributes& getCPUattributes() const;
+
 		//callback will be called whenever model is modified
 		template<typename F>
 		size_t addModelCallback( F&& f) const;
@@ -124,24 +225,49 @@ namespace gloops {
 
 		void invalidateModel();
 		void invalidateGeometry();
+		void invalidateAdjacency();
+
+		// after any modification of the arrays
+		virtual void invalidateArrays();
+
+		// the array itself if this mesh is its only owner, a copy of it otherwise
+		template<typename T>
+		static T& writable(std::shared_ptr<T>& array);
+
+		template<typename T>
+		static const T& readable(const std::shared_ptr<T>& array);
 	
 		using Callbacks = std::map<size_t, Callback>;
 
-		mutable std::shared_ptr<Callbacks> modelCallbacks, geometryCallbacks;
+		struct AdjacencyCache {
+			std::mutex mutex;
+			std::shared_ptr<const MeshAdjacency> adjacency;
+		};
 
-		//v3f _translation = { 0,0,0 }, _scaling = { 1,1,1 };
-		//Qf _rotation = Qf::Identity();
-		//mutable m4f _model;
+		// everything shared by the copies of a mesh, in a single allocation
+		// arrays are also shared with the clones, and null until set
+		struct Data {
+			std::shared_ptr<Triangles> triangles;
+			std::shared_ptr<Vertices> vertices;
+			std::shared_ptr<Normals> normals;
+			std::shared_ptr<Colors> colors;
+			std::shared_ptr<UVs> uvs;
+			MeshAttributes attributes;
+			Transform4 transform;
+			Callbacks modelCallbacks, geometryCallbacks;
+			AdjacencyCache adjacency;
+		};
 
-		std::shared_ptr<Transform4> _transform;
+		std::shared_ptr<Data> data;
 
-		std::shared_ptr<std::map<std::string, std::any>> custom_attributes;
+		// positions and triangles of the last incremental normals computation
+		struct NormalsSnapshot {
+			std::shared_ptr<const Vertices> vertices;
+			std::shared_ptr<const MeshAdjacency> adjacency;
+			NormalWeighting weighting = NormalWeighting::AREA;
+		};
 
-		std::shared_ptr<Triangles> triangles;
-		std::shared_ptr<Vertices> vertices;
-		std::shared_ptr<Normals> normals;
-		std::shared_ptr<Colors> colors;
-		std::shared_ptr<UVs> uvs;
+		std::shared_ptr<NormalsSnapshot> normalsSnapshot;
 	};
 
 
@@ -211,16 +337,22 @@ namespace gloops {
 		void setNormals(const Normals& normals, GLuint location = NormalDefaultLocation);
 		void setColors(const Colors& colors, GLuint location = ColorDefaultLocation);
 
+		virtual void setTriangles(Triangles&& tris) override;
+		void setVertices(Vertices&& verts, GLuint location = PositionDefaultLocation);
+		void setUVs(UVs&& uvs, GLuint location = UVDefaultLocation);
+		void setNormals(Normals&& normals, GLuint location = NormalDefaultLocation);
+		void setColors(Colors&& colors, GLuint location = ColorDefaultLocation);
+
 		template<typename T>
-		void setGLattribute(const std::string& name, const std::vector<T>& data, GLuint location);
+		void setGLattribute(const std::string& name, const std::vector<T>& values, GLuint location);
 
 		//void modifyAttributeLocation(GLuint currentLocation, GLuint newLocation);
 
-		static std::vector<MeshGL> loadMeshes(const std::string& path);
+		static std::vector<MeshGL> loadMeshes(const std::string& path, const MeshLoadingParams& params = {});
 
 		//virtual bool load(const std::string& path) override;
 
-		void computeVertexNormalsFromVertices(GLuint location = NormalDefaultLocation);
+		void computeVertexNormalsFromVertices(const VertexNormalsParams& params = {}, GLuint location = NormalDefaultLocation);
 
 		void draw() const;
 
@@ -238,13 +370,18 @@ namespace gloops {
 		static MeshGL fromPoints(const std::vector<v3f>& pts);
 		static MeshGL quad(const v3f& center, const v3f& semiDiagonalA, const v3f& semiDiagonalB, const v2f& uvs_tl = { 0,0 }, const v2f uvs_br = { 1,1 });
 
+	protected:
+		virtual void invalidateArrays() override;
+
 	private:
 		size_t size_of_vertex_data() const;
 
+		// arrays may have been reallocated by edits or copies on write
+		void updateArrayPointers() const;
 		void updateBuffers() const;
 		void updateLocations() const;
 
-		std::map<std::string, VertexAttribute> attributes_mapping;
+		mutable std::map<std::string, VertexAttribute> attributes_mapping;
 		//std::shared_ptr<std::map<GLuint, std::any>> custom_attributes;
 
 		GLptr vao, triangleBuffer, vertexBuffer;
@@ -253,15 +390,31 @@ namespace gloops {
 	};
 
 	template<typename T>
-	inline void Mesh::setCPUattribute(const std::string& name, const std::vector<T>& data)
+	inline AttributeHandle<T> Mesh::setCPUattribute(const std::string& name, const std::vector<T>& values)
 	{
-		(*custom_attributes)[name] = std::make_any<std::vector<T>>(data);
+		return data->attributes.set(name, values);
 	}
 
 	template<typename T>
 	inline const std::vector<T>& Mesh::getAttribute(const std::string& name) const
 	{
-		return std::any_cast<const std::vector<T>&>(custom_attributes->at(name));
+		const AttributeHandle<T> handle = findAttribute<T>(name);
+		if (!handle.valid()) {
+			throw std::runtime_error("no mesh attribute " + name + " of type " + typeid(T).name());
+		}
+		return attributeValues(handle);
+	}
+
+	template<typename T>
+	inline AttributeHandle<T> Mesh::findAttribute(const std::string& name) const
+	{
+		return data->attributes.find<T>(name);
+	}
+
+	template<typename T>
+	inline const std::vector<T>& Mesh::attributeValues(const AttributeHandle<T>& handle) const
+	{
+		return data->attributes.values(handle);
 	}
 
 	template<typename F>
@@ -269,7 +422,7 @@ namespace gloops {
 	{
 		static size_t id = 0;
 		++id;
-		modelCallbacks->emplace(id, std::forward<F>(f));
+		data->modelCallbacks.emplace(id, std::forward<F>(f));
 		return id;
 	}
 
@@ -278,19 +431,85 @@ namespace gloops {
 	{
 		static size_t id = 0;
 		++id;
-		geometryCallbacks->emplace(id, std::forward<F>(f));
+		data->geometryCallbacks.emplace(id, std::forward<F>(f));
 		return id;
 	}
 
+	template<typename F>
+	inline Mesh& Mesh::editTriangles(F&& f)
+	{
+		Triangles& triangles = writable(data->triangles);
+		f(Span<Tri>{ triangles.data(), triangles.data() + triangles.size() });
+		invalidateAdjacency();
+		invalidateGeometry();
+		invalidateArrays();
+		return *this;
+	}
+
+	template<typename F>
+	inline Mesh& Mesh::editVertices(F&& f)
+	{
+		Vertices& vertices = writable(data->vertices);
+		f(Span<Vert>{ vertices.data(), vertices.data() + vertices.size() });
+		invalidateGeometry();
+		invalidateArrays();
+		return *this;
+	}
+
+	template<typename F>
+	inline Mesh& Mesh::editNormals(F&& f)
+	{
+		Normals& normals = writable(data->normals);
+		f(Span<v3f>{ normals.data(), normals.data() + normals.size() });
+		invalidateArrays();
+		return *this;
+	}
+
+	template<typename F>
+	inline Mesh& Mesh::editColors(F&& f)
+	{
+		Colors& colors = writable(data->colors);
+		f(Span<v3f>{ colors.data(), colors.data() + colors.size() });
+		invalidateArrays();
+		return *this;
+	}
+
+	template<typename F>
+	inline Mesh& Mesh::editUVs(F&& f)
+	{
+		UVs& uvs = writable(data->uvs);
+		f(Span<v2f>{ uvs.data(), uvs.data() + uvs.size() });
+		invalidateArrays();
+		return *this;
+	}
+
+	template<typename T>
+	inline T& Mesh::writable(std::shared_ptr<T>& array)
+	{
+		if (!array) {
+			array = std::make_shared<T>();
+		} else if (array.use_count() > 1) {
+			array = std::make_shared<T>(*array);
+		}
+		return *array;
+	}
+
+	template<typename T>
+	inline const T& Mesh::readable(const std::shared_ptr<T>& array)
+	{
+		static const T empty;
+		return array ? *array : empty;
+	}
+
 	template<typename T>
-	inline void MeshGL::setGLattribute(const std::string& name, const std::vector<T>& data, GLuint location)
+	inline void MeshGL::setGLattribute(const std::string& name, const std::vector<T>& values, GLuint location)
 	{
-		Mesh::setCPUattribute(name, data);
+		const AttributeHandle<T> handle = Mesh::setCPUattribute(name, values);
 
-		attributes_mapping[name] = VertexAttribute(getAttribute<T>(name), location);
+		attributes_mapping[name] = VertexAttribute(attributeValues(handle), location);
 
 		if (numElements == 0) {
-			numElements = static_cast<GLsizei>(data.size());
+			numElements = static_cast<GLsizei>(values.size());
 		}
 
 		dirtyBuffers = true;
@@ -0,0 +1,183 @@
+#include "MeshAdjacency.hpp"
+#include "Debug.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace gloops {
+
+	namespace {
+
+		// items grouped by key, offsets[k] to offsets[k + 1] being the items of key k, ordered by less within each group
+		// counts and scatters are concurrent, the final sort makes the result deterministic
+		template<typename Key, typename Less>
+		void bucketSort(size_t numItems, size_t numKeys, Key&& key, Less&& less, std::vector<uint>& offsets, std::vector<uint>& items, int maxNumThreads)
+		{
+			std::vector<std::atomic<uint>> heads(numKeys);
+			for (std::atomic<uint>& head : heads) {
+				head.store(0, std::memory_order_relaxed);
+			}
+			forEachRange(numItems, [&](size_t from, size_t to) {
+				for (size_t i = from; i < to; ++i) {
+					heads[key(i)].fetch_add(1, std::memory_order_relaxed);
+				}
+			}, maxNumThreads);
+
+			offsets.resize(numKeys + 1);
+			offsets[0] = 0;
+			for (size_t k = 0; k < numKeys; ++k) {
+				offsets[k + 1] = offsets[k] + heads[k].load(std::memory_order_relaxed);
+				heads[k].store(offsets[k], std::memory_order_relaxed);
+			}
+
+			items.resize(numItems);
+			forEachRange(numItems, [&](size_t from, size_t to) {
+				for (size_t i = from; i < to; ++i) {
+					items[heads[key(i)].fetch_add(1, std::memory_order_relaxed)] = static_cast<uint>(i);
+				}
+			}, maxNumThreads);
+
+			forEachRange(numKeys, [&](size_t from, size_t to) {
+				for (size_t k = from; k < to; ++k) {
+					std::sort(items.begin() + offsets[k], items.begin() + offsets[k + 1], less);
+				}
+			}, maxNumThreads);
+		}
+	}
+
+	MeshAdjacency::MeshAdjacency(const Mesh::Triangles& triangles, size_t numVertices, int maxNumThreads)
+	{
+		const size_t numCorners = 3 * triangles.size();
+		auto vertex = [&](size_t corner) {
+			return triangles[corner / 3][corner % 3];
+		};
+		// directed edge faced by a corner
+		auto from = [&](size_t corner) {
+			return triangles[corner / 3][(corner + 1) % 3];
+		};
+		auto to = [&](size_t corner) {
+			return triangles[corner / 3][(corner + 2) % 3];
+		};
+		auto smallest = [&](size_t corner) {
+			return std::min(from(corner), to(corner));
+		};
+		auto largest = [&](size_t corner) {
+			return std::max(from(corner), to(corner));
+		};
+
+		// vertex to triangles, corners sorted by id are also sorted by triangle
+		bucketSort(numCorners, numVertices, vertex, std::less<uint>(), vertexOffsets, vertexTriangleIds, maxNumThreads);
+		forEachRange(numCorners, [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i) {
+				vertexTriangleIds[i] /= 3;
+			}
+		}, maxNumThreads);
+
+		// corners by smallest then largest vertex of their edge, runs of equal edges are the edges
+		std::vector<uint> smallestOffsets;
+		bucketSort(numCorners, numVertices, smallest, [&](uint a, uint b) {
+			const uint la = largest(a), lb = largest(b);
+			return la < lb || (la == lb && a < b);
+		}, smallestOffsets, edgeCornerIds, maxNumThreads);
+
+		std::vector<uint> numEdgesPerVertex(numVertices + 1, 0);
+		forEachRange(numVertices, [&](size_t first, size_t last) {
+			for (size_t v = first; v < last; ++v) {
+				for (uint i = smallestOffsets[v]; i < smallestOffsets[v + 1]; ++i) {
+					numEdgesPerVertex[v + 1] += (i == smallestOffsets[v] || largest(edgeCornerIds[i]) != largest(edgeCornerIds[i - 1]));
+				}
+			}
+		}, maxNumThreads);
+		for (size_t v = 0; v < numVertices; ++v) {
+			numEdgesPerVertex[v + 1] += numEdgesPerVertex[v];
+		}
+
+		const size_t numEdges = numEdgesPerVertex[numVertices];
+		_edges.resize(numEdges);
+		edgeOffsets.resize(numEdges + 1);
+		edgeOffsets[numEdges] = static_cast<uint>(numCorners);
+		cornerEdges.resize(numCorners);
+		opposites.assign(numCorners, Invalid);
+
+		std::atomic<bool> allManifold = true;
+		forEachRange(numVertices, [&](size_t first, size_t last) {
+			for (size_t v = first; v < last; ++v) {
+				uint edge = numEdgesPerVertex[v];
+				for (uint i = smallestOffsets[v]; i < smallestOffsets[v + 1]; ++edge) {
+					uint end = i + 1;
+					while (end < smallestOffsets[v + 1] && largest(edgeCornerIds[end]) == largest(edgeCornerIds[i])) {
+						++end;
+					}
+
+					_edges[edge] = v2u(static_cast<uint>(v), largest(edgeCornerIds[i]));
+					edgeOffsets[edge] = i;
+					for (uint j = i; j < end; ++j) {
+						cornerEdges[edgeCornerIds[j]] = edge;
+					}
+
+					const uint a = edgeCornerIds[i], b = edgeCornerIds[i + 1 < end ? i + 1 : i];
+					if (end - i == 2 && from(a) == to(b) && to(a) == from(b)) {
+						opposites[a] = b;
+						opposites[b] = a;
+					} else if (end - i > 1) {
+						allManifold = false;
+					}
+					i = end;
+				}
+			}
+		}, maxNumThreads);
+		manifold = allManifold;
+	}
+
+	size_t MeshAdjacency::numVertices() const
+	{
+		return vertexOffsets.empty() ? 0 : vertexOffsets.size() - 1;
+	}
+
+	size_t MeshAdjacency::numTriangles() const
+	{
+		return cornerEdges.size() / 3;
+	}
+
+	size_t MeshAdjacency::numEdges() const
+	{
+		return _edges.size();
+	}
+
+	IndexRange MeshAdjacency::vertexTriangles(uint vertex) const
+	{
+		return { vertexTriangleIds.data() + vertexOffsets[vertex], vertexTriangleIds.data() + vertexOffsets[vertex + 1] };
+	}
+
+	const std::vector<v2u>& MeshAdjacency::edges() const
+	{
+		return _edges;
+	}
+
+	IndexRange MeshAdjacency::edgeCorners(uint edge) const
+	{
+		return { edgeCornerIds.data() + edgeOffsets[edge], edgeCornerIds.data() + edgeOffsets[edge + 1] };
+	}
+
+	uint MeshAdjacency::cornerEdge(uint corner) const
+	{
+		return cornerEdges[corner];
+	}
+
+	bool MeshAdjacency::isBoundaryEdge(uint edge) const
+	{
+		return edgeOffsets[edge + 1] - edgeOffsets[edge] == 1;
+	}
+
+	uint MeshAdjacency::opposite(uint corner) const
+	{
+		return opposites[corner];
+	}
+
+	bool MeshAdjacency::isManifold() const
+	{
+		return manifold;
+	}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "config.hpp"
+#include "Mesh.hpp"
+
+#include <limits>
+#include <vector>
+
+namespace gloops {
+
+	// read only range of indices of a MeshAdjacency
+	struct IndexRange {
+		const uint* first = nullptr;
+		const uint* last = nullptr;
+
+		const uint* begin() const {
+			return first;
+		}
+		const uint* end() const {
+			return last;
+		}
+		size_t size() const {
+			return static_cast<size_t>(last - first);
+		}
+		bool empty() const {
+			return first == last;
+		}
+		uint operator[](size_t i) const {
+			return first[i];
+		}
+	};
+
+	// compressed adjacency of a triangle mesh, built in parallel with counting sorts
+	// corner c = 3 * t + k is vertex k of triangle t, it faces the edge from vertex k + 1 to vertex k + 2
+	class MeshAdjacency {
+
+	public:
+		static constexpr uint Invalid = std::numeric_limits<uint>::max();
+
+		MeshAdjacency() = default;
+		MeshAdjacency(const Mesh::Triangles& triangles, size_t numVertices, int maxNumThreads = 256);
+
+		size_t numVertices() const;
+		size_t numTriangles() const;
+		size_t numEdges() const;
+
+		// ascending ids of the triangles around a vertex
+		IndexRange vertexTriangles(uint vertex) const;
+
+		// undirected edges sorted by vertices, the first one being the smallest
+		const std::vector<v2u>& edges() const;
+
+		// ascending ids of the corners facing an edge, one on boundaries, more than two on non manifold edges
+		IndexRange edgeCorners(uint edge) const;
+		uint cornerEdge(uint corner) const;
+		bool isBoundaryEdge(uint edge) const;
+
+		// corner of the neighbor triangle facing the same edge, Invalid on boundary,
+		// non manifold or inconsistently oriented edges
+		uint opposite(uint corner) const;
+
+		// all edges shared by at most two consistently oriented triangles
+		bool isManifold() const;
+
+	protected:
+		std::vector<uint> vertexOffsets, vertexTriangleIds;
+		std::vector<uint> edgeOffsets, edgeCornerIds, cornerEdges, opposites;
+		std::vector<v2u> _edges;
+		bool manifold = true;
+	};
+
+}
@@ -0,0 +1,75 @@
+#include "MeshAttributes.hpp"
+
+namespace gloops {
+
+	MeshAttributes::MeshAttributes(const MeshAttributes& other)
+	{
+		*this = other;
+	}
+
+	MeshAttributes& MeshAttributes::operator=(const MeshAttributes& other)
+	{
+		if (this == &other) {
+			return *this;
+		}
+		entries.resize(other.entries.size());
+		for (size_t i = 0; i < entries.size(); ++i) {
+			entries[i].name = other.entries[i].name;
+			entries[i].typeKey = other.entries[i].typeKey;
+			entries[i].storage = other.entries[i].storage->clone();
+		}
+		return *this;
+	}
+
+	int MeshAttributes::size() const
+	{
+		return static_cast<int>(entries.size());
+	}
+
+	int MeshAttributes::id(const std::string& name) const
+	{
+		// a handful of attributes per mesh, a linear search beats a map
+		for (size_t i = 0; i < entries.size(); ++i) {
+			if (entries[i].name == name) {
+				return static_cast<int>(i);
+			}
+		}
+		return -1;
+	}
+
+	const std::string& MeshAttributes::name(int id) const
+	{
+		return entries.at(id).name;
+	}
+
+	const std::type_info& MeshAttributes::type(int id) const
+	{
+		return entries.at(id).storage->type();
+	}
+
+	size_t MeshAttributes::count(int id) const
+	{
+		return entries.at(id).storage->count();
+	}
+
+	size_t MeshAttributes::elementSize(int id) const
+	{
+		return entries.at(id).storage->elementSize();
+	}
+
+	const void* MeshAttributes::data(int id) const
+	{
+		return entries.at(id).storage->data();
+	}
+
+	void MeshAttributes::reorder(int id, const std::vector<uint>& order)
+	{
+		entries.at(id).storage->reorder(order);
+	}
+
+	void MeshAttributes::clear()
+	{
+		entries.clear();
+	}
+
+}
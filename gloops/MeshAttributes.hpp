@@ -0,0 +1,173 @@
+#pragma once
+
+#include "config.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace gloops {
+
+	// typed index of an attribute in a MeshAttributes, from MeshAttributes::set or MeshAttributes::find
+	template<typename T>
+	struct AttributeHandle {
+		int id = -1;
+
+		bool valid() const {
+			return id >= 0;
+		}
+	};
+
+	// named arrays of any element type, each one contiguous in a std::vector<T>
+	// ids are stable, setting an existing name keeps its id even with another type
+	// handles give typed access without name lookup, their type being checked with a single pointer comparison
+	class MeshAttributes {
+
+	public:
+		MeshAttributes() = default;
+		MeshAttributes(const MeshAttributes& other);
+		MeshAttributes& operator=(const MeshAttributes& other);
+		MeshAttributes(MeshAttributes&& other) = default;
+		MeshAttributes& operator=(MeshAttributes&& other) = default;
+
+		template<typename T>
+		AttributeHandle<T> set(const std::string& name, std::vector<T> values);
+
+		// invalid if there is no such attribute with type T
+		template<typename T>
+		AttributeHandle<T> find(const std::string& name) const;
+
+		// throws std::runtime_error if the handle is not an attribute of type T
+		template<typename T>
+		const std::vector<T>& values(const AttributeHandle<T>& handle) const;
+		template<typename T>
+		std::vector<T>& values(const AttributeHandle<T>& handle);
+
+		// untyped access, ids go from 0 to size() excluded, -1 for missing names
+		int size() const;
+		int id(const std::string& name) const;
+		const std::string& name(int id) const;
+		const std::type_info& type(int id) const;
+		size_t count(int id) const;
+		size_t elementSize(int id) const;
+		const void* data(int id) const;
+
+		template<typename T>
+		bool is(int id) const;
+
+		// values[i] becomes values[order[i]]
+		void reorder(int id, const std::vector<uint>& order);
+
+		void clear();
+
+	protected:
+		struct Storage {
+			virtual ~Storage() = default;
+			virtual std::unique_ptr<Storage> clone() const = 0;
+			virtual const std::type_info& type() const = 0;
+			virtual size_t count() const = 0;
+			virtual size_t elementSize() const = 0;
+			virtual const void* data() const = 0;
+			virtual void reorder(const std::vector<uint>& order) = 0;
+		};
+
+		template<typename T>
+		struct TypedStorage : Storage {
+			TypedStorage(std::vector<T>&& values) : values(std::move(values)) {}
+
+			std::unique_ptr<Storage> clone() const override {
+				return std::make_unique<TypedStorage<T>>(std::vector<T>(values));
+			}
+			const std::type_info& type() const override {
+				return typeid(T);
+			}
+			size_t count() const override {
+				return values.size();
+			}
+			size_t elementSize() const override {
+				return sizeof(T);
+			}
+			const void* data() const override {
+				return values.data();
+			}
+			// copied back, so that pointers to the values stay valid for permutations
+			void reorder(const std::vector<uint>& order) override {
+				std::vector<T> reordered(order.size());
+				for (size_t i = 0; i < order.size(); ++i) {
+					reordered[i] = values[order[i]];
+				}
+				values.resize(order.size());
+				std::copy(reordered.begin(), reordered.end(), values.begin());
+			}
+
+			// its address identifies T
+			static constexpr char key = 0;
+
+			std::vector<T> values;
+		};
+
+		struct Entry {
+			std::string name;
+			const void* typeKey = nullptr;
+			std::unique_ptr<Storage> storage;
+		};
+
+		template<typename T>
+		TypedStorage<T>& typed(int id) const;
+
+		std::vector<Entry> entries;
+	};
+
+	template<typename T>
+	inline AttributeHandle<T> MeshAttributes::set(const std::string& name, std::vector<T> values)
+	{
+		int attribute = id(name);
+		if (attribute < 0) {
+			attribute = static_cast<int>(entries.size());
+			entries.emplace_back();
+			entries.back().name = name;
+		}
+		Entry& entry = entries[attribute];
+		entry.typeKey = &TypedStorage<T>::key;
+		entry.storage = std::make_unique<TypedStorage<T>>(std::move(values));
+		return AttributeHandle<T>{ attribute };
+	}
+
+	template<typename T>
+	inline AttributeHandle<T> MeshAttributes::find(const std::string& name) const
+	{
+		const int attribute = id(name);
+		return AttributeHandle<T>{ is<T>(attribute) ? attribute : -1 };
+	}
+
+	template<typename T>
+	inline const std::vector<T>& MeshAttributes::values(const AttributeHandle<T>& handle) const
+	{
+		return typed<T>(handle.id).values;
+	}
+
+	template<typename T>
+	inline std::vector<T>& MeshAttributes::values(const AttributeHandle<T>& handle)
+	{
+		return typed<T>(handle.id).values;
+	}
+
+	template<typename T>
+	inline bool MeshAttributes::is(int id) const
+	{
+		return id >= 0 && id < size() && entries[id].typeKey == &TypedStorage<T>::key;
+	}
+
+	template<typename T>
+	inline MeshAttributes::TypedStorage<T>& MeshAttributes::typed(int id) const
+	{
+		if (!is<T>(id)) {
+			throw std::runtime_error("mesh attribute " + std::to_string(id) + " is missing or has another type than " + typeid(T).name());
+		}
+		return static_cast<TypedStorage<T>&>(*entries[id].storage);
+	}
+
+}
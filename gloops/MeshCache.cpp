@@ -0,0 +1,338 @@
+#include "MeshCache.hpp"
+#include "Debug.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace gloops {
+
+	namespace {
+
+		constexpr char Magic[4] = { 'G', 'L', 'M', 'C' };
+		constexpr uint64_t Alignment = 64;
+		constexpr uint64_t ScalarSize = 4;		// float, int and uint
+
+		struct Header {
+			char magic[4];
+			uint32_t version;
+			uint32_t numMeshes;
+			uint32_t numSections;
+			uint64_t sourceSize;
+			int64_t sourceTime;
+			uint64_t pathOffset, pathSize;
+		};
+
+		uint64_t align(uint64_t offset) {
+			return (offset + Alignment - 1) / Alignment * Alignment;
+		}
+	}
+
+	MeshCacheKey MeshCacheKey::fromFile(const std::string& path)
+	{
+		MeshCacheKey key;
+		std::error_code error;
+		const uint64_t size = std::filesystem::file_size(path, error);
+		if (error) {
+			return key;
+		}
+		const auto time = std::filesystem::last_write_time(path, error);
+		if (error) {
+			return key;
+		}
+		key.sourcePath = std::filesystem::absolute(path, error).lexically_normal().string();
+		key.sourceSize = size;
+		key.sourceTime = static_cast<int64_t>(time.time_since_epoch().count());
+		return key;
+	}
+
+	bool MeshCacheKey::operator==(const MeshCacheKey& other) const
+	{
+		return sourcePath == other.sourcePath && sourceSize == other.sourceSize && sourceTime == other.sourceTime;
+	}
+
+	bool MeshCache::write(const std::string& path, const std::vector<Mesh>& meshes, const MeshCacheKey& key)
+	{
+		struct Pending {
+			Section section;
+			const void* data;
+		};
+		std::vector<Pending> pendings;
+		std::vector<Mesh::Box> boxes(meshes.size());
+
+		auto add = [&](uint32_t mesh, SectionKind kind, ScalarType type, uint32_t channels, size_t count, const void* data, const std::string& name = {}) {
+			Pending pending;
+			std::memset(&pending.section, 0, sizeof(Section));
+			pending.section.mesh = mesh;
+			pending.section.kind = kind;
+			pending.section.type = type;
+			pending.section.channels = channels;
+			pending.section.count = count;
+			std::strncpy(pending.section.name, name.c_str(), sizeof(pending.section.name) - 1);
+			pending.data = data;
+			pendings.push_back(pending);
+		};
+
+		auto addAttribute = [&](uint32_t mesh, const MeshAttributes& attributes, int id, auto typeTag) {
+			using T = decltype(typeTag);
+			if (!attributes.is<T>(id)) {
+				return false;
+			}
+			const std::vector<T>& values = attributes.values(AttributeHandle<T>{ id });
+			add(mesh, SectionKind::ATTRIBUTE, TypeInfos<T>::type, TypeInfos<T>::channels, values.size(), values.data(), attributes.name(id));
+			return true;
+		};
+
+		for (uint32_t m = 0; m < meshes.size(); ++m) {
+			const Mesh& mesh = meshes[m];
+			add(m, SectionKind::TRIANGLES, ScalarType::UINT, 3, mesh.getTriangles().size(), mesh.getTriangles().data());
+			add(m, SectionKind::VERTICES, ScalarType::FLOAT, 3, mesh.getVertices().size(), mesh.getVertices().data());
+			add(m, SectionKind::NORMALS, ScalarType::FLOAT, 3, mesh.getNormals().size(), mesh.getNormals().data());
+			add(m, SectionKind::COLORS, ScalarType::FLOAT, 3, mesh.getColors().size(), mesh.getColors().data());
+			add(m, SectionKind::UVS, ScalarType::FLOAT, 2, mesh.getUVs().size(), mesh.getUVs().data());
+
+			boxes[m].setEmpty();
+			for (const v3f& v : mesh.getVertices()) {
+				boxes[m].extend(v);
+			}
+			add(m, SectionKind::BOX, ScalarType::FLOAT, 3, 2, boxes[m].min().data());
+
+			const MeshAttributes& attributes = mesh.getCPUattributes();
+			for (int id = 0; id < attributes.size(); ++id) {
+				const bool stored = 
+					addAttribute(m, attributes, id, float()) || addAttribute(m, attributes, id, int()) ||
+					addAttribute(m, attributes, id, uint()) || addAttribute(m, attributes, id, v2f()) ||
+					addAttribute(m, attributes, id, v3f()) || addAttribute(m, attributes, id, v4f()) ||
+					addAttribute(m, attributes, id, v3u());
+				if (!stored) {
+					addToLogs(LogType::WARNING, "mesh cache : attribute " + attributes.name(id) + " has an unsupported type, skipped");
+				}
+			}
+		}
+
+		Header header;
+		std::memcpy(header.magic, Magic, sizeof(Magic));
+		header.version = Version;
+		header.numMeshes = static_cast<uint32_t>(meshes.size());
+		header.numSections = static_cast<uint32_t>(pendings.size());
+		header.sourceSize = key.sourceSize;
+		header.sourceTime = key.sourceTime;
+		header.pathOffset = sizeof(Header) + pendings.size() * sizeof(Section);
+		header.pathSize = key.sourcePath.size();
+
+		uint64_t offset = align(header.pathOffset + header.pathSize);
+		for (Pending& pending : pendings) {
+			pending.section.offset = offset;
+			offset = align(offset + pending.section.count * pending.section.channels * ScalarSize);
+		}
+
+		// written aside then renamed, so that readers never see partial files
+		const std::string tmpPath = path + ".tmp";
+		{
+			std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+			if (!out) {
+				return false;
+			}
+
+			out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+			for (const Pending& pending : pendings) {
+				out.write(reinterpret_cast<const char*>(&pending.section), sizeof(Section));
+			}
+			out.write(key.sourcePath.data(), key.sourcePath.size());
+
+			const char zeros[Alignment] = {};
+			uint64_t position = header.pathOffset + header.pathSize;
+			for (const Pending& pending : pendings) {
+				out.write(zeros, pending.section.offset - position);
+				const uint64_t numBytes = pending.section.count * pending.section.channels * ScalarSize;
+				out.write(static_cast<const char*>(pending.data), numBytes);
+				position = pending.section.offset + numBytes;
+			}
+			out.write(zeros, offset - position);
+
+			if (!out) {
+				return false;
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(tmpPath, path, error);
+		if (error) {
+			std::filesystem::remove(tmpPath, error);
+			return false;
+		}
+		return true;
+	}
+
+	bool MeshCache::open(const std::string& path)
+	{
+		sections = nullptr;
+		_numMeshes = numSections = 0;
+		_key = MeshCacheKey();
+
+		if (!file.open(path) || file.size() < sizeof(Header)) {
+			file.close();
+			return false;
+		}
+
+		Header header;
+		std::memcpy(&header, file.data(), sizeof(Header));
+		const uint64_t size = file.size();
+		bool valid = std::memcmp(header.magic, Magic, sizeof(Magic)) == 0 && header.version == Version &&
+			sizeof(Header) + uint64_t(header.numSections) * sizeof(Section) <= size &&
+			header.pathOffset + header.pathSize <= size;
+
+		const Section* table = reinterpret_cast<const Section*>(file.data() + sizeof(Header));
+		for (uint32_t s = 0; valid && s < header.numSections; ++s) {
+			const Section& section = table[s];
+			valid = section.mesh < header.numMeshes && section.offset % Alignment == 0 &&
+				section.offset + section.count * section.channels * ScalarSize <= size;
+		}
+		if (!valid) {
+			file.close();
+			return false;
+		}
+
+		sections = table;
+		_numMeshes = header.numMeshes;
+		numSections = header.numSections;
+		_key.sourcePath = std::string(file.data() + header.pathOffset, header.pathSize);
+		_key.sourceSize = header.sourceSize;
+		_key.sourceTime = header.sourceTime;
+		return true;
+	}
+
+	const MeshCacheKey& MeshCache::key() const
+	{
+		return _key;
+	}
+
+	int MeshCache::numMeshes() const
+	{
+		return static_cast<int>(_numMeshes);
+	}
+
+	MeshCacheView<Mesh::Tri> MeshCache::triangles(int mesh) const
+	{
+		return view<Mesh::Tri>(mesh, SectionKind::TRIANGLES);
+	}
+
+	MeshCacheView<Mesh::Vert> MeshCache::vertices(int mesh) const
+	{
+		return view<Mesh::Vert>(mesh, SectionKind::VERTICES);
+	}
+
+	MeshCacheView<v3f> MeshCache::normals(int mesh) const
+	{
+		return view<v3f>(mesh, SectionKind::NORMALS);
+	}
+
+	MeshCacheView<v3f> MeshCache::colors(int mesh) const
+	{
+		return view<v3f>(mesh, SectionKind::COLORS);
+	}
+
+	MeshCacheView<v2f> MeshCache::uvs(int mesh) const
+	{
+		return view<v2f>(mesh, SectionKind::UVS);
+	}
+
+	Mesh::Box MeshCache::boundingBox(int mesh) const
+	{
+		const MeshCacheView<v3f> corners = view<v3f>(mesh, SectionKind::BOX);
+		return corners.size() == 2 ? Mesh::Box(corners[0], corners[1]) : Mesh::Box();
+	}
+
+	std::vector<std::string> MeshCache::attributeNames(int mesh) const
+	{
+		std::vector<std::string> out;
+		for (uint32_t s = 0; s < numSections; ++s) {
+			if (sections[s].mesh == uint32_t(mesh) && sections[s].kind == SectionKind::ATTRIBUTE) {
+				out.emplace_back(sections[s].name, strnlen(sections[s].name, sizeof(sections[s].name)));
+			}
+		}
+		return out;
+	}
+
+	Mesh MeshCache::toMesh(int mesh) const
+	{
+		auto copy = [](const auto& view) {
+			using T = std::decay_t<decltype(*view.data)>;
+			return std::vector<T>(view.begin(), view.end());
+		};
+
+		Mesh out;
+		out.setTriangles(copy(triangles(mesh)));
+		out.setVertices(copy(vertices(mesh)));
+		if (!normals(mesh).empty()) {
+			out.setNormals(copy(normals(mesh)));
+		}
+		if (!colors(mesh).empty()) {
+			out.setColors(copy(colors(mesh)));
+		}
+		if (!uvs(mesh).empty()) {
+			out.setUVs(copy(uvs(mesh)));
+		}
+
+		for (const std::string& name : attributeNames(mesh)) {
+			const Section& section = *findSection(mesh, SectionKind::ATTRIBUTE, name);
+			const uint32_t c = section.channels;
+			switch (section.type)
+			{
+			case ScalarType::FLOAT:
+				if (c == 1) out.setCPUattribute(name, copy(attribute<float>(mesh, name)));
+				if (c == 2) out.setCPUattribute(name, copy(attribute<v2f>(mesh, name)));
+				if (c == 3) out.setCPUattribute(name, copy(attribute<v3f>(mesh, name)));
+				if (c == 4) out.setCPUattribute(name, copy(attribute<v4f>(mesh, name)));
+				break;
+			case ScalarType::INT:
+				out.setCPUattribute(name, copy(attribute<int>(mesh, name)));
+				break;
+			case ScalarType::UINT:
+				if (c == 1) out.setCPUattribute(name, copy(attribute<uint>(mesh, name)));
+				if (c == 3) out.setCPUattribute(name, copy(attribute<v3u>(mesh, name)));
+				break;
+			default:
+				break;
+			}
+		}
+		return out;
+	}
+
+	std::vector<Mesh> MeshCache::toMeshes() const
+	{
+		std::vector<Mesh> out;
+		for (int m = 0; m < numMeshes(); ++m) {
+			out.push_back(toMesh(m));
+		}
+		return out;
+	}
+
+	const MeshCache::Section* MeshCache::findSection(int mesh, SectionKind kind, const std::string& name) const
+	{
+		for (uint32_t s = 0; s < numSections; ++s) {
+			const Section& section = sections[s];
+			if (section.mesh == uint32_t(mesh) && section.kind == kind && name.compare(0, std::string::npos, section.name, strnlen(section.name, sizeof(section.name))) == 0) {
+				return &section;
+			}
+		}
+		return nullptr;
+	}
+
+	const void* MeshCache::sectionData(int mesh, SectionKind kind, ScalarType type, uint32_t channels, size_t& count, const std::string& name) const
+	{
+		const Section* section = findSection(mesh, kind, name);
+		if (!section || section->type != type || section->channels != channels) {
+			count = 0;
+			return nullptr;
+		}
+		count = static_cast<size_t>(section->count);
+		return file.data() + section->offset;
+	}
+
+	std::string meshCachePath(const std::string& sourcePath)
+	{
+		return sourcePath + ".glmc";
+	}
+
+}
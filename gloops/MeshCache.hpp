@@ -0,0 +1,134 @@
+#pragma once
+
+#include "config.hpp"
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gloops {
+
+	// identifies the source a cache was built from
+	struct MeshCacheKey {
+		std::string sourcePath;
+		uint64_t sourceSize = 0;
+		int64_t sourceTime = 0;		// last write time, in file clock ticks
+
+		// size and last write time of an existing file, empty key otherwise
+		static MeshCacheKey fromFile(const std::string& path);
+
+		bool operator==(const MeshCacheKey& other) const;
+	};
+
+	// read only view of an array of a mapped cache
+	template<typename T>
+	struct MeshCacheView {
+		const T* data = nullptr;
+		size_t count = 0;
+
+		const T* begin() const {
+			return data;
+		}
+		const T* end() const {
+			return data + count;
+		}
+		size_t size() const {
+			return count;
+		}
+		bool empty() const {
+			return count == 0;
+		}
+		const T& operator[](size_t i) const {
+			return data[i];
+		}
+	};
+
+	// binary container for a set of meshes: a header, a table of sections, then each array at a 64 bytes aligned offset
+	// arrays are used in place from the memory mapping, toMesh copies them into a Mesh
+	// custom attributes of types float, int, uint, v2f, v3f, v4f and v3u are stored, the other ones are skipped
+	class MeshCache {
+
+	public:
+		static constexpr uint32_t Version = 1;
+
+		static bool write(const std::string& path, const std::vector<Mesh>& meshes, const MeshCacheKey& key = {});
+
+		// false if the file is missing, truncated or from another version
+		bool open(const std::string& path);
+
+		const MeshCacheKey& key() const;
+		int numMeshes() const;
+
+		MeshCacheView<Mesh::Tri> triangles(int mesh) const;
+		MeshCacheView<Mesh::Vert> vertices(int mesh) const;
+		MeshCacheView<v3f> normals(int mesh) const;
+		MeshCacheView<v3f> colors(int mesh) const;
+		MeshCacheView<v2f> uvs(int mesh) const;
+
+		// of the vertices, without the model transformation
+		Mesh::Box boundingBox(int mesh) const;
+
+		std::vector<std::string> attributeNames(int mesh) const;
+
+		// empty view if there is no such attribute with type T
+		template<typename T>
+		MeshCacheView<T> attribute(int mesh, const std::string& name) const;
+
+		Mesh toMesh(int mesh) const;
+		std::vector<Mesh> toMeshes() const;
+
+	protected:
+		enum class SectionKind : uint32_t { TRIANGLES, VERTICES, NORMALS, COLORS, UVS, BOX, ATTRIBUTE };
+		enum class ScalarType : uint32_t { FLOAT, INT, UINT };
+
+		struct Section {
+			uint32_t mesh;
+			SectionKind kind;
+			ScalarType type;
+			uint32_t channels;
+			uint64_t count;
+			uint64_t offset;
+			char name[64];
+		};
+
+		const Section* findSection(int mesh, SectionKind kind, const std::string& name = {}) const;
+		const void* sectionData(int mesh, SectionKind kind, ScalarType type, uint32_t channels, size_t& count, const std::string& name = {}) const;
+
+		template<typename T>
+		MeshCacheView<T> view(int mesh, SectionKind kind, const std::string& name = {}) const;
+
+		template<typename T>
+		struct TypeInfos;
+
+		MappedFile file;
+		MeshCacheKey _key;
+		const Section* sections = nullptr;
+		uint32_t _numMeshes = 0, numSections = 0;
+	};
+
+	// path + ".glmc", where Mesh::loadMeshes looks for a cache
+	std::string meshCachePath(const std::string& sourcePath);
+
+	template<> struct MeshCache::TypeInfos<float> { static constexpr ScalarType type = ScalarType::FLOAT; static constexpr uint32_t channels = 1; };
+	template<> struct MeshCache::TypeInfos<int> { static constexpr ScalarType type = ScalarType::INT; static constexpr uint32_t channels = 1; };
+	template<> struct MeshCache::TypeInfos<uint> { static constexpr ScalarType type = ScalarType::UINT; static constexpr uint32_t channels = 1; };
+	template<typename T, int N>
+	struct MeshCache::TypeInfos<Eigen::Matrix<T, N, 1>> { static constexpr ScalarType type = TypeInfos<T>::type; static constexpr uint32_t channels = N; };
+
+	template<typename T>
+	inline MeshCacheView<T> MeshCache::view(int mesh, SectionKind kind, const std::string& name) const
+	{
+		MeshCacheView<T> out;
+		out.data = static_cast<const T*>(sectionData(mesh, kind, TypeInfos<T>::type, TypeInfos<T>::channels, out.count, name));
+		return out;
+	}
+
+	template<typename T>
+	inline MeshCacheView<T> MeshCache::attribute(int mesh, const std::string& name) const
+	{
+		return view<T>(mesh, SectionKind::ATTRIBUTE, name);
+	}
+
+}
@@ -0,0 +1,326 @@
+#include "MeshOptimization.hpp"
+#include "MeshAdjacency.hpp"
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace gloops {
+
+	namespace {
+
+		// a vertex is cached while less than size other vertices were transformed after it
+		class FifoCache {
+		public:
+			FifoCache(size_t numVertices, int size) :
+				timestamps(numVertices, 0), size(static_cast<uint>(std::max(size, 1))), time(this->size + 1)
+			{
+			}
+
+			// true on a miss, the vertex being transformed
+			bool access(uint v) {
+				if (time - timestamps[v] > size) {
+					timestamps[v] = time++;
+					return true;
+				}
+				return false;
+			}
+
+			void flush() {
+				time += size + 1;
+			}
+
+			// number of vertices transformed since v was, larger than size if v is not cached
+			uint age(uint v) const {
+				return time - timestamps[v];
+			}
+
+			uint capacity() const {
+				return size;
+			}
+
+		protected:
+			std::vector<uint> timestamps;
+			uint size, time;
+		};
+
+		// fans around the vertex whose triangles stay in cache, jumping to recent dead ends, then to the next vertex in order
+		// clusters get the first triangle after each jump
+		std::vector<uint> tipsify(const Mesh::Triangles& triangles, const MeshAdjacency& adjacency, int cacheSize, std::vector<uint>& clusters)
+		{
+			const uint numVertices = static_cast<uint>(adjacency.numVertices());
+			std::vector<uint> liveCounts(numVertices);
+			for (uint v = 0; v < numVertices; ++v) {
+				liveCounts[v] = static_cast<uint>(adjacency.vertexTriangles(v).size());
+			}
+
+			FifoCache cache(numVertices, cacheSize);
+			std::vector<char> emitted(triangles.size(), false);
+			std::vector<uint> order, deadEnds, candidates;
+			order.reserve(triangles.size());
+			clusters.clear();
+
+			uint cursor = 0;
+			auto nextInOrder = [&]() {
+				while (cursor < numVertices && liveCounts[cursor] == 0) {
+					++cursor;
+				}
+				return cursor < numVertices ? cursor : MeshAdjacency::Invalid;
+			};
+
+			uint fan = nextInOrder();
+			bool jumped = true;
+			while (fan != MeshAdjacency::Invalid) {
+				if (jumped) {
+					clusters.push_back(static_cast<uint>(order.size()));
+				}
+
+				candidates.clear();
+				for (uint t : adjacency.vertexTriangles(fan)) {
+					if (emitted[t]) {
+						continue;
+					}
+					emitted[t] = true;
+					order.push_back(t);
+					for (int k = 0; k < 3; ++k) {
+						const uint v = triangles[t][k];
+						deadEnds.push_back(v);
+						candidates.push_back(v);
+						--liveCounts[v];
+						cache.access(v);
+					}
+				}
+
+				// the oldest candidate still cached once fanned around, any one with live triangles otherwise
+				fan = MeshAdjacency::Invalid;
+				int bestPriority = -1;
+				for (uint v : candidates) {
+					if (liveCounts[v] == 0) {
+						continue;
+					}
+					const uint age = cache.age(v);
+					const int priority = age + 2 * liveCounts[v] <= cache.capacity() ? static_cast<int>(age) : 0;
+					if (priority > bestPriority) {
+						bestPriority = priority;
+						fan = v;
+					}
+				}
+
+				jumped = fan == MeshAdjacency::Invalid;
+				while (fan == MeshAdjacency::Invalid && !deadEnds.empty()) {
+					if (liveCounts[deadEnds.back()] > 0) {
+						fan = deadEnds.back();
+					}
+					deadEnds.pop_back();
+				}
+				if (fan == MeshAdjacency::Invalid) {
+					fan = nextInOrder();
+				}
+			}
+			return order;
+		}
+
+		// splits the clusters as soon as their running ACMR gets below threshold times their own ACMR,
+		// the cache being flushed at each split so that the new clusters can be drawn in any order
+		std::vector<uint> splitClusters(const Mesh::Triangles& triangles, const std::vector<uint>& order, const std::vector<uint>& clusters, size_t numVertices, int cacheSize, float threshold)
+		{
+			FifoCache cache(numVertices, cacheSize);
+			auto misses = [&](uint t) {
+				return int(cache.access(triangles[t][0])) + int(cache.access(triangles[t][1])) + int(cache.access(triangles[t][2]));
+			};
+
+			std::vector<uint> splits;
+			for (size_t c = 0; c < clusters.size(); ++c) {
+				const uint first = clusters[c];
+				const uint last = c + 1 < clusters.size() ? clusters[c + 1] : static_cast<uint>(order.size());
+
+				cache.flush();
+				size_t clusterMisses = 0;
+				for (uint i = first; i < last; ++i) {
+					clusterMisses += misses(order[i]);
+				}
+				const float clusterThreshold = threshold * clusterMisses / float(last - first);
+
+				cache.flush();
+				splits.push_back(first);
+				size_t runningMisses = 0, runningTriangles = 0;
+				for (uint i = first; i < last; ++i) {
+					runningMisses += misses(order[i]);
+					++runningTriangles;
+					if (i + 1 < last && runningMisses <= clusterThreshold * runningTriangles) {
+						splits.push_back(i + 1);
+						cache.flush();
+						runningMisses = runningTriangles = 0;
+					}
+				}
+			}
+			return splits;
+		}
+
+		// clusters facing away from the mesh centroid first, as they are likely to occlude the others
+		std::vector<uint> sortClusters(const Mesh& mesh, const std::vector<uint>& order, const std::vector<uint>& clusters)
+		{
+			const Mesh::Vertices& vertices = mesh.getVertices();
+			const Mesh::Triangles& triangles = mesh.getTriangles();
+
+			v3f meshCentroid = v3f::Zero();
+			for (const v3f& v : vertices) {
+				meshCentroid += v;
+			}
+			meshCentroid /= static_cast<float>(std::max<size_t>(vertices.size(), 1));
+
+			struct Cluster {
+				uint first, last;
+				float key;
+			};
+			std::vector<Cluster> sorted(clusters.size());
+			for (size_t c = 0; c < clusters.size(); ++c) {
+				Cluster& cluster = sorted[c];
+				cluster.first = clusters[c];
+				cluster.last = c + 1 < clusters.size() ? clusters[c + 1] : static_cast<uint>(order.size());
+
+				v3f centroid = v3f::Zero(), normal = v3f::Zero();
+				float area = 0;
+				for (uint i = cluster.first; i < cluster.last; ++i) {
+					const Mesh::Tri& tri = triangles[order[i]];
+					const v3f& p0 = vertices[tri[0]], & p1 = vertices[tri[1]], & p2 = vertices[tri[2]];
+					const v3f cross = (p1 - p0).cross(p2 - p0);
+					const float triangleArea = cross.norm();
+					centroid += triangleArea * (p0 + p1 + p2) / 3.0f;
+					normal += cross;
+					area += triangleArea;
+				}
+				const float normalNorm = normal.norm();
+				cluster.key = area > 0 && normalNorm > 0 ? (centroid / area - meshCentroid).dot(normal / normalNorm) : 0;
+			}
+
+			std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) {
+				return a.key > b.key;
+			});
+
+			std::vector<uint> sortedOrder;
+			sortedOrder.reserve(order.size());
+			for (const Cluster& cluster : sorted) {
+				sortedOrder.insert(sortedOrder.end(), order.begin() + cluster.first, order.begin() + cluster.last);
+			}
+			return sortedOrder;
+		}
+
+		VertexCacheStats analyze(const Mesh::Triangles& triangles, size_t numVertices, int cacheSize)
+		{
+			constexpr size_t LineSize = 64, NumLines = 256;
+
+			FifoCache cache(numVertices, cacheSize);
+			std::vector<size_t> lines(NumLines, std::numeric_limits<size_t>::max());
+			std::vector<char> used(numVertices, false);
+			size_t numMisses = 0, numUsed = 0, numFetchedLines = 0;
+			for (const Mesh::Tri& tri : triangles) {
+				for (int k = 0; k < 3; ++k) {
+					const uint v = tri[k];
+					if (!used[v]) {
+						used[v] = true;
+						++numUsed;
+					}
+					if (!cache.access(v)) {
+						continue;
+					}
+					++numMisses;
+
+					// position fetched by the vertex shader, through a direct mapped cache
+					const size_t firstLine = v * sizeof(Mesh::Vert) / LineSize, lastLine = ((v + 1) * sizeof(Mesh::Vert) - 1) / LineSize;
+					for (size_t line = firstLine; line <= lastLine; ++line) {
+						if (lines[line % NumLines] != line) {
+							lines[line % NumLines] = line;
+							++numFetchedLines;
+						}
+					}
+				}
+			}
+
+			VertexCacheStats stats;
+			if (!triangles.empty()) {
+				stats.acmr = numMisses / float(triangles.size());
+			}
+			if (numUsed > 0) {
+				stats.atvr = numMisses / float(numUsed);
+				stats.overfetch = numFetchedLines * LineSize / float(numUsed * sizeof(Mesh::Vert));
+			}
+			return stats;
+		}
+
+		bool worse(const VertexCacheStats& stats, const VertexCacheStats& reference)
+		{
+			return stats.acmr > reference.acmr || stats.overfetch > reference.overfetch;
+		}
+	}
+
+	VertexCacheStats analyzeVertexCache(const Mesh& mesh, int cacheSize)
+	{
+		return analyze(mesh.getTriangles(), mesh.getVertices().size(), cacheSize);
+	}
+
+	MeshOptimizationReport optimizeMesh(Mesh& mesh, const MeshOptimizationParams& params)
+	{
+		MeshOptimizationReport report;
+		report.before = report.after = analyzeVertexCache(mesh, params.cacheSize);
+		if (mesh.getTriangles().empty()) {
+			return report;
+		}
+
+		const size_t numVertices = mesh.getVertices().size();
+		std::vector<uint> clusters;
+		std::vector<uint> order = tipsify(mesh.getTriangles(), *mesh.adjacency(), params.cacheSize, clusters);
+		if (params.overdrawThreshold > 0) {
+			clusters = splitClusters(mesh.getTriangles(), order, clusters, numVertices, params.cacheSize, params.overdrawThreshold);
+			order = sortClusters(mesh, order, clusters);
+		}
+
+		Mesh::Triangles triangles(order.size());
+		for (size_t t = 0; t < order.size(); ++t) {
+			triangles[t] = mesh.getTriangles()[order[t]];
+		}
+		const VertexCacheStats reordered = analyze(triangles, numVertices, params.cacheSize);
+
+		// first used first, then the unused ones
+		std::vector<uint> vertexOrder;
+		VertexCacheStats renumbered;
+		if (params.reorderVertices) {
+			vertexOrder.reserve(numVertices);
+			std::vector<uint> newIds(numVertices, MeshAdjacency::Invalid);
+			Mesh::Triangles remapped(triangles.size());
+			for (size_t t = 0; t < triangles.size(); ++t) {
+				for (int k = 0; k < 3; ++k) {
+					uint& id = newIds[triangles[t][k]];
+					if (id == MeshAdjacency::Invalid) {
+						id = static_cast<uint>(vertexOrder.size());
+						vertexOrder.push_back(triangles[t][k]);
+					}
+					remapped[t][k] = id;
+				}
+			}
+			for (uint v = 0; v < numVertices; ++v) {
+				if (newIds[v] == MeshAdjacency::Invalid) {
+					vertexOrder.push_back(v);
+				}
+			}
+			renumbered = analyze(remapped, numVertices, params.cacheSize);
+		}
+
+		// already coherent meshes can lose fetch locality, the input orders are then kept
+		if (params.reorderVertices && !worse(renumbered, report.before)) {
+			mesh.reorderTriangles(order);
+			mesh.reorderVertices(vertexOrder);
+			report.reorderedTriangles = report.reorderedVertices = true;
+		} else if (!worse(reordered, report.before)) {
+			mesh.reorderTriangles(order);
+			report.reorderedTriangles = true;
+		}
+
+		if (report.reorderedTriangles) {
+			report.numClusters = clusters.size();
+			report.after = analyzeVertexCache(mesh, params.cacheSize);
+		}
+		return report;
+	}
+
+}
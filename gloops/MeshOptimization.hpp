@@ -0,0 +1,37 @@
+#pragma once
+
+#include "config.hpp"
+
+#include <cstddef>
+
+namespace gloops {
+
+	class Mesh;
+
+	// simulated rendering of the triangles in order, through a FIFO post transform cache
+	struct VertexCacheStats {
+		float acmr = 0;			// average cache miss ratio, transformed vertices per triangle, from about 0.5 to 3
+		float atvr = 0;			// average transformed to vertex ratio, transformed vertices per used vertex, 1 at best
+		float overfetch = 0;	// position bytes read through 64 bytes cache lines per used position byte, 1 at best
+	};
+
+	VertexCacheStats analyzeVertexCache(const Mesh& mesh, int cacheSize = 16);
+
+	struct MeshOptimizationParams {
+		int cacheSize = 16;					// of the simulated post transform cache
+		float overdrawThreshold = 1.05f;	// ACMR increase allowed to the clusters sorted against overdraw, 0 keeps the cache order
+		bool reorderVertices = true;		// in order of first use, for fetch locality
+	};
+
+	struct MeshOptimizationReport {
+		VertexCacheStats before, after;
+		size_t numClusters = 0;
+		bool reorderedTriangles = false, reorderedVertices = false;	// false if that order was kept, as reordering made ACMR or overfetch worse
+	};
+
+	// triangles reordered with Tipsify (Sander et al. 2007), then split into clusters sorted
+	// outside first, so that front faces tend to be drawn first whatever the view
+	// each reordering is only applied if neither ACMR nor overfetch gets worse
+	MeshOptimizationReport optimizeMesh(Mesh& mesh, const MeshOptimizationParams& params = {});
+
+}
@@ -0,0 +1,526 @@
+#include "MeshReaders.hpp"
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+#include "Debug.hpp"
+#include "Utils.hpp"
+
+#include <cstring>
+#include <sstream>
+
+namespace gloops {
+
+	namespace {
+
+		enum class PlyType { INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64, INVALID };
+
+		PlyType plyType(const std::string& s) {
+			static const std::map<std::string, PlyType> types = {
+				{ "char", PlyType::INT8 }, { "int8", PlyType::INT8 },
+				{ "uchar", PlyType::UINT8 }, { "uint8", PlyType::UINT8 },
+				{ "short", PlyType::INT16 }, { "int16", PlyType::INT16 },
+				{ "ushort", PlyType::UINT16 }, { "uint16", PlyType::UINT16 },
+				{ "int", PlyType::INT32 }, { "int32", PlyType::INT32 },
+				{ "uint", PlyType::UINT32 }, { "uint32", PlyType::UINT32 },
+				{ "float", PlyType::FLOAT32 }, { "float32", PlyType::FLOAT32 },
+				{ "double", PlyType::FLOAT64 }, { "float64", PlyType::FLOAT64 },
+			};
+			const auto it = types.find(s);
+			return it == types.end() ? PlyType::INVALID : it->second;
+		}
+
+		size_t plySize(PlyType type) {
+			static const size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+			return sizes[static_cast<int>(type)];
+		}
+
+		template<typename T>
+		T readRaw(const char* ptr, bool swap) {
+			char bytes[sizeof(T)];
+			std::memcpy(bytes, ptr, sizeof(T));
+			if (swap) {
+				std::reverse(bytes, bytes + sizeof(T));
+			}
+			T out;
+			std::memcpy(&out, bytes, sizeof(T));
+			return out;
+		}
+
+		double readPly(const char* ptr, PlyType type, bool swap) {
+			switch (type)
+			{
+			case PlyType::INT8: return readRaw<int8_t>(ptr, swap);
+			case PlyType::UINT8: return readRaw<uint8_t>(ptr, swap);
+			case PlyType::INT16: return readRaw<int16_t>(ptr, swap);
+			case PlyType::UINT16: return readRaw<uint16_t>(ptr, swap);
+			case PlyType::INT32: return readRaw<int32_t>(ptr, swap);
+			case PlyType::UINT32: return readRaw<uint32_t>(ptr, swap);
+			case PlyType::FLOAT32: return readRaw<float>(ptr, swap);
+			case PlyType::FLOAT64: return readRaw<double>(ptr, swap);
+			default: return 0;
+			}
+		}
+
+		// what a vertex property is decoded into
+		enum class PlyRole { X, Y, Z, NX, NY, NZ, RED, GREEN, BLUE, U, V, EXTRA, NONE };
+
+		struct PlyProperty {
+			std::string name;
+			PlyType type = PlyType::INVALID, countType = PlyType::INVALID;
+			bool isList = false;
+			size_t offset = 0;
+			PlyRole role = PlyRole::NONE;
+			int extra = -1;
+		};
+
+		struct PlyElement {
+			std::string name;
+			size_t count = 0;
+			std::vector<PlyProperty> properties;
+			bool fixedSize = true;
+			size_t stride = 0;
+		};
+
+		PlyRole plyRole(const std::string& name) {
+			static const std::map<std::string, PlyRole> roles = {
+				{ "x", PlyRole::X }, { "y", PlyRole::Y }, { "z", PlyRole::Z },
+				{ "nx", PlyRole::NX }, { "ny", PlyRole::NY }, { "nz", PlyRole::NZ },
+				{ "red", PlyRole::RED }, { "green", PlyRole::GREEN }, { "blue", PlyRole::BLUE },
+				{ "diffuse_red", PlyRole::RED }, { "diffuse_green", PlyRole::GREEN }, { "diffuse_blue", PlyRole::BLUE },
+				{ "u", PlyRole::U }, { "v", PlyRole::V }, { "s", PlyRole::U }, { "t", PlyRole::V },
+				{ "texture_u", PlyRole::U }, { "texture_v", PlyRole::V },
+			};
+			const auto it = roles.find(name);
+			return it == roles.end() ? PlyRole::EXTRA : it->second;
+		}
+
+		// size of one element, empty lists included, to reject element counts larger than the file
+		size_t plyMinElementSize(const PlyElement& element) {
+			size_t size = 0;
+			for (const PlyProperty& property : element.properties) {
+				size += plySize(property.isList ? property.countType : property.type);
+			}
+			return std::max<size_t>(size, 1);
+		}
+
+		// size of one element starting at ptr, lists included, 0 if it goes past end
+		size_t plyElementSize(const PlyElement& element, const char* ptr, const char* end, bool swap) {
+			const size_t available = static_cast<size_t>(end - ptr);
+			if (element.fixedSize) {
+				return element.stride <= available ? element.stride : 0;
+			}
+			size_t size = 0;
+			for (const PlyProperty& property : element.properties) {
+				const size_t fieldSize = plySize(property.isList ? property.countType : property.type);
+				if (fieldSize > available - size) {
+					return 0;
+				}
+				if (property.isList) {
+					const double n = readPly(ptr + size, property.countType, swap);
+					size += fieldSize;
+					const size_t itemSize = std::max<size_t>(plySize(property.type), 1);
+					if (n < 0 || n > static_cast<double>((available - size) / itemSize)) {
+						return 0;
+					}
+					size += static_cast<size_t>(n) * itemSize;
+				} else {
+					size += fieldSize;
+				}
+			}
+			return size;
+		}
+
+		// open addressing from positions to welded vertices, with linear probing
+		// with a tolerance, cells may hold several vertices, all further than tolerance from each other
+		class PositionMap {
+		public:
+			PositionMap(size_t numPositions, float tolerance) :
+				invTolerance(tolerance > 0 ? 1.0f / tolerance : 0.0f), squaredTolerance(tolerance * tolerance)
+			{
+				size_t capacity = 16;
+				while (capacity < 2 * numPositions) {
+					capacity *= 2;
+				}
+				keys.resize(capacity);
+				values.assign(capacity, empty);
+				if (invTolerance > 0) {
+					points.resize(capacity);
+				}
+				mask = capacity - 1;
+			}
+
+			// the vertex of p, candidate if no vertex is within tolerance of p, or at the same position without tolerance
+			uint insert(const v3f& p, uint candidate) {
+				const v3i key = cell(p);
+				if (invTolerance > 0) {
+					// closest vertex in the 27 cells around, as cells are as large as the tolerance
+					uint closest = empty;
+					float closestDistance = squaredTolerance;
+					for (int dz = -1; dz <= 1; ++dz) {
+						for (int dy = -1; dy <= 1; ++dy) {
+							for (int dx = -1; dx <= 1; ++dx) {
+								const v3i neighbor = key + v3i(dx, dy, dz);
+								for (size_t slot = hash(neighbor) & mask; values[slot] != empty; slot = (slot + 1) & mask) {
+									const float distance = (points[slot] - p).squaredNorm();
+									if (keys[slot] == neighbor && distance <= closestDistance) {
+										closest = values[slot];
+										closestDistance = distance;
+									}
+								}
+							}
+						}
+					}
+					if (closest != empty) {
+						return closest;
+					}
+				}
+
+				size_t slot = hash(key) & mask;
+				while (values[slot] != empty) {
+					if (invTolerance == 0 && keys[slot] == key) {
+						return values[slot];
+					}
+					slot = (slot + 1) & mask;
+				}
+				keys[slot] = key;
+				values[slot] = candidate;
+				if (invTolerance > 0) {
+					points[slot] = p;
+				}
+				return candidate;
+			}
+
+		protected:
+			// float bits when welding identical positions only, -0 and 0 being merged
+			v3i cell(const v3f& p) const {
+				v3i out;
+				for (int k = 0; k < 3; ++k) {
+					if (invTolerance > 0) {
+						out[k] = static_cast<int>(std::floor(p[k] * invTolerance));
+					} else {
+						const float f = p[k] == 0.0f ? 0.0f : p[k];
+						std::memcpy(&out[k], &f, sizeof(float));
+					}
+				}
+				return out;
+			}
+
+			static size_t hash(const v3i& key) {
+				return hashTriplet(key[0], key[1], key[2]);
+			}
+
+			static constexpr uint empty = std::numeric_limits<uint>::max();
+			float invTolerance, squaredTolerance;
+			std::vector<v3i> keys;
+			std::vector<v3f> points;
+			std::vector<uint> values;
+			size_t mask;
+		};
+	}
+
+	Mesh readPLY(const std::string& path, const PLYParams& params)
+	{
+		MappedFile file;
+		if (!file.open(path)) {
+			addToLogs(LogType::ERROR, "cannot open " + path);
+			return Mesh();
+		}
+
+		const char* data = file.data();
+		const size_t size = file.size();
+
+		// ascii header
+		static const std::string headerEnd = "end_header";
+		const char* endHeader = size > 3 ? std::search(data, data + size, headerEnd.begin(), headerEnd.end()) : data + size;
+		const char* body = endHeader == data + size ? nullptr : static_cast<const char*>(std::memchr(endHeader, '\n', data + size - endHeader));
+		if (size < 3 || std::strncmp(data, "ply", 3) != 0 || !body) {
+			addToLogs(LogType::ERROR, path + " : not a PLY file");
+			return Mesh();
+		}
+		++body;
+
+		std::vector<PlyElement> elements;
+		std::istringstream header(std::string(data, endHeader - data));
+		std::string line, format;
+		while (std::getline(header, line)) {
+			std::istringstream tokens(line);
+			std::string keyword;
+			tokens >> keyword;
+			if (keyword == "format") {
+				tokens >> format;
+			} else if (keyword == "element") {
+				elements.emplace_back();
+				tokens >> elements.back().name >> elements.back().count;
+			} else if (keyword == "property" && !elements.empty()) {
+				PlyElement& element = elements.back();
+				PlyProperty property;
+				std::string type;
+				tokens >> type;
+				if (type == "list") {
+					std::string countType, itemType;
+					tokens >> countType >> itemType;
+					property.isList = true;
+					property.countType = plyType(countType);
+					property.type = plyType(itemType);
+					element.fixedSize = false;
+				} else {
+					property.type = plyType(type);
+				}
+				tokens >> property.name;
+				if (property.type == PlyType::INVALID || (property.isList && property.countType == PlyType::INVALID)) {
+					addToLogs(LogType::ERROR, path + " : unknown PLY type in " + line);
+					return Mesh();
+				}
+				property.offset = element.stride;
+				element.stride += plySize(property.type);
+				element.properties.push_back(property);
+			}
+		}
+
+		if (format != "binary_little_endian" && format != "binary_big_endian") {
+			addToLogs(LogType::ERROR, path + " : unsupported PLY format " + format + ", only binary ones are read");
+			return Mesh();
+		}
+		const bool swap = format == "binary_big_endian";
+
+		Mesh::Vertices vertices;
+		Mesh::Normals normals;
+		Mesh::Colors colors;
+		Mesh::UVs uvs;
+		Mesh::Triangles triangles;
+		std::vector<std::vector<float>> extras;
+		std::vector<std::string> extraNames;
+
+		const char* ptr = body;
+		const char* end = data + size;
+		auto truncated = [&]() {
+			addToLogs(LogType::ERROR, path + " : truncated PLY file");
+			return Mesh();
+		};
+		for (PlyElement& element : elements) {
+			// before any allocation, as the counts come from the header
+			if (element.count > static_cast<size_t>(end - ptr) / plyMinElementSize(element)) {
+				return truncated();
+			}
+
+			if (element.name == "vertex") {
+				bool has[static_cast<int>(PlyRole::NONE)] = {};
+				bool integerColors = false;
+				for (PlyProperty& property : element.properties) {
+					if (property.isList) {
+						continue;
+					}
+					property.role = plyRole(property.name);
+					if (property.role == PlyRole::EXTRA) {
+						if (!params.extraAttributes) {
+							property.role = PlyRole::NONE;
+							continue;
+						}
+						property.extra = static_cast<int>(extraNames.size());
+						extraNames.push_back(property.name);
+					}
+					has[static_cast<int>(property.role)] = true;
+					if (property.role == PlyRole::RED) {
+						integerColors = property.type != PlyType::FLOAT32 && property.type != PlyType::FLOAT64;
+					}
+				}
+
+				const size_t n = element.count;
+				vertices.resize(n, v3f::Zero());
+				normals.resize(has[int(PlyRole::NX)] ? n : 0, v3f::Zero());
+				colors.resize(has[int(PlyRole::RED)] ? n : 0, v3f::Ones());
+				uvs.resize(has[int(PlyRole::U)] ? n : 0, v2f::Zero());
+				extras.assign(extraNames.size(), std::vector<float>(n, 0.0f));
+				const float colorScale = integerColors ? 1.0f / 255.0f : 1.0f;
+
+				auto decode = [&](size_t i, const char* vertex) {
+					for (const PlyProperty& property : element.properties) {
+						if (property.role == PlyRole::NONE) {
+							continue;
+						}
+						const float value = static_cast<float>(readPly(vertex + property.offset, property.type, swap));
+						switch (property.role)
+						{
+						case PlyRole::X: vertices[i][0] = value; break;
+						case PlyRole::Y: vertices[i][1] = value; break;
+						case PlyRole::Z: vertices[i][2] = value; break;
+						case PlyRole::NX: normals[i][0] = value; break;
+						case PlyRole::NY: normals[i][1] = value; break;
+						case PlyRole::NZ: normals[i][2] = value; break;
+						case PlyRole::RED: colors[i][0] = colorScale * value; break;
+						case PlyRole::GREEN: colors[i][1] = colorScale * value; break;
+						case PlyRole::BLUE: colors[i][2] = colorScale * value; break;
+						case PlyRole::U: uvs[i][0] = value; break;
+						case PlyRole::V: uvs[i][1] = value; break;
+						case PlyRole::EXTRA: extras[property.extra][i] = value; break;
+						default: break;
+						}
+					}
+				};
+
+				if (element.fixedSize) {
+					forEachRange(n, [&](size_t from, size_t to) {
+						for (size_t i = from; i < to; ++i) {
+							decode(i, ptr + i * element.stride);
+						}
+					}, params.maxNumThreads);
+					ptr += n * element.stride;
+				} else {
+					// list properties in vertices, only their offsets are needed
+					for (size_t i = 0; i < n; ++i) {
+						const size_t elementSize = plyElementSize(element, ptr, end, swap);
+						if (elementSize == 0) {
+							return truncated();
+						}
+						size_t offset = 0;
+						for (PlyProperty& property : element.properties) {
+							property.offset = offset;
+							offset += property.isList
+								? plySize(property.countType) + static_cast<size_t>(readPly(ptr + offset, property.countType, swap)) * plySize(property.type)
+								: plySize(property.type);
+						}
+						decode(i, ptr);
+						ptr += elementSize;
+					}
+				}
+			} else if (element.name == "face") {
+				triangles.reserve(element.count);
+				for (size_t f = 0; f < element.count; ++f) {
+					const size_t elementSize = plyElementSize(element, ptr, end, swap);
+					if (elementSize == 0) {
+						return truncated();
+					}
+					const char* face = ptr;
+					for (const PlyProperty& property : element.properties) {
+						if (!property.isList) {
+							face += plySize(property.type);
+							continue;
+						}
+						const size_t count = static_cast<size_t>(readPly(face, property.countType, swap));
+						face += plySize(property.countType);
+						const size_t itemSize = plySize(property.type);
+						if (property.name == "vertex_indices" || property.name == "vertex_index") {
+							const uint first = static_cast<uint>(readPly(face, property.type, swap));
+							for (size_t k = 2; k < count; ++k) {
+								triangles.emplace_back(
+									first,
+									static_cast<uint>(readPly(face + (k - 1) * itemSize, property.type, swap)),
+									static_cast<uint>(readPly(face + k * itemSize, property.type, swap))
+								);
+							}
+						}
+						face += count * itemSize;
+					}
+					ptr += elementSize;
+				}
+			} else {
+				for (size_t i = 0; i < element.count; ++i) {
+					const size_t elementSize = plyElementSize(element, ptr, end, swap);
+					if (elementSize == 0) {
+						return truncated();
+					}
+					ptr += elementSize;
+				}
+			}
+		}
+
+		// faces referencing missing vertices are dropped
+		const uint numVertices = static_cast<uint>(vertices.size());
+		triangles.erase(std::remove_if(triangles.begin(), triangles.end(), [&](const Mesh::Tri& t) {
+			return t[0] >= numVertices || t[1] >= numVertices || t[2] >= numVertices;
+		}), triangles.end());
+
+		Mesh mesh;
+		mesh.setVertices(std::move(vertices));
+		mesh.setTriangles(std::move(triangles));
+		if (!normals.empty()) {
+			mesh.setNormals(std::move(normals));
+		}
+		if (!colors.empty()) {
+			mesh.setColors(std::move(colors));
+		}
+		if (!uvs.empty()) {
+			mesh.setUVs(std::move(uvs));
+		}
+		for (size_t e = 0; e < extraNames.size(); ++e) {
+			mesh.setCPUattribute(extraNames[e], extras[e]);
+		}
+		return mesh;
+	}
+
+	Mesh readSTL(const std::string& path, const STLParams& params)
+	{
+		MappedFile file;
+		if (!file.open(path)) {
+			addToLogs(LogType::ERROR, "cannot open " + path);
+			return Mesh();
+		}
+
+		// 80 bytes header, triangle count, then 50 bytes per triangle: normal, 3 corners, attribute
+		constexpr size_t headerSize = 84, triangleSize = 50;
+		const char* data = file.data();
+		const size_t size = file.size();
+		const size_t numTriangles = size >= headerSize ? readRaw<uint32_t>(data + 80, false) : 0;
+		if (size < headerSize || size < headerSize + numTriangles * triangleSize) {
+			addToLogs(LogType::ERROR, path + " : not a binary STL file");
+			return Mesh();
+		}
+
+		const size_t numCorners = 3 * numTriangles;
+		Mesh::Vertices corners(numCorners);
+		Mesh::Normals facetNormals(numTriangles);
+		forEachRange(numTriangles, [&](size_t from, size_t to) {
+			for (size_t t = from; t < to; ++t) {
+				const char* triangle = data + headerSize + t * triangleSize;
+				std::memcpy(facetNormals[t].data(), triangle, 3 * sizeof(float));
+				std::memcpy(corners[3 * t].data(), triangle + 12, 9 * sizeof(float));
+			}
+		}, params.maxNumThreads);
+
+		Mesh mesh;
+		if (!params.weld) {
+			Mesh::Triangles triangles(numTriangles);
+			Mesh::Normals normals(numCorners);
+			for (size_t t = 0; t < numTriangles; ++t) {
+				const uint i = static_cast<uint>(3 * t);
+				triangles[t] = Mesh::Tri(i, i + 1, i + 2);
+				normals[i] = normals[i + 1] = normals[i + 2] = facetNormals[t];
+			}
+			mesh.setVertices(std::move(corners));
+			mesh.setTriangles(std::move(triangles));
+			mesh.setNormals(std::move(normals));
+			return mesh;
+		}
+
+		PositionMap positionMap(numCorners, params.weldTolerance);
+		Mesh::Vertices vertices;
+		Mesh::Triangles triangles(numTriangles);
+		for (size_t i = 0; i < numCorners; ++i) {
+			const uint id = positionMap.insert(corners[i], static_cast<uint>(vertices.size()));
+			if (id == vertices.size()) {
+				vertices.push_back(corners[i]);
+			}
+			triangles[i / 3][i % 3] = id;
+		}
+
+		// area weighted, the file normals for vertices of degenerate triangles only
+		Mesh::Normals normals(vertices.size(), v3f::Zero()), fallbacks(vertices.size(), v3f::Zero());
+		for (size_t t = 0; t < numTriangles; ++t) {
+			const Mesh::Tri& tri = triangles[t];
+			const v3f n = (vertices[tri[1]] - vertices[tri[0]]).cross(vertices[tri[2]] - vertices[tri[0]]);
+			for (int k = 0; k < 3; ++k) {
+				normals[tri[k]] += n;
+				fallbacks[tri[k]] += facetNormals[t];
+			}
+		}
+		for (size_t i = 0; i < normals.size(); ++i) {
+			const v3f& n = normals[i].isZero() ? fallbacks[i] : normals[i];
+			normals[i] = n.isZero() ? v3f::UnitZ() : v3f(n.normalized());
+		}
+
+		mesh.setVertices(std::move(vertices));
+		mesh.setTriangles(std::move(triangles));
+		mesh.setNormals(std::move(normals));
+		return mesh;
+	}
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "config.hpp"
+
+#include <string>
+
+namespace gloops {
+
+	class Mesh;
+
+	struct PLYParams {
+		bool extraAttributes = true;	// other scalar vertex properties as float CPU attributes, named after them
+		int maxNumThreads = 256;
+	};
+
+	struct STLParams {
+		bool weld = true;				// merges the corners of the triangles, otherwise keeps the facet normals
+		float weldTolerance = 0.0f;		// max distance between merged corners, 0 welding only identical positions
+		int maxNumThreads = 256;
+	};
+
+	// binary little or big endian PLY, with positions, normals, colors, uvs and polygonal faces, fan triangulated
+	// vertices are decoded in parallel straight from the file mapping
+	Mesh readPLY(const std::string& path, const PLYParams& params = {});
+
+	// binary STL, triangles decoded in parallel, welded vertices get area weighted normals
+	Mesh readSTL(const std::string& path, const STLParams& params = {});
+
+}
@@ -0,0 +1,298 @@
+#include "ObjParser.hpp"
+#include "Debug.hpp"
+#include "Utils.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <string_view>
+
+namespace gloops {
+
+	namespace {
+
+		// relative indices are stored as local indices, to be offset by the attributes of the previous chunks
+		// bit a of mask set for the relative attributes of the corner, in v, vt, vn order
+		struct RelativeIndex {
+			size_t corner;
+			int mask;
+		};
+
+		struct ObjChunk {
+			ObjData data;
+			std::vector<RelativeIndex> relatives;
+			std::vector<std::pair<size_t, std::string>> shapeStarts;
+			bool hasColors = false;
+		};
+
+		bool isBlank(char c) {
+			return c == ' ' || c == '\t' || c == '\r';
+		}
+
+		const char* skipBlanks(const char* ptr, const char* end) {
+			while (ptr < end && isBlank(*ptr)) {
+				++ptr;
+			}
+			return ptr;
+		}
+
+		bool parseFloat(const char*& ptr, const char* end, float& out) {
+			ptr = skipBlanks(ptr, end);
+			if (ptr < end && *ptr == '+') {
+				++ptr;
+			}
+			const std::from_chars_result res = std::from_chars(ptr, end, out);
+			if (res.ec != std::errc()) {
+				return false;
+			}
+			ptr = res.ptr;
+			return true;
+		}
+
+		bool parseInt(const char*& ptr, const char* end, int& out) {
+			if (ptr < end && *ptr == '+') {
+				++ptr;
+			}
+			const std::from_chars_result res = std::from_chars(ptr, end, out);
+			if (res.ec != std::errc()) {
+				return false;
+			}
+			ptr = res.ptr;
+			return true;
+		}
+
+		template<int N>
+		bool parseVec(const char*& ptr, const char* end, Vec<float, N>& out) {
+			for (int i = 0; i < N; ++i) {
+				if (!parseFloat(ptr, end, out[i])) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// v, v/vt, v//vn or v/vt/vn
+		bool parseCorner(const char*& ptr, const char* end, const ObjChunk& chunk, ObjIndex& out, int& relatives) {
+			const int counts[3] = {
+				static_cast<int>(chunk.data.positions.size()),
+				static_cast<int>(chunk.data.texCoords.size()),
+				static_cast<int>(chunk.data.normals.size())
+			};
+			int* indices[3] = { &out.v, &out.vt, &out.vn };
+			out = ObjIndex();
+			relatives = 0;
+			for (int a = 0; a < 3; ++a) {
+				if (a > 0) {
+					if (ptr == end || *ptr != '/') {
+						break;
+					}
+					++ptr;
+					if (ptr < end && (*ptr == '/' || isBlank(*ptr) || *ptr == '\n')) {
+						continue;
+					}
+				}
+
+				int i;
+				if (!parseInt(ptr, end, i) || i == 0) {
+					return false;
+				}
+				relatives |= (i < 0) << a;
+				*indices[a] = i > 0 ? i - 1 : counts[a] + i;
+			}
+			return ptr == end || isBlank(*ptr) || *ptr == '\n';
+		}
+
+		bool parseLine(const char* ptr, const char* end, ObjChunk& chunk) {
+			ObjData& data = chunk.data;
+			ptr = skipBlanks(ptr, end);
+			if (ptr == end || *ptr == '#') {
+				return true;
+			}
+
+			const char* keyEnd = ptr;
+			while (keyEnd < end && !isBlank(*keyEnd)) {
+				++keyEnd;
+			}
+			const std::string_view key(ptr, keyEnd - ptr);
+			ptr = keyEnd;
+
+			// invalid attribute lines still get a default value, so that the following indices stay aligned
+			if (key == "v") {
+				v3f p, c;
+				const bool valid = parseVec(ptr, end, p);
+				data.positions.push_back(valid ? p : v3f::Zero());
+
+				// optional vertex colors
+				if (valid && parseVec(ptr, end, c)) {
+					if (!chunk.hasColors) {
+						data.colors.resize(data.positions.size() - 1, v3f::Ones());
+						chunk.hasColors = true;
+					}
+					data.colors.push_back(c);
+				} else if (chunk.hasColors) {
+					data.colors.push_back(v3f::Ones());
+				}
+				return valid;
+			} else if (key == "vt") {
+				// v is optional, and so is w, ignored
+				v2f uv = v2f::Zero();
+				const bool valid = parseFloat(ptr, end, uv[0]);
+				float v;
+				if (valid && parseFloat(ptr, end, v)) {
+					uv[1] = v;
+				}
+				data.texCoords.push_back(valid ? uv : v2f::Zero());
+				return valid;
+			} else if (key == "vn") {
+				v3f n;
+				const bool valid = parseVec(ptr, end, n);
+				data.normals.push_back(valid ? n : v3f::Zero());
+				return valid;
+			} else if (key == "f") {
+				ObjIndex corners[3];
+				int relatives[3] = { 0, 0, 0 };
+				int numCorners = 0;
+				while ((ptr = skipBlanks(ptr, end)) < end) {
+					// fan triangulation, first, previous and current corners
+					const int slot = std::min(numCorners, 2);
+					if (numCorners > 2) {
+						corners[1] = corners[2];
+						relatives[1] = relatives[2];
+					}
+					if (!parseCorner(ptr, end, chunk, corners[slot], relatives[slot])) {
+						return false;
+					}
+					if (++numCorners < 3) {
+						continue;
+					}
+					for (int i = 0; i < 3; ++i) {
+						if (relatives[i]) {
+							chunk.relatives.push_back({ data.corners.size(), relatives[i] });
+						}
+						data.corners.push_back(corners[i]);
+					}
+				}
+				return numCorners >= 3;
+			} else if (key == "o" || key == "g") {
+				ptr = skipBlanks(ptr, end);
+				while (end > ptr && isBlank(end[-1])) {
+					--end;
+				}
+				chunk.shapeStarts.emplace_back(data.corners.size() / 3, std::string(ptr, end));
+			}
+			return true;
+		}
+	}
+
+	ObjData parseObj(const char* data, size_t size, const ObjParsingParams& params)
+	{
+		// chunk boundaries right after line ends
+		const size_t chunkSize = std::max<size_t>(params.chunkSize, 1);
+		std::vector<size_t> starts = { 0 };
+		while (starts.back() + chunkSize < size) {
+			const char* next = static_cast<const char*>(std::memchr(data + starts.back() + chunkSize, '\n', size - starts.back() - chunkSize));
+			if (!next) {
+				break;
+			}
+			starts.push_back(next + 1 - data);
+		}
+		starts.push_back(size);
+		const int numChunks = static_cast<int>(starts.size()) - 1;
+
+		std::vector<ObjChunk> chunks(numChunks);
+		parallelForEach(0, numChunks, [&](int c) {
+			ObjChunk& chunk = chunks[c];
+			const char* ptr = data + starts[c];
+			const char* end = data + starts[c + 1];
+			while (ptr < end) {
+				const char* lineEnd = static_cast<const char*>(std::memchr(ptr, '\n', end - ptr));
+				lineEnd = lineEnd ? lineEnd : end;
+				// trailing \r is a blank
+				if (!parseLine(ptr, lineEnd, chunk)) {
+					++chunk.data.numInvalidLines;
+				}
+				ptr = lineEnd + 1;
+			}
+		}, params.maxNumThreads);
+
+		// attributes and triangles offsets of each chunk
+		ObjData out;
+		std::vector<v3i> offsets(numChunks + 1, v3i::Zero());
+		std::vector<size_t> triangleOffsets(numChunks + 1, 0);
+		bool hasColors = false;
+		for (int c = 0; c < numChunks; ++c) {
+			const ObjData& chunk = chunks[c].data;
+			offsets[c + 1] = offsets[c] + v3i(
+				static_cast<int>(chunk.positions.size()), static_cast<int>(chunk.texCoords.size()), static_cast<int>(chunk.normals.size())
+			);
+			triangleOffsets[c + 1] = triangleOffsets[c] + chunk.corners.size() / 3;
+			hasColors |= chunks[c].hasColors;
+			out.numInvalidLines += chunk.numInvalidLines;
+		}
+
+		out.positions.resize(offsets[numChunks][0]);
+		out.texCoords.resize(offsets[numChunks][1]);
+		out.normals.resize(offsets[numChunks][2]);
+		out.colors.resize(hasColors ? out.positions.size() : 0, v3f::Ones());
+		out.corners.resize(3 * triangleOffsets[numChunks]);
+
+		const v3i counts = offsets[numChunks];
+		parallelForEach(0, numChunks, [&](int c) {
+			ObjChunk& chunk = chunks[c];
+			ObjData& data = chunk.data;
+			const v3i& offset = offsets[c];
+
+			for (const RelativeIndex& r : chunk.relatives) {
+				ObjIndex& corner = data.corners[r.corner];
+				int* indices[3] = { &corner.v, &corner.vt, &corner.vn };
+				for (int a = 0; a < 3; ++a) {
+					if ((r.mask >> a) & 1) {
+						*indices[a] += offset[a];
+					}
+				}
+			}
+
+			// out of range indices are dropped
+			for (ObjIndex& corner : data.corners) {
+				int* indices[3] = { &corner.v, &corner.vt, &corner.vn };
+				for (int a = 0; a < 3; ++a) {
+					if (*indices[a] < 0 || *indices[a] >= counts[a]) {
+						*indices[a] = -1;
+					}
+				}
+			}
+
+			std::copy(data.positions.begin(), data.positions.end(), out.positions.begin() + offset[0]);
+			std::copy(data.texCoords.begin(), data.texCoords.end(), out.texCoords.begin() + offset[1]);
+			std::copy(data.normals.begin(), data.normals.end(), out.normals.begin() + offset[2]);
+			std::copy(data.colors.begin(), data.colors.end(), out.colors.begin() + offset[0]);
+			std::copy(data.corners.begin(), data.corners.end(), out.corners.begin() + 3 * triangleOffsets[c]);
+			data = ObjData();
+		}, params.maxNumThreads);
+
+		// shapes, empty ones only keep the last name
+		out.shapes.push_back(ObjShape());
+		for (int c = 0; c < numChunks; ++c) {
+			for (const auto& start : chunks[c].shapeStarts) {
+				const size_t first = triangleOffsets[c] + start.first;
+				if (first > out.shapes.back().firstTriangle) {
+					out.shapes.back().numTriangles = first - out.shapes.back().firstTriangle;
+					out.shapes.push_back(ObjShape());
+					out.shapes.back().firstTriangle = first;
+				}
+				out.shapes.back().name = start.second;
+			}
+		}
+		out.shapes.back().numTriangles = triangleOffsets[numChunks] - out.shapes.back().firstTriangle;
+		if (out.shapes.back().numTriangles == 0 && out.shapes.size() > 1) {
+			out.shapes.pop_back();
+		}
+
+		return out;
+	}
+
+	ObjData parseObj(const std::string& content, const ObjParsingParams& params)
+	{
+		return parseObj(content.data(), content.size(), params);
+	}
+
+}
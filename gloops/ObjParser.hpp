@@ -0,0 +1,44 @@
+#pragma once
+
+#include "config.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gloops {
+
+	struct ObjParsingParams {
+		size_t chunkSize = size_t(1) << 22;		// bytes per parallel parsing job, split at line ends
+		int maxNumThreads = 256;
+	};
+
+	// 0-based attribute indices of a face corner, -1 if absent or out of range
+	struct ObjIndex {
+		int v = -1, vt = -1, vn = -1;
+
+		bool operator==(const ObjIndex& other) const {
+			return v == other.v && vt == other.vt && vn == other.vn;
+		}
+	};
+
+	// triangles [firstTriangle, firstTriangle + numTriangles), a new shape starts at each o or g statement
+	struct ObjShape {
+		std::string name;
+		size_t firstTriangle = 0, numTriangles = 0;
+	};
+
+	// geometry of an OBJ file, polygons being fan triangulated, materials are ignored
+	// colors are empty if no vertex has any, ones for the vertices without otherwise
+	struct ObjData {
+		std::vector<v3f> positions, colors, normals;
+		std::vector<v2f> texCoords;
+		std::vector<ObjIndex> corners;	// 3 per triangle
+		std::vector<ObjShape> shapes;
+		size_t numInvalidLines = 0;
+	};
+
+	// lines are parsed in parallel by chunks, relative indices being resolved once all chunks are done
+	ObjData parseObj(const char* data, size_t size, const ObjParsingParams& params = {});
+	ObjData parseObj(const std::string& content, const ObjParsingParams& params = {});
+
+}
@@ -17,26 +17,41 @@ namespace gloops {
 
 	template <> struct RayPack<4> {
 		using RayHitType = RTCRayHit4;
+		using RayType = RTCRay4;
 
 		static const auto& rtcIntersectFunc() {
 			return rtcIntersect4;
 		}
+
+		static const auto& rtcOccludedFunc() {
+			return rtcOccluded4;
+		}
 	};
 
 	template <> struct RayPack<8> {
 		using RayHitType = RTCRayHit8;
+		using RayType = RTCRay8;
 
 		static const auto& rtcIntersectFunc() {
 			return rtcIntersect8;
 		}
+
+		static const auto& rtcOccludedFunc() {
+			return rtcOccluded8;
+		}
 	};
 
 	template <> struct RayPack<16> {
 		using RayHitType = RTCRayHit16;
+		using RayType = RTCRay16;
 
 		static const auto& rtcIntersectFunc() {
 			return rtcIntersect16;
 		}
+
+		static const auto& rtcOccludedFunc() {
+			return rtcOccluded16;
+		}
 	};
 
 	template<size_t... Is>
@@ -108,6 +123,15 @@ namespace gloops {
 			float far = std::numeric_limits<float>::infinity()
 		) const;
 
+		// true for occluded rays, invalid rays are reported as not occluded
+		template<uint N>
+		std::array<bool, N> occlusion(
+			const std::array<Ray, N>& rays,
+			const std::array<int32_t, N>& valids = allValidRays<N>(),
+			float near = 0.0f,
+			float far = std::numeric_limits<float>::infinity()
+		) const;
+
 		template<typename ...Meshes, typename Mesh> 
 		void addMesh(const Mesh& mesh, const Meshes& ...meshes);
 	
@@ -146,6 +170,9 @@ namespace gloops {
 
 		void initRay(RTCRay& out, const Ray& ray, float near, float far) const;
 
+		template<uint N>
+		void initRayPack(typename RayPack<N>::RayType& out, const std::array<Ray, N>& rays, float near, float far) const;
+
 		template<uint N>
 		void initRayHitPack(typename RayPack<N>::RayHitType& out, const std::array<Ray, N>& rays, float near, float far) const;
 
@@ -167,6 +194,7 @@ namespace gloops {
 		std::array<Hit, N> out;
 		for (uint i = 0; i < N; ++i) {
 			out[i].geomId = hits.geomID[i];
+			out[i].instId = hits.instID[0][i];
 			if (out[i].successful()) {
 				out[i].triId = hits.primID[i];
 				out[i].dist = rayHits.ray.tfar[i];
@@ -178,11 +206,9 @@ namespace gloops {
 	}
 
 	template<uint N>
-	inline void Raycaster::initRayHitPack(
-		typename RayPack<N>::RayHitType& out, const std::array<Ray, N>& rays, float near, float far) const
+	inline void Raycaster::initRayPack(
+		typename RayPack<N>::RayType& eRay, const std::array<Ray, N>& rays, float near, float far) const
 	{
-		auto& eRay = out.ray;
-		auto& hit = out.hit;
 		for (uint i = 0; i < N; ++i) {
 			eRay.tnear[i] = near;
 			eRay.tfar[i] = far;
@@ -192,9 +218,20 @@ namespace gloops {
 			eRay.dir_x[i] = rays[i].direction()[0];
 			eRay.dir_y[i] = rays[i].direction()[1];
 			eRay.dir_z[i] = rays[i].direction()[2];
+			eRay.time[i] = 0;
+			eRay.mask[i] = static_cast<unsigned>(-1);
 			eRay.flags[i] = 0;
+		}
+	}
 
-			hit.geomID[i] = RTC_INVALID_GEOMETRY_ID;
+	template<uint N>
+	inline void Raycaster::initRayHitPack(
+		typename RayPack<N>::RayHitType& out, const std::array<Ray, N>& rays, float near, float far) const
+	{
+		initRayPack<N>(out.ray, rays, near, far);
+		for (uint i = 0; i < N; ++i) {
+			out.hit.geomID[i] = RTC_INVALID_GEOMETRY_ID;
+			out.hit.instID[0][i] = RTC_INVALID_GEOMETRY_ID;
 		}
 	}
 
@@ -207,11 +244,29 @@ namespace gloops {
 		typename RayPack<N>::RayHitType rayHits;
 		initRayHitPack(rayHits, rays, near, far);
 
-		RayPack<N>::rtcIntersectFunc()(valids.data(), scene.get(), context.get(), &rayHits);
+		RayPack<N>::rtcIntersectFunc()(valids.data(), data->scene.get(), data->context.get(), &rayHits);
 
 		return Hit::fromPack<N>(rayHits);
 	}
 
+	template<uint N>
+	inline std::array<bool, N> Raycaster::occlusion(
+		const std::array<Ray, N>& rays, const std::array<int32_t, N>& valids, float near, float far) const
+	{
+		checkScene();
+
+		typename RayPack<N>::RayType eRays;
+		initRayPack<N>(eRays, rays, near, far);
+
+		RayPack<N>::rtcOccludedFunc()(valids.data(), data->scene.get(), data->context.get(), &eRays);
+
+		std::array<bool, N> out;
+		for (uint i = 0; i < N; ++i) {
+			out[i] = valids[i] != 0 && eRays.tfar[i] < 0;
+		}
+		return out;
+	}
+
 	template<typename ...Meshes, typename Mesh>
 	inline void Raycaster::addMesh(const Mesh& mesh, const Meshes& ...meshes)
 	{
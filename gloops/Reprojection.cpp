@@ -0,0 +1,102 @@
+#include "Reprojection.hpp"
+#include "Utils.hpp"
+
+namespace gloops {
+
+	void TemporalReprojection::reproject(
+		const RaycastingCameraf& previousCam, const Image1f& previousDepth, const Image3f& previousNormals,
+		const RaycastingCameraf& currentCam, const Image1f& currentDepth, const Image3f& currentNormals,
+		Image3f& color, Image1f& counts, const ReprojectionParams& params)
+	{
+		std::swap(previousColor, color);
+		std::swap(previousCounts, counts);
+
+		const int w = currentCam.w(), h = currentCam.h();
+		color.resize(w, h);
+		counts.resize(w, h);
+
+		const int pw = previousCam.w(), ph = previousCam.h();
+		const bool validHistory =
+			previousColor.w() == pw && previousColor.h() == ph &&
+			previousCounts.w() == pw && previousCounts.h() == ph &&
+			previousDepth.w() == pw && previousDepth.h() == ph;
+
+		if (!validHistory) {
+			color.setTo(v3f::Zero());
+			counts.setTo(Image1f::Pixel(0));
+			return;
+		}
+
+		const v3f previousPosition = previousCam.position(), previousDir = previousCam.dir();
+
+		parallelForEach(0, h, [&](int y) {
+			for (int x = 0; x < w; ++x) {
+				const float depth = currentDepth.at(x, y);
+				const bool hit = depth > 0;
+				const v3f dir = currentCam.rayDir(v2f(x + 0.5f, h - y - 0.5f));
+
+				v3f previousPixel;
+				float previousDist = 0;
+				v3f normal = v3f::Zero();
+
+				if (hit) {
+					const v3f p = currentCam.position() + depth * dir;
+					previousDist = (p - previousPosition).norm();
+					normal = currentNormals.pixel(x, y);
+					if ((p - previousPosition).dot(previousDir) <= 0) {
+						color.pixel(x, y).setZero();
+						counts.at(x, y) = 0;
+						continue;
+					}
+					previousPixel = previousCam.projectImgInvY(p);
+				} else {
+					// background, only the rotation matters
+					previousPixel = previousCam.projectImgInvY(previousPosition + dir);
+				}
+
+				const float fx = previousPixel[0] - 0.5f, fy = (ph - previousPixel[1]) - 0.5f;
+				const int x0 = static_cast<int>(std::floor(fx)), y0 = static_cast<int>(std::floor(fy));
+				const float tx = fx - x0, ty = fy - y0;
+
+				v3f sumColor = v3f::Zero();
+				float sumCount = 0, sumW = 0;
+
+				for (int dy = 0; dy < 2; ++dy) {
+					for (int dx = 0; dx < 2; ++dx) {
+						const int px = x0 + dx, py = y0 + dy;
+						if (!previousColor.boundsCheck(px, py)) {
+							continue;
+						}
+
+						const float d = previousDepth.at(px, py);
+						bool valid = false;
+						if (hit) {
+							valid = d > 0 &&
+								std::abs(d - previousDist) < params.depthTolerance * previousDist &&
+								normal.dot(previousNormals.pixel(px, py)) > params.normalTolerance;
+						} else {
+							valid = d <= 0;
+						}
+						if (!valid) {
+							continue;
+						}
+
+						const float weight = (dx ? tx : 1 - tx) * (dy ? ty : 1 - ty);
+						sumColor += weight * previousColor.pixel(px, py);
+						sumCount += weight * previousCounts.at(px, py);
+						sumW += weight;
+					}
+				}
+
+				if (sumW > 1e-3f) {
+					color.pixel(x, y) = sumColor / sumW;
+					counts.at(x, y) = std::min(sumCount / sumW, params.maxHistory);
+				} else {
+					color.pixel(x, y).setZero();
+					counts.at(x, y) = 0;
+				}
+			}
+		}, params.maxNumThreads);
+	}
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "config.hpp"
+#include "Image.hpp"
+#include "Camera.hpp"
+
+namespace gloops {
+
+	struct ReprojectionParams {
+		float depthTolerance = 0.05f;	// relative to the distance to the previous camera
+		float normalTolerance = 0.9f;	// minimal cosine between current and previous normals
+		float maxHistory = 64.0f;		// bounds the reprojected sample counts, limits blur and ghosting
+		int maxNumThreads = 256;
+	};
+
+	// reuses accumulated samples across camera motion
+	// images are stored bottom to top as for GL upload, pixel (x, y) is seen through camera pixel (x + 0.5, h - y - 0.5)
+	// depths are primary hit distances along normalized rays, depth <= 0 meaning no hit
+	class TemporalReprojection {
+
+	public:
+		TemporalReprojection() = default;
+
+		// warps color and per pixel sample counts from the previous view into the current one,
+		// disoccluded pixels, rejected by depth and normal, end up with a null count
+		void reproject(
+			const RaycastingCameraf& previousCam, const Image1f& previousDepth, const Image3f& previousNormals,
+			const RaycastingCameraf& currentCam, const Image1f& currentDepth, const Image3f& currentNormals,
+			Image3f& color, Image1f& counts, const ReprojectionParams& params = {}
+		);
+
+	protected:
+		Image3f previousColor;
+		Image1f previousCounts;
+	};
+
+}
@@ -0,0 +1,185 @@
+#include "Scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace gloops {
+
+	bool ProgressiveTask::Internal::runUnit()
+	{
+		// in flight before checking active, so that stop() cannot miss this unit
+		++inFlight;
+		if (!active) {
+			--inFlight;
+			return false;
+		}
+
+		const int unit = next++;
+		if (unit >= numUnits) {
+			--inFlight;
+			return false;
+		}
+
+		unitFunc(unit);
+		++done;
+		--inFlight;
+		return true;
+	}
+
+	bool ProgressiveTask::Internal::hasUnits() const
+	{
+		return active && next < numUnits;
+	}
+
+	ProgressiveTask::ProgressiveTask()
+	{
+		data = std::make_shared<Internal>();
+	}
+
+	void ProgressiveTask::setUnitFunction(const UnitFunction& f)
+	{
+		stop();
+		data->unitFunc = f;
+	}
+
+	void ProgressiveTask::setPassFunction(const PassFunction& f)
+	{
+		data->passFunc = f;
+	}
+
+	void ProgressiveTask::start(int numUnits)
+	{
+		stop();
+		if (!data->unitFunc || numUnits <= 0) {
+			return;
+		}
+
+		data->numUnits = numUnits;
+		data->next = 0;
+		data->done = 0;
+		data->active = true;
+		Scheduler::getMain().submit(data);
+	}
+
+	void ProgressiveTask::stop()
+	{
+		data->active = false;
+		while (data->inFlight > 0) {
+			std::this_thread::yield();
+		}
+	}
+
+	bool ProgressiveTask::running() const
+	{
+		return data->active;
+	}
+
+	float ProgressiveTask::progress() const
+	{
+		return data->numUnits > 0 ? data->done / float(data->numUnits) : 0.0f;
+	}
+
+	void ProgressiveTask::process(double budgetMs)
+	{
+		using Clock = std::chrono::steady_clock;
+		const auto deadline = Clock::now() + std::chrono::duration<double, std::milli>(budgetMs);
+
+		while (Clock::now() < deadline && data->runUnit()) {}
+
+		if (data->active && data->done == data->numUnits) {
+			data->active = false;
+			if (data->passFunc) {
+				data->passFunc();
+			}
+		}
+	}
+
+	Scheduler& Scheduler::getMain()
+	{
+		static Scheduler scheduler;
+		return scheduler;
+	}
+
+	Scheduler::Scheduler()
+	{
+		setNumWorkers(static_cast<int>(std::thread::hardware_concurrency()) - 1);
+	}
+
+	Scheduler::~Scheduler()
+	{
+		setNumWorkers(0);
+	}
+
+	void Scheduler::setNumWorkers(int n)
+	{
+		n = std::max(n, 0);
+		if (n == numWorkers()) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wakeUp.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+
+		quit = false;
+		for (int i = 0; i < n; ++i) {
+			workers.emplace_back([this] { workerLoop(); });
+		}
+	}
+
+	int Scheduler::numWorkers() const
+	{
+		return static_cast<int>(workers.size());
+	}
+
+	void Scheduler::submit(const std::shared_ptr<ProgressiveTask::Internal>& task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (std::find(tasks.begin(), tasks.end(), task) == tasks.end()) {
+				tasks.push_back(task);
+			}
+		}
+		wakeUp.notify_all();
+	}
+
+	void Scheduler::workerLoop()
+	{
+		while (true) {
+			std::shared_ptr<ProgressiveTask::Internal> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+
+				auto pickTask = [&] {
+					tasks.erase(std::remove_if(tasks.begin(), tasks.end(), [](const auto& t) { return !t->active; }), tasks.end());
+					for (size_t i = 0; i < tasks.size(); ++i) {
+						const auto& t = tasks[(roundRobin + i) % tasks.size()];
+						if (t->hasUnits()) {
+							roundRobin = (roundRobin + i + 1) % tasks.size();
+							task = t;
+							return true;
+						}
+					}
+					return false;
+				};
+
+				// new units only come from submit(), which notifies
+				while (!quit && !pickTask()) {
+					wakeUp.wait(lock);
+				}
+				if (quit) {
+					return;
+				}
+			}
+
+			while (!quit && task->runUnit()) {}
+		}
+	}
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "config.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gloops {
+
+	// resumable work split in independent units (tiles, rows, samples) processed by the Scheduler workers
+	// a pass is complete once all its units are done, the pass function is then called on the main thread
+	class ProgressiveTask {
+
+	public:
+		using UnitFunction = std::function<void(int unit)>;
+		using PassFunction = std::function<void()>;
+
+		ProgressiveTask();
+
+		// called from any thread, must not touch GL
+		void setUnitFunction(const UnitFunction& f);
+
+		// called from process(), at a frame boundary, may start another pass
+		void setPassFunction(const PassFunction& f);
+
+		// waits for the units in flight of the current pass before starting the new one
+		void start(int numUnits);
+		void stop();
+
+		bool running() const;
+		float progress() const;
+
+		// runs units on the calling thread until the budget is spent, then publishes a completed pass
+		void process(double budgetMs);
+
+	protected:
+		friend class Scheduler;
+
+		struct Internal {
+			// false if there was no unit left to run
+			bool runUnit();
+			bool hasUnits() const;
+
+			UnitFunction unitFunc;
+			PassFunction passFunc;
+			std::atomic<int> numUnits = 0, next = 0, done = 0, inFlight = 0;
+			std::atomic<bool> active = false;
+		};
+
+		std::shared_ptr<Internal> data;
+	};
+
+	// worker pool shared by all progressive tasks, the main thread participates within its frame budget
+	class Scheduler {
+
+	public:
+		static Scheduler& getMain();
+
+		~Scheduler();
+
+		void setNumWorkers(int n);
+		int numWorkers() const;
+
+	protected:
+		friend class ProgressiveTask;
+
+		Scheduler();
+
+		void submit(const std::shared_ptr<ProgressiveTask::Internal>& task);
+		void workerLoop();
+
+		std::vector<std::thread> workers;
+		std::vector<std::shared_ptr<ProgressiveTask::Internal>> tasks;
+		std::mutex mutex;
+		std::condition_variable wakeUp;
+		std::atomic<bool> quit = false;
+		size_t roundRobin = 0;
+	};
+
+}
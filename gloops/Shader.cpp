@@ -220,6 +220,8 @@ namespace gloops {
 
 	ShaderCollection::ShaderCollection()
 	{
+		sh_coeffs.get().fill(v3f::Zero());
+
 		initBasic();
 		initPhong();
 		initColoredMesh();
@@ -257,6 +259,14 @@ namespace gloops {
 		renderPhongMesh(eye, eye.position(), mesh);
 	}
 
+	void ShaderCollection::renderPhongMesh(const Cameraf& eye, const v3f& light_position, const MeshGL& mesh, const SHCoefficients& ambient)
+	{
+		sh_ambient = true;
+		sh_coeffs = ambient;
+		renderPhongMesh(eye, light_position, mesh);
+		sh_ambient = false;
+	}
+
 	void ShaderCollection::renderColoredMesh(const Cameraf& eye, const MeshGL& mesh)
 	{
 		setMVP(eye, mesh);
@@ -594,6 +604,16 @@ namespace gloops {
 
 				uniform vec3 light_pos;
 				uniform vec3 cam_pos;
+				uniform bool sh_ambient;
+				uniform vec3 sh_coeffs[9];
+
+				vec3 evalSH(vec3 n) {
+					return sh_coeffs[0] * 0.282095
+						+ (sh_coeffs[1] * n.y + sh_coeffs[2] * n.z + sh_coeffs[3] * n.x) * 0.488603
+						+ (sh_coeffs[4] * n.x * n.y + sh_coeffs[5] * n.y * n.z + sh_coeffs[7] * n.x * n.z) * 1.092548
+						+ sh_coeffs[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+						+ sh_coeffs[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+				}
 
 				void main(){
 					const float kd = 0.3;
@@ -606,8 +626,9 @@ namespace gloops {
 					vec3 R = reflect(-L,N);
 					float diffuse = max(0.0, dot(L,N));
 					float specular = max(0.0, dot(R,V));
+					vec3 ambient = sh_ambient ? max(vec3(0.0), evalSH(N)) : vec3(1.0);
 	
-					color = vec4( (1.0 - kd - kd)*meshColor + (kd*diffuse + ks*specular)*vec3(1.0) , 1.0);
+					color = vec4( (1.0 - kd - kd)*meshColor*ambient + (kd*diffuse + ks*specular)*vec3(1.0) , 1.0);
 				}
 			)";
 		return s;
@@ -638,7 +659,7 @@ namespace gloops {
 	{
 		ShaderProgram shader;
 		shader.init(vertexMeshInterface(), fragPhong());
-		shader.addUniforms(model, vp, light_pos, cam_pos);
+		shader.addUniforms(model, vp, light_pos, cam_pos, sh_ambient, sh_coeffs);
 		shaderPrograms[Name::PHONG] = std::move(shader);
 	}
 
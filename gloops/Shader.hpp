@@ -7,6 +7,7 @@
 #include <set>
 
 #include "Camera.hpp"
+#include "SphericalHarmonics.hpp"
 
 namespace gloops {
 
@@ -82,6 +83,11 @@ namespace gloops {
 	template<> inline void GLuniformInternal<m4f>::send() const {
 		glUniformMatrix4fv(location, 1, GL_FALSE, t.data());
 	}
+	// vec3 array of the same size in the shader
+	template<> inline void GLuniformInternal<SHCoefficients>::send() const {
+		static_assert(sizeof(SHCoefficients) == 9 * sizeof(v3f), "SHCoefficients should be tightly packed");
+		glUniform3fv(location, static_cast<GLsizei>(t.size()), t[0].data());
+	}
 
 	class ShaderProgram;
 
@@ -213,6 +219,9 @@ namespace gloops {
 		void renderBasicMesh(const Cameraf& eye, const MeshGL& mesh, const v4f& color);
 		void renderPhongMesh(const Cameraf& eye, const v3f& light_position, const MeshGL& mesh);
 		void renderPhongMesh(const Cameraf& eye, const MeshGL& mesh);
+
+		// ambient term from diffuse SH coefficients, see diffuseSH, instead of the constant one
+		void renderPhongMesh(const Cameraf& eye, const v3f& light_position, const MeshGL& mesh, const SHCoefficients& ambient);
 		void renderColoredMesh(const Cameraf& eye, const MeshGL& mesh);
 		
 		void renderTexturedMesh(const Cameraf& eye, const MeshGL& mesh, const Texture& tex, float alpha = 1.0f, float lod = - 1);
@@ -232,6 +241,8 @@ namespace gloops {
 		Uniform<v2f> viewport_diagonal = { "viewport_diagonal" };
 		Uniform<float> alpha = { "alpha" }, size = { "size" }, lod = { "lod" }, tesselation_size = { "tesselation_size", 1 },
 			displacement_scaling = { "displacement_scaling", 1.0f };
+		Uniform<bool> sh_ambient = { "sh_ambient", false };
+		Uniform<SHCoefficients> sh_coeffs = { "sh_coeffs" };
 
 		std::map<Name, ShaderProgram> shaderPrograms;
 
@@ -0,0 +1,222 @@
+#include "SparseVolume.hpp"
+#include "Utils.hpp"
+
+namespace gloops {
+
+	SparseVolume SparseVolume::fromDense(const Volume1b& vol, const SparseVolumeParams& params)
+	{
+		return fromFunction(vol.size(), vol.box(), [&](int x, int y, int z) {
+			return vol.at(x, y, z);
+		}, params);
+	}
+
+	SparseVolume SparseVolume::fromFunction(const v3i& size, const BBox3f& box, const Source& source, const SparseVolumeParams& params)
+	{
+		SparseVolume out;
+		out._size = size;
+		out._box = box;
+		out._brickSize = std::max(params.brickSize, 1);
+		out._apron = std::max(params.apron, 0);
+		out._emptyValue = params.emptyValue;
+
+		const int b = out._brickSize, a = out._apron, slotSide = b + 2 * a;
+		const v3i nb = out.numBricks();
+		out._indirection.resize(nb[0], nb[1], nb[2], v4b::Zero());
+		out._indirection.setBox(box);
+
+		// calls f(x, y, z, value) for the voxels of the brick slot, apron included, in x then y then z order, until it returns false
+		auto forEachVoxel = [&](const v3i& brick, const auto& f) {
+			const v3i origin = b * brick - v3i::Constant(a);
+			for (int z = 0; z < slotSide; ++z) {
+				const int vz = std::clamp(origin[2] + z, 0, size[2] - 1);
+				for (int y = 0; y < slotSide; ++y) {
+					const int vy = std::clamp(origin[1] + y, 0, size[1] - 1);
+					for (int x = 0; x < slotSide; ++x) {
+						if (!f(x, y, z, source(std::clamp(origin[0] + x, 0, size[0] - 1), vy, vz))) {
+							return;
+						}
+					}
+				}
+			}
+		};
+
+		// non empty bricks are only flagged and counted per row of bricks along x, so that the atlas can be allocated first
+		const int numRows = nb[1] * nb[2];
+		std::vector<int> rowOffsets(numRows + 1, 0);
+		parallelForEach(0, numRows, [&](int row) {
+			const int by = row % nb[1], bz = row / nb[1];
+			for (int bx = 0; bx < nb[0]; ++bx) {
+				bool empty = true;
+				forEachVoxel(v3i(bx, by, bz), [&](int, int, int, uchar value) {
+					empty = std::abs(value - params.emptyValue) <= params.tolerance;
+					return empty;
+				});
+				if (!empty) {
+					out._indirection.at(bx, by, bz)[3] = 255;
+					++rowOffsets[row + 1];
+				}
+			}
+		}, params.maxNumThreads);
+
+		for (int r = 0; r < numRows; ++r) {
+			rowOffsets[r + 1] += rowOffsets[r];
+		}
+		const int numSlots = rowOffsets.back();
+
+		// roughly cubic atlas, within the usual 2048 max 3D texture size and 8 bits slot indices
+		const int maxSlots = std::max(1, std::min(255, 2048 / slotSide));
+		v3i slots;
+		slots[0] = std::clamp(static_cast<int>(std::ceil(std::cbrt(static_cast<double>(numSlots)))), 1, maxSlots);
+		slots[1] = std::clamp(static_cast<int>(std::ceil(std::sqrt(numSlots / static_cast<double>(slots[0])))), 1, maxSlots);
+		slots[2] = std::max(1, (numSlots + slots[0] * slots[1] - 1) / (slots[0] * slots[1]));
+		if (slots[2] > maxSlots) {
+			addToLogs(LogType::ERROR, "sparse volume atlas too large, " + std::to_string(numSlots) + " bricks for at most " + std::to_string(maxSlots * maxSlots * maxSlots));
+			return SparseVolume();
+		}
+		out._numStoredBricks = numSlots;
+
+		out._atlas.resize(slots[0] * slotSide, slots[1] * slotSide, slots[2] * slotSide, params.emptyValue);
+
+		// voxels evaluated again, straight into their slot
+		parallelForEach(0, numRows, [&](int row) {
+			const int by = row % nb[1], bz = row / nb[1];
+			int slot = rowOffsets[row];
+			for (int bx = 0; bx < nb[0]; ++bx) {
+				v4b& entry = out._indirection.at(bx, by, bz);
+				if (entry[3] == 0) {
+					continue;
+				}
+				const v3i s(slot % slots[0], (slot / slots[0]) % slots[1], slot / (slots[0] * slots[1]));
+				entry = v4b(s[0], s[1], s[2], 255);
+				++slot;
+
+				forEachVoxel(v3i(bx, by, bz), [&](int x, int y, int z, uchar value) {
+					out._atlas.at(s[0] * slotSide + x, s[1] * slotSide + y, s[2] * slotSide + z) = value;
+					return true;
+				});
+			}
+		}, params.maxNumThreads);
+
+		return out;
+	}
+
+	uchar SparseVolume::at(int x, int y, int z) const
+	{
+		const v4b& slot = _indirection.at(x / _brickSize, y / _brickSize, z / _brickSize);
+		if (slot[3] == 0) {
+			return _emptyValue;
+		}
+		const int slotSide = _brickSize + 2 * _apron;
+		return _atlas.at(
+			slot[0] * slotSide + _apron + x % _brickSize,
+			slot[1] * slotSide + _apron + y % _brickSize,
+			slot[2] * slotSide + _apron + z % _brickSize
+		);
+	}
+
+	SparseVolume::operator bool() const
+	{
+		return _size.prod() > 0;
+	}
+
+	v3i SparseVolume::size() const
+	{
+		return _size;
+	}
+
+	v3i SparseVolume::numBricks() const
+	{
+		return (_size + v3i::Constant(_brickSize - 1)) / _brickSize;
+	}
+
+	int SparseVolume::numStoredBricks() const
+	{
+		return _numStoredBricks;
+	}
+
+	size_t SparseVolume::memoryBytes() const
+	{
+		return _indirection.size().cast<size_t>().prod() * sizeof(v4b) + _atlas.size().cast<size_t>().prod();
+	}
+
+	const BBox3f& SparseVolume::box() const
+	{
+		return _box;
+	}
+
+	int SparseVolume::brickSize() const
+	{
+		return _brickSize;
+	}
+
+	int SparseVolume::apron() const
+	{
+		return _apron;
+	}
+
+	uchar SparseVolume::emptyValue() const
+	{
+		return _emptyValue;
+	}
+
+	const Volume<v4b>& SparseVolume::indirection() const
+	{
+		return _indirection;
+	}
+
+	const Volume1b& SparseVolume::atlas() const
+	{
+		return _atlas;
+	}
+
+	void SparseVolumeGL::upload(const SparseVolume& vol)
+	{
+		TexParams indirectionParams;
+		indirectionParams.setTarget(GL_TEXTURE_3D).setInternalFormat(GL_RGBA8UI).setFormat(GL_RGBA_INTEGER).setType(GL_UNSIGNED_BYTE)
+			.disableMipmap().setMagFilter(GL_NEAREST).setMinFilter(GL_NEAREST).setWrapAll(GL_CLAMP_TO_EDGE);
+		indirection.update3D(vol.indirection(), indirectionParams);
+
+		atlas.update3D(vol.atlas());
+
+		size = vol.size();
+		brickSize = vol.brickSize();
+		apron = vol.apron();
+		emptyValue = vol.emptyValue() / 255.0f;
+	}
+
+	void SparseVolumeGL::bind() const
+	{
+		indirection.bindSlot(GL_TEXTURE1);
+		atlas.bindSlot(GL_TEXTURE2);
+	}
+
+	void SparseVolumeGL::addUniformsTo(ShaderProgram& program)
+	{
+		program.addUniforms(size, brickSize, apron, emptyValue);
+	}
+
+	const std::string& SparseVolumeGL::glslSampling()
+	{
+		static const std::string s = R"(
+			layout(binding = 1) uniform usampler3D sparse_indirection;
+			layout(binding = 2) uniform sampler3D sparse_atlas;
+
+			uniform ivec3 sparse_size;
+			uniform int sparse_brick_size, sparse_apron;
+			uniform float sparse_empty_value;
+
+			float sampleSparse(vec3 uvw) {
+				vec3 g = clamp(uvw * vec3(sparse_size) - 0.5, vec3(0.0), vec3(sparse_size - 1));
+				ivec3 brick = ivec3(g) / sparse_brick_size;
+				uvec4 slot = texelFetch(sparse_indirection, brick, 0);
+				if (slot.w == 0u) {
+					return sparse_empty_value;
+				}
+				vec3 atlasPos = vec3(slot.xyz) * float(sparse_brick_size + 2 * sparse_apron) + float(sparse_apron) + g - vec3(brick * sparse_brick_size);
+				return texture(sparse_atlas, (atlasPos + 0.5) / vec3(textureSize(sparse_atlas, 0))).x;
+			}
+		)";
+		return s;
+	}
+
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "config.hpp"
+#include "Volume.hpp"
+#include "Texture.hpp"
+#include "Shader.hpp"
+
+#include <functional>
+
+namespace gloops {
+
+	struct SparseVolumeParams {
+		int brickSize = 8;		// voxels per brick side, apron excluded
+		int apron = 1;			// voxels copied from the neighbor bricks, so that hardware trilinear filtering stays within a brick
+		uchar emptyValue = 0;
+		int tolerance = 0;		// bricks whose voxels, apron included, are all within tolerance of emptyValue are not stored
+		int maxNumThreads = 256;
+	};
+
+	// indirection grid with one entry per brick, pointing to its slot in a brick atlas, only non empty bricks are stored
+	// memory scales with the occupied volume, about (brickSize + 2 * apron)^3 bytes per stored brick plus 4 bytes per brick
+	class SparseVolume {
+
+	public:
+		// value of voxel (x, y, z), called in parallel
+		using Source = std::function<uchar(int x, int y, int z)>;
+
+		SparseVolume() = default;
+
+		static SparseVolume fromDense(const Volume1b& vol, const SparseVolumeParams& params = {});
+		// source is called up to twice per voxel of the non empty bricks, apron included, once to find them and once to fill the atlas
+		// the volume is empty if its non empty bricks do not fit in the atlas, see operator bool()
+		static SparseVolume fromFunction(const v3i& size, const BBox3f& box, const Source& source, const SparseVolumeParams& params = {});
+
+		// false if empty, or if building it failed
+		operator bool() const;
+
+		uchar at(int x, int y, int z) const;
+
+		v3i size() const;
+		v3i numBricks() const;
+		int numStoredBricks() const;
+		size_t memoryBytes() const;
+
+		const BBox3f& box() const;
+		int brickSize() const;
+		int apron() const;
+		uchar emptyValue() const;
+
+		// rgb is the slot position in the atlas, in slots, alpha is 0 for empty bricks
+		const Volume<v4b>& indirection() const;
+		const Volume1b& atlas() const;
+
+	protected:
+		Volume<v4b> _indirection;
+		Volume1b _atlas;
+		BBox3f _box;
+		v3i _size = v3i::Zero();
+		int _brickSize = 8, _apron = 1, _numStoredBricks = 0;
+		uchar _emptyValue = 0;
+	};
+
+	// GPU side of a SparseVolume, textures are bound to slots 1 and 2 as declared in glslSampling()
+	class SparseVolumeGL {
+
+	public:
+		void upload(const SparseVolume& vol);
+
+		void bind() const;
+		void addUniformsTo(ShaderProgram& program);
+
+		// declares float sampleSparse(vec3 uvw), trilinear, uvw in [0,1]^3 over the whole volume
+		// to be inserted after the #version line of the shaders
+		static const std::string& glslSampling();
+
+	protected:
+		Texture indirection, atlas;
+		Uniform<v3i> size = { "sparse_size" };
+		Uniform<int> brickSize = { "sparse_brick_size" }, apron = { "sparse_apron" };
+		Uniform<float> emptyValue = { "sparse_empty_value" };
+	};
+
+}
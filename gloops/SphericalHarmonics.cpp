@@ -0,0 +1,123 @@
+#include "SphericalHarmonics.hpp"
+#include "EnvironmentLight.hpp"
+#include "Utils.hpp"
+
+namespace gloops {
+
+	namespace {
+
+		using SHAccumulator = Eigen::Matrix<float, 3, 9>;
+
+		// texelFunc(x, y, dir) returns the texel solid angle and sets its normalized direction
+		template<typename TexelFunc>
+		SHCoefficients project(const Image3f& img, int w, int h, const TexelFunc& texelFunc, const SHProjectionParams& params)
+		{
+			SHCoefficients out;
+			out.fill(v3f::Zero());
+			if (w <= 0 || h <= 0) {
+				return out;
+			}
+
+			const int numCoeffs = params.order <= 2 ? 4 : 9;
+
+			// per row partial sums, reduced in order for deterministic results
+			std::vector<SHAccumulator> rows(h, SHAccumulator::Zero());
+			parallelForEach(0, h, [&](int y) {
+				SHAccumulator& acc = rows[y];
+				v3f dir;
+				for (int x = 0; x < w; ++x) {
+					const float solidAngle = texelFunc(x, y, dir);
+					const std::array<float, 9> basis = shBasis(dir);
+					acc += (solidAngle * img.pixel(x, y)) * Eigen::Map<const Eigen::Matrix<float, 1, 9>>(basis.data());
+				}
+			}, params.maxNumThreads);
+
+			SHAccumulator total = SHAccumulator::Zero();
+			for (const SHAccumulator& row : rows) {
+				total += row;
+			}
+			for (int i = 0; i < numCoeffs; ++i) {
+				out[i] = total.col(i);
+			}
+			return out;
+		}
+	}
+
+	std::array<float, 9> shBasis(const v3f& dir)
+	{
+		const float x = dir[0], y = dir[1], z = dir[2];
+		return {
+			0.282095f,
+			0.488603f * y, 0.488603f * z, 0.488603f * x,
+			1.092548f * x * y, 1.092548f * y * z, 0.315392f * (3 * z * z - 1), 1.092548f * x * z, 0.546274f * (x * x - y * y)
+		};
+	}
+
+	v3f evalSH(const SHCoefficients& coeffs, const v3f& dir)
+	{
+		const std::array<float, 9> basis = shBasis(dir);
+		v3f out = v3f::Zero();
+		for (int i = 0; i < 9; ++i) {
+			out += basis[i] * coeffs[i];
+		}
+		return out;
+	}
+
+	SHCoefficients projectLatLongSH(const Image3f& img, const SHProjectionParams& params)
+	{
+		const int w = img.w(), h = img.h();
+		const float dphi = 2 * pi<float>() / w;
+
+		return project(img, w, h, [&](int x, int y, v3f& dir) {
+			const float theta0 = pi<float>() * y / h, theta1 = pi<float>() * (y + 1) / h;
+			dir = sphericalDir<float>(dphi * (x + 0.5f), pi<float>() * (y + 0.5f) / h);
+			return dphi * (std::cos(theta0) - std::cos(theta1));
+		}, params);
+	}
+
+	SHCoefficients projectCubeCrossSH(const Image3f& img, const SHProjectionParams& params)
+	{
+		const int s = std::min(img.w() / 4, img.h() / 3);
+
+		Image3f strip(NUM_CUBE_FACES * s, s);
+		for (int f = 0; f < NUM_CUBE_FACES; ++f) {
+			const v2i offset = s * cubeCrossOffset(f);
+			for (int y = 0; y < s; ++y) {
+				for (int x = 0; x < s; ++x) {
+					strip.pixel(f * s + x, y) = img.pixel(offset[0] + x, offset[1] + y);
+				}
+			}
+		}
+		return projectCubeStripSH(strip, params);
+	}
+
+	SHCoefficients projectCubeStripSH(const Image3f& img, const SHProjectionParams& params)
+	{
+		const int s = img.h();
+		if (s == 0 || img.w() != NUM_CUBE_FACES * s) {
+			SHCoefficients out;
+			out.fill(v3f::Zero());
+			return out;
+		}
+
+		return project(img, img.w(), s, [&](int x, int y, v3f& dir) {
+			const int face = x / s, fx = x % s;
+			dir = cubeFaceDir(face, v2f((fx + 0.5f) / s, (y + 0.5f) / s)).normalized();
+			return cubeTexelSolidAngle(fx, y, s);
+		}, params);
+	}
+
+	SHCoefficients diffuseSH(const SHCoefficients& radiance)
+	{
+		// Ramamoorthi and Hanrahan 2001, cosine lobe band factors pi, 2pi/3 and pi/4, divided by pi
+		static const float bandFactors[3] = { 1.0f, 2.0f / 3.0f, 0.25f };
+		static const int bands[9] = { 0, 1, 1, 1, 2, 2, 2, 2, 2 };
+
+		SHCoefficients out;
+		for (int i = 0; i < 9; ++i) {
+			out[i] = bandFactors[bands[i]] * radiance[i];
+		}
+		return out;
+	}
+
+}
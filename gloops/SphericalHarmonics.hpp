@@ -0,0 +1,38 @@
+#pragma once
+
+#include "config.hpp"
+#include "Image.hpp"
+
+#include <array>
+
+namespace gloops {
+
+	// rgb coefficients of the real spherical harmonics up to band 2, in (l, m) order
+	// order 2 projections only fill the first 4 coefficients
+	using SHCoefficients = std::array<v3f, 9>;
+
+	struct SHProjectionParams {
+		int order = 3;		// number of bands, 2 or 3
+		int maxNumThreads = 256;
+	};
+
+	// dir is assumed normalized
+	std::array<float, 9> shBasis(const v3f& dir);
+
+	v3f evalSH(const SHCoefficients& coeffs, const v3f& dir);
+
+	// projections of radiance maps, texels are weighted by their exact solid angle
+	// lat-long maps follow sphericalDirUV, z up and first row at theta = 0
+	SHCoefficients projectLatLongSH(const Image3f& img, const SHProjectionParams& params = {});
+
+	// horizontal cross layout read by Texture::fromPathCube
+	SHCoefficients projectCubeCrossSH(const Image3f& img, const SHProjectionParams& params = {});
+
+	// 6 faces side by side, in CubeFace order
+	SHCoefficients projectCubeStripSH(const Image3f& img, const SHProjectionParams& params = {});
+
+	// convolution with the clamped cosine lobe divided by pi, evalSH of the result gives the outgoing radiance
+	// of a white lambertian surface, 1 for a uniform white environment
+	SHCoefficients diffuseSH(const SHCoefficients& radiance);
+
+}
@@ -4,6 +4,7 @@
 
 #include "Input.hpp"
 #include "Image.hpp"
+#include "Volume.hpp"
 
 #include <list>
 #include <thread>
@@ -220,6 +221,43 @@ namespace gloops {
 		}
 	};
 
+	template<>
+	struct DefaultTexParams<Volume1b> : TexParams {
+		DefaultTexParams() {
+			target = GL_TEXTURE_3D;
+			internal_format = GL_R8;
+			format = GL_RED;
+			disableMipmap();
+			setWrapAll(GL_CLAMP_TO_EDGE);
+		}
+	};
+
+	// min max macro cells, see buildMacroCells
+	template<>
+	struct DefaultTexParams<Volume<v2b>> : TexParams {
+		DefaultTexParams() {
+			target = GL_TEXTURE_3D;
+			internal_format = GL_RG8;
+			format = GL_RG;
+			disableMipmap();
+			setMagFilter(GL_NEAREST);
+			setMinFilter(GL_NEAREST);
+			setWrapAll(GL_CLAMP_TO_EDGE);
+		}
+	};
+
+	template<>
+	struct DefaultTexParams<Volume1f> : TexParams {
+		DefaultTexParams() {
+			target = GL_TEXTURE_3D;
+			format = GL_RED;
+			internal_format = GL_R32F;
+			type = GL_FLOAT;
+			disableMipmap();
+			setWrapAll(GL_CLAMP_TO_EDGE);
+		}
+	};
+
 	class Texture : public TexParams {
 
 	public:
@@ -247,6 +285,10 @@ namespace gloops {
 		void allocate3D(int width, int height, int depth, int nchannels);
 		void updloadToGPU3D(int lod, int xoffset, int yoffset, int zoffset, int width, int height, int depth, const void* data);
 
+		// single channel volumes, reallocates if the size changed
+		template<typename T>
+		void update3D(const Volume<T>& vol, const TexParams& params = DefaultTexParams<Volume<T>>{});
+
 		void allocateCube(int width, int height, int nchannels);
 		
 		template<typename T>
@@ -286,7 +328,7 @@ namespace gloops {
 		void createFromImage2D(const ImageInfos<T>& img);
 
 		struct Size {
-			int _w, _h, _d = 1, _n, _lods = 1;
+			int _w = 0, _h = 0, _d = 1, _n = 0, _lods = 1;
 		};
 		
 		std::shared_ptr<Size> size;
@@ -458,6 +500,23 @@ namespace gloops {
 		}
 	}
 
+	template<typename T>
+	inline void Texture::update3D(const Volume<T>& vol, const TexParams& _params)
+	{
+		TexParams params(_params);
+		params.setTarget(GL_TEXTURE_3D);
+
+		if (w() != vol.w() || h() != vol.h() || d() != vol.d() || changeRequiresReallocating(params)) {
+			createGPUid();
+			update(params);
+			allocate3D(vol.w(), vol.h(), vol.d(), 1);
+		} else {
+			update(params);
+			bind();
+		}
+		updloadToGPU3D(0, 0, 0, 0, vol.w(), vol.h(), vol.d(), vol.data());
+	}
+
 	template<typename T>
 	inline void Texture::updateCubeFace(const T& t, GLenum face, const TexParams& _params)
 	{
@@ -0,0 +1,375 @@
+#include "TileFarm.hpp"
+#include "Utils.hpp"
+
+#include <deque>
+#include <mutex>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define GLOOPS_TILE_FARM_PROCESSES
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+namespace gloops {
+
+	TileFarm::TileFarm(const RenderFunc& renderFunc, const SetupFunc& setupFunc)
+		: renderFunc(renderFunc), setupFunc(setupFunc)
+	{
+	}
+
+	bool TileFarm::render(int w, int h, Image3f& out, const TileFarmParams& params)
+	{
+		std::vector<Image3f> frames;
+		const bool ok = renderSequence(1, w, h, frames, params);
+		out = frames[0];
+		return ok;
+	}
+
+	bool TileFarm::renderSequence(int numFrames, int w, int h, std::vector<Image3f>& out, const TileFarmParams& params)
+	{
+		const std::vector<TileJob> jobs = makeJobs(numFrames, w, h, params);
+
+		std::vector<Image3f> sums(numFrames, Image3f(w, h));
+		std::vector<Image1f> weights(numFrames, Image1f(w, h));
+		for (int f = 0; f < numFrames; ++f) {
+			sums[f].setTo(v3f::Zero());
+			weights[f].setTo(Image1f::Pixel(0));
+		}
+
+		bool ok = false;
+#ifdef GLOOPS_TILE_FARM_PROCESSES
+		if (params.useProcesses) {
+			ok = renderWithProcesses(jobs, sums, weights, params);
+		} else
+#endif
+		{
+			ok = renderWithThreads(jobs, sums, weights, params);
+		}
+
+		out.resize(numFrames);
+		for (int f = 0; f < numFrames; ++f) {
+			out[f].resize(w, h);
+			for (int y = 0; y < h; ++y) {
+				for (int x = 0; x < w; ++x) {
+					const float weight = weights[f].at(x, y);
+					out[f].pixel(x, y) = weight > 0 ? v3f(sums[f].pixel(x, y) / weight) : v3f::Zero();
+				}
+			}
+		}
+		return ok;
+	}
+
+	int TileFarm::numCrashes() const
+	{
+		return crashes;
+	}
+
+	std::vector<TileJob> TileFarm::makeJobs(int numFrames, int w, int h, const TileFarmParams& params) const
+	{
+		const int tileSize = std::max(params.tileSize, 1);
+
+		// passes first, so that early jobs cover whole frames
+		std::vector<TileJob> jobs;
+		for (int f = 0; f < numFrames; ++f) {
+			for (int p = 0; p < params.numPasses; ++p) {
+				for (int y = 0; y < h; y += tileSize) {
+					for (int x = 0; x < w; x += tileSize) {
+						TileJob job;
+						job.frame = f;
+						job.x = x;
+						job.y = y;
+						job.w = std::min(tileSize, w - x);
+						job.h = std::min(tileSize, h - y);
+						job.pass = p;
+						job.numSamples = std::max(params.samplesPerPass, 1);
+						jobs.push_back(job);
+					}
+				}
+			}
+		}
+		return jobs;
+	}
+
+	bool TileFarm::renderWithThreads(const std::vector<TileJob>& jobs, std::vector<Image3f>& sums, std::vector<Image1f>& weights, const TileFarmParams& params)
+	{
+		if (setupFunc) {
+			setupFunc();
+		}
+
+		std::mutex mutex;
+		bool ok = true;
+
+		parallelForEach(0, static_cast<int>(jobs.size()), [&](int i) {
+			const TileJob& job = jobs[i];
+			Image3f tile(job.w, job.h);
+			for (int attempt = 0; attempt <= params.maxRetries; ++attempt) {
+				try {
+					tile.setTo(v3f::Zero());
+					renderFunc(job, tile);
+					std::lock_guard<std::mutex> lock(mutex);
+					merge(job, tile, sums[job.frame], weights[job.frame]);
+					return;
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(mutex);
+					++crashes;
+				}
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			ok = false;
+		}, std::max(params.numWorkers, 1));
+
+		return ok;
+	}
+
+#ifdef GLOOPS_TILE_FARM_PROCESSES
+
+	namespace {
+
+		bool writeAll(int fd, const void* data, size_t size)
+		{
+			const char* ptr = static_cast<const char*>(data);
+			while (size > 0) {
+				const ssize_t n = ::send(fd, ptr, size, MSG_NOSIGNAL);
+				if (n < 0 && errno == EINTR) {
+					continue;
+				}
+				if (n <= 0) {
+					return false;
+				}
+				ptr += n;
+				size -= static_cast<size_t>(n);
+			}
+			return true;
+		}
+
+		bool readAll(int fd, void* data, size_t size)
+		{
+			char* ptr = static_cast<char*>(data);
+			while (size > 0) {
+				const ssize_t n = ::recv(fd, ptr, size, 0);
+				if (n < 0 && errno == EINTR) {
+					continue;
+				}
+				if (n <= 0) {
+					return false;
+				}
+				ptr += n;
+				size -= static_cast<size_t>(n);
+			}
+			return true;
+		}
+
+		struct TileReply {
+			int job = -1, w = 0, h = 0;
+		};
+
+		struct Worker {
+			pid_t pid = -1;
+			int fd = -1, job = -1;
+		};
+	}
+
+	bool TileFarm::renderWithProcesses(const std::vector<TileJob>& jobs, std::vector<Image3f>& sums, std::vector<Image1f>& weights, const TileFarmParams& params)
+	{
+		std::vector<Worker> workers(std::max(params.numWorkers, 1));
+
+		auto workerMain = [&](int fd) {
+			if (setupFunc) {
+				setupFunc();
+			}
+
+			int id;
+			TileJob job;
+			Image3f tile;
+			while (readAll(fd, &id, sizeof(id)) && readAll(fd, &job, sizeof(job))) {
+				tile.resize(job.w, job.h);
+				tile.setTo(v3f::Zero());
+				renderFunc(job, tile);
+
+				const TileReply reply = { id, tile.w(), tile.h() };
+				if (!writeAll(fd, &reply, sizeof(reply)) || !writeAll(fd, tile.data(), tile.w() * static_cast<size_t>(tile.h()) * sizeof(v3f))) {
+					break;
+				}
+			}
+		};
+
+		auto spawn = [&](Worker& worker) {
+			int fds[2];
+			if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+				return false;
+			}
+#ifdef SO_NOSIGPIPE
+			const int one = 1;
+			::setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+			const pid_t pid = ::fork();
+			if (pid < 0) {
+				::close(fds[0]);
+				::close(fds[1]);
+				return false;
+			}
+
+			if (pid == 0) {
+				::close(fds[0]);
+				for (const Worker& other : workers) {
+					if (other.fd >= 0) {
+						::close(other.fd);
+					}
+				}
+				// no static destructors nor atexit handlers of the parent, and no unwinding into its stack
+				// a throwing worker exits as if it crashed, so that its tile is requeued
+				try {
+					workerMain(fds[1]);
+				} catch (...) {
+					::_exit(1);
+				}
+				::_exit(0);
+			}
+
+			::close(fds[1]);
+			worker.pid = pid;
+			worker.fd = fds[0];
+			worker.job = -1;
+			return true;
+		};
+
+		std::deque<int> pending;
+		for (int i = 0; i < static_cast<int>(jobs.size()); ++i) {
+			pending.push_back(i);
+		}
+		std::vector<int> attempts(jobs.size(), 0);
+		size_t remaining = jobs.size();
+		bool ok = true;
+
+		auto release = [&](Worker& worker) {
+			::close(worker.fd);
+			::waitpid(worker.pid, nullptr, 0);
+			worker.fd = -1;
+			worker.pid = -1;
+		};
+
+		auto crash = [&](Worker& worker) {
+			release(worker);
+			++crashes;
+			if (worker.job >= 0) {
+				if (++attempts[worker.job] > params.maxRetries) {
+					ok = false;
+					--remaining;
+				} else {
+					pending.push_front(worker.job);
+				}
+				worker.job = -1;
+			}
+		};
+
+		Image3f tile;
+		while (remaining > 0) {
+			for (Worker& worker : workers) {
+				if (pending.empty()) {
+					break;
+				}
+				if (worker.fd < 0 && !spawn(worker)) {
+					continue;
+				}
+				if (worker.job < 0) {
+					worker.job = pending.front();
+					pending.pop_front();
+					if (!writeAll(worker.fd, &worker.job, sizeof(int)) || !writeAll(worker.fd, &jobs[worker.job], sizeof(TileJob))) {
+						crash(worker);
+					}
+				}
+			}
+
+			std::vector<pollfd> polled;
+			std::vector<Worker*> busy;
+			for (Worker& worker : workers) {
+				if (worker.fd >= 0 && worker.job >= 0) {
+					polled.push_back({ worker.fd, POLLIN, 0 });
+					busy.push_back(&worker);
+				}
+			}
+
+			if (polled.empty()) {
+				if (pending.empty()) {
+					continue;
+				}
+
+				// no worker could be spawned, finish in this process
+				std::vector<TileJob> left;
+				for (int id : pending) {
+					left.push_back(jobs[id]);
+				}
+				ok &= renderWithThreads(left, sums, weights, params);
+				break;
+			}
+
+			if (::poll(polled.data(), polled.size(), -1) < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				ok = false;
+				break;
+			}
+
+			for (size_t i = 0; i < polled.size(); ++i) {
+				if (!polled[i].revents) {
+					continue;
+				}
+
+				Worker& worker = *busy[i];
+				const TileJob& job = jobs[worker.job];
+
+				TileReply reply;
+				bool received = readAll(worker.fd, &reply, sizeof(reply)) && reply.job == worker.job && reply.w == job.w && reply.h == job.h;
+				if (received) {
+					tile.resize(job.w, job.h);
+					received = readAll(worker.fd, tile.data(), tile.w() * static_cast<size_t>(tile.h()) * sizeof(v3f));
+				}
+
+				if (received) {
+					merge(job, tile, sums[job.frame], weights[job.frame]);
+					worker.job = -1;
+					--remaining;
+				} else {
+					crash(worker);
+				}
+			}
+		}
+
+		// workers exit on end of stream
+		for (Worker& worker : workers) {
+			if (worker.fd >= 0) {
+				release(worker);
+			}
+		}
+
+		return ok;
+	}
+
+#else
+
+	bool TileFarm::renderWithProcesses(const std::vector<TileJob>& jobs, std::vector<Image3f>& sums, std::vector<Image1f>& weights, const TileFarmParams& params)
+	{
+		return renderWithThreads(jobs, sums, weights, params);
+	}
+
+#endif
+
+	void TileFarm::merge(const TileJob& job, const Image3f& tile, Image3f& sum, Image1f& weight)
+	{
+		for (int y = 0; y < job.h; ++y) {
+			for (int x = 0; x < job.w; ++x) {
+				sum.pixel(job.x + x, job.y + y) += job.numSamples * tile.pixel(x, y);
+				weight.at(job.x + x, job.y + y) += static_cast<float>(job.numSamples);
+			}
+		}
+	}
+
+}
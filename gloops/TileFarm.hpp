@@ -0,0 +1,57 @@
+#pragma once
+
+#include "config.hpp"
+#include "Image.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace gloops {
+
+	// numSamples samples of one tile, pass distinguishes the successive jobs of a same tile (e.g. for seeding)
+	struct TileJob {
+		int frame = 0, x = 0, y = 0, w = 0, h = 0;
+		int pass = 0, numSamples = 1;
+	};
+
+	struct TileFarmParams {
+		int numWorkers = 4;
+		int tileSize = 64;
+		int numPasses = 1, samplesPerPass = 16;
+		int maxRetries = 2;		// per job, after a worker crash
+		bool useProcesses = true;	// threads otherwise, also the fallback without fork()
+	};
+
+	// offline rendering split across local worker processes talking over Unix sockets
+	// workers are forked, so the farm should run before any GL context or background thread is created
+	class TileFarm {
+
+	public:
+		// renders the average of job.numSamples samples into a job.w x job.h image
+		using RenderFunc = std::function<void(const TileJob& job, Image3f& out)>;
+
+		// called once in each worker, e.g. to load the scene into its own Raycaster
+		using SetupFunc = std::function<void()>;
+
+		TileFarm(const RenderFunc& renderFunc, const SetupFunc& setupFunc = {});
+
+		// blocking, false if some jobs failed in all their attempts, their samples are then missing
+		bool render(int w, int h, Image3f& out, const TileFarmParams& params = {});
+		bool renderSequence(int numFrames, int w, int h, std::vector<Image3f>& out, const TileFarmParams& params = {});
+
+		int numCrashes() const;
+
+	protected:
+		std::vector<TileJob> makeJobs(int numFrames, int w, int h, const TileFarmParams& params) const;
+
+		bool renderWithThreads(const std::vector<TileJob>& jobs, std::vector<Image3f>& sums, std::vector<Image1f>& weights, const TileFarmParams& params);
+		bool renderWithProcesses(const std::vector<TileJob>& jobs, std::vector<Image3f>& sums, std::vector<Image1f>& weights, const TileFarmParams& params);
+
+		static void merge(const TileJob& job, const Image3f& tile, Image3f& sum, Image1f& weight);
+
+		RenderFunc renderFunc;
+		SetupFunc setupFunc;
+		int crashes = 0;
+	};
+
+}
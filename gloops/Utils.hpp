@@ -43,6 +43,25 @@ namespace gloops {
 		parallelForEach(from_incl, to_excl, std::forward<F>(f), 256);
 	}
 
+	// f(from, to) on consecutive ranges of about itemsPerJob items, in at most 1024 jobs
+	template<typename F>
+	void forEachRange(size_t numItems, F&& f, int maxNumThreads = 256, size_t itemsPerJob = 4096)
+	{
+		const int numJobs = static_cast<int>(std::min<size_t>((numItems + itemsPerJob - 1) / itemsPerJob, 1024));
+		parallelForEach(0, numJobs, [&](int job) {
+			f(numItems * job / numJobs, numItems * (job + 1) / numJobs);
+		}, maxNumThreads);
+	}
+
+	// for the open addressing tables keyed by three integers
+	inline size_t hashTriplet(int a, int b, int c)
+	{
+		uint64_t h = uint64_t(uint32_t(a)) * 0x9E3779B97F4A7C15ull;
+		h ^= uint64_t(uint32_t(b)) * 0xC2B2AE3D27D4EB4Full;
+		h ^= uint64_t(uint32_t(c)) * 0x165667B19E3779F9ull;
+		return static_cast<size_t>(h ^ (h >> 31));
+	}
+
 	template<typename T, int N>
 	Vec<T, N> randomVec()
 	{
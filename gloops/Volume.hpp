@@ -0,0 +1,261 @@
+#pragma once
+
+#include "config.hpp"
+#include "Debug.hpp"
+
+#include <vector>
+
+namespace gloops {
+
+	// dense w x h x d grid, x first then y then z, as expected by glTexSubImage3D
+	// voxel (x, y, z) is centered at min + (x + 0.5, y + 0.5, z + 0.5) * cellSize, like the texels of a 3D texture spanning the box
+	template<typename T>
+	class Volume {
+	public:
+		Volume() = default;
+
+		Volume(int width, int height, int depth, const T& value = T()) {
+			resize(width, height, depth, value);
+		}
+
+		void resize(int width, int height, int depth, const T& value = T())
+		{
+			_w = width;
+			_h = height;
+			_d = depth;
+			voxels.assign(static_cast<size_t>(_w) * _h * _d, value);
+		}
+
+		void setTo(const T& value)
+		{
+			std::fill(voxels.begin(), voxels.end(), value);
+		}
+
+		int w() const
+		{
+			return _w;
+		}
+
+		int h() const
+		{
+			return _h;
+		}
+
+		int d() const
+		{
+			return _d;
+		}
+
+		v3i size() const
+		{
+			return v3i(_w, _h, _d);
+		}
+
+		size_t index(int x, int y, int z) const
+		{
+			return (static_cast<size_t>(z) * _h + y) * _w + x;
+		}
+
+		T& at(int x, int y, int z) {
+			return voxels[index(x, y, z)];
+		}
+
+		const T& at(int x, int y, int z) const {
+			return voxels[index(x, y, z)];
+		}
+
+		T& at(const v3i& p) {
+			return at(p[0], p[1], p[2]);
+		}
+
+		const T& at(const v3i& p) const {
+			return at(p[0], p[1], p[2]);
+		}
+
+		bool boundsCheck(int x, int y, int z) const
+		{
+			return (x >= 0 && y >= 0 && z >= 0 && x < _w && y < _h && z < _d);
+		}
+
+		const T* data() const
+		{
+			return voxels.data();
+		}
+
+		T* data()
+		{
+			return voxels.data();
+		}
+
+		const BBox3f& box() const
+		{
+			return _box;
+		}
+
+		void setBox(const BBox3f& box)
+		{
+			_box = box;
+		}
+
+		v3f cellSize() const
+		{
+			return _box.sizes().cwiseQuotient(size().template cast<float>());
+		}
+
+		v3f voxelCenter(int x, int y, int z) const
+		{
+			return _box.min() + (v3f(x, y, z) + v3f::Constant(0.5f)).cwiseProduct(cellSize());
+		}
+
+		// continuous grid coordinates, voxel centers at integer positions
+		v3f worldToGrid(const v3f& p) const
+		{
+			return (p - _box.min()).cwiseQuotient(cellSize()) - v3f::Constant(0.5f);
+		}
+
+		// trilinear interpolation, clamped to the border voxels
+		T sample(const v3f& p) const
+		{
+			const v3f g = worldToGrid(p).cwiseMax(v3f::Zero()).cwiseMin((size() - v3i::Ones()).template cast<float>());
+			const v3i c = g.template cast<int>().cwiseMin(size() - v3i::Constant(2)).cwiseMax(v3i::Zero());
+			const v3f f = g - c.template cast<float>();
+			const v3i n = (c + v3i::Ones()).cwiseMin(size() - v3i::Ones());
+
+			auto lerp = [](const T& a, const T& b, float t) {
+				return static_cast<T>(a + t * (b - a));
+			};
+			const T x00 = lerp(at(c[0], c[1], c[2]), at(n[0], c[1], c[2]), f[0]);
+			const T x10 = lerp(at(c[0], n[1], c[2]), at(n[0], n[1], c[2]), f[0]);
+			const T x01 = lerp(at(c[0], c[1], n[2]), at(n[0], c[1], n[2]), f[0]);
+			const T x11 = lerp(at(c[0], n[1], n[2]), at(n[0], n[1], n[2]), f[0]);
+			return lerp(lerp(x00, x10, f[1]), lerp(x01, x11, f[1]), f[2]);
+		}
+
+		template<typename U>
+		Volume<U> convert(double scale = 1, double offset = 0) const
+		{
+			Volume<U> out(_w, _h, _d);
+			out.setBox(_box);
+			for (size_t i = 0; i < voxels.size(); ++i) {
+				out.data()[i] = saturate_cast<U>(scale * voxels[i] + offset);
+			}
+			return out;
+		}
+
+	protected:
+		std::vector<T> voxels;
+		BBox3f _box = BBox3f(v3f::Zero(), v3f::Ones());
+		int _w = 0, _h = 0, _d = 0;
+	};
+
+	using Volume1f = Volume<float>;
+	using Volume1b = Volume<uchar>;
+
+	// binary grid packed by 4x4x4 bricks, one 64 bits word per brick, voxel (x, y, z) of a brick is bit x + 4 * (y + 4 * z)
+	// same placement conventions as Volume
+	class BitVolume {
+	public:
+		BitVolume() = default;
+
+		BitVolume(int width, int height, int depth) {
+			resize(width, height, depth);
+		}
+
+		void resize(int width, int height, int depth)
+		{
+			_w = width;
+			_h = height;
+			_d = depth;
+			words.assign(static_cast<size_t>(numBricks().prod()), 0);
+		}
+
+		int w() const
+		{
+			return _w;
+		}
+
+		int h() const
+		{
+			return _h;
+		}
+
+		int d() const
+		{
+			return _d;
+		}
+
+		v3i size() const
+		{
+			return v3i(_w, _h, _d);
+		}
+
+		v3i numBricks() const
+		{
+			return v3i((_w + 3) / 4, (_h + 3) / 4, (_d + 3) / 4);
+		}
+
+		uint64_t& brick(int bx, int by, int bz)
+		{
+			return words[(static_cast<size_t>(bz) * numBricks()[1] + by) * numBricks()[0] + bx];
+		}
+
+		uint64_t brick(int bx, int by, int bz) const
+		{
+			return words[(static_cast<size_t>(bz) * numBricks()[1] + by) * numBricks()[0] + bx];
+		}
+
+		bool get(int x, int y, int z) const
+		{
+			return (brick(x / 4, y / 4, z / 4) >> bit(x, y, z)) & 1;
+		}
+
+		// not thread safe for voxels of a same brick
+		void set(int x, int y, int z, bool value = true)
+		{
+			uint64_t& word = brick(x / 4, y / 4, z / 4);
+			const uint64_t mask = uint64_t(1) << bit(x, y, z);
+			word = value ? (word | mask) : (word & ~mask);
+		}
+
+		const std::vector<uint64_t>& bricks() const
+		{
+			return words;
+		}
+
+		const BBox3f& box() const
+		{
+			return _box;
+		}
+
+		void setBox(const BBox3f& box)
+		{
+			_box = box;
+		}
+
+		// 255 for set voxels
+		Volume1b unpack() const
+		{
+			Volume1b out(_w, _h, _d, 0);
+			out.setBox(_box);
+			for (int z = 0; z < _d; ++z) {
+				for (int y = 0; y < _h; ++y) {
+					for (int x = 0; x < _w; ++x) {
+						out.at(x, y, z) = get(x, y, z) ? 255 : 0;
+					}
+				}
+			}
+			return out;
+		}
+
+	protected:
+		static int bit(int x, int y, int z)
+		{
+			return (x % 4) + 4 * ((y % 4) + 4 * (z % 4));
+		}
+
+		std::vector<uint64_t> words;
+		BBox3f _box = BBox3f(v3f::Zero(), v3f::Ones());
+		int _w = 0, _h = 0, _d = 0;
+	};
+
+}
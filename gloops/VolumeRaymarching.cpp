@@ -0,0 +1,324 @@
+#include "VolumeRaymarching.hpp"
+#include "Utils.hpp"
+
+#include <atomic>
+
+namespace gloops {
+
+	VolumeRaymarcher::VolumeRaymarcher(const Volume1b& volume, const MacroCellParams& macroParams)
+		: values(volume.convert<float>(1 / 255.0)), macroCells(buildMacroCells(volume, macroParams)), macroCellSize(std::max(macroParams.cellSize, 1))
+	{
+		bmin = values.box().min();
+		bmax = values.box().max();
+		cellSize = values.cellSize();
+	}
+
+	VolumeRaymarcher::VolumeRaymarcher(const Volume1f& volume)
+		: values(volume)
+	{
+		bmin = values.box().min();
+		bmax = values.box().max();
+		cellSize = values.cellSize();
+	}
+
+	Image4f VolumeRaymarcher::render(const RaycastingCameraf& cam, const VolumeRaymarchingParams& params)
+	{
+		const int w = cam.w(), h = cam.h();
+		Image4f out(w, h);
+		out.setTo(v4f::Zero());
+
+		const v3f eye = cam.position();
+		const int numPackets = (w + PacketSize - 1) / PacketSize;
+		std::atomic<size_t> total = 0;
+
+		parallelForEach(0, h, [&](int y) {
+			size_t rowSamples = 0;
+			Packet packet;
+			v4f colors[PacketSize];
+			for (int p = 0; p < numPackets; ++p) {
+				const int x0 = p * PacketSize;
+
+				LaneVecs dirs;
+				LaneMask valid;
+				for (int l = 0; l < PacketSize; ++l) {
+					const int x = std::min(x0 + l, w - 1);
+					dirs.row(l) = cam.rayDir(v2f(x + 0.5f, h - y - 0.5f)).transpose().array();
+					valid[l] = x0 + l < w;
+					colors[l] = v4f::Zero();
+				}
+
+				setupPacket(packet, eye, dirs, valid);
+				switch (params.mode)
+				{
+				case VolumeRenderMode::DENSITY: traceDensity(packet, params, colors, rowSamples); break;
+				case VolumeRenderMode::ISOSURFACE: traceIsosurface(packet, params, colors, rowSamples); break;
+				case VolumeRenderMode::SPHERE_TRACING: traceSpheres(packet, params, colors, rowSamples); break;
+				default: break;
+				}
+
+				for (int l = 0; l < PacketSize && x0 + l < w; ++l) {
+					out.pixel(x0 + l, y) = colors[l];
+				}
+			}
+			total += rowSamples;
+		}, params.maxNumThreads);
+
+		lastNumSamples = total;
+		return out;
+	}
+
+	size_t VolumeRaymarcher::numSamples() const
+	{
+		return lastNumSamples;
+	}
+
+	const Volume1f& VolumeRaymarcher::volume() const
+	{
+		return values;
+	}
+
+	void VolumeRaymarcher::setupPacket(Packet& packet, const v3f& eye, const LaneVecs& dirs, const LaneMask& valid) const
+	{
+		packet.eye = eye;
+		packet.dirs = dirs;
+		packet.active = valid;
+		packet.t.setZero();
+
+		// box entry, the eye may be inside
+		const bool inside = insideBox(eye);
+		Lanes nearT = Lanes::Constant(-std::numeric_limits<float>::infinity());
+		Lanes farT = Lanes::Constant(std::numeric_limits<float>::infinity());
+		for (int k = 0; k < 3; ++k) {
+			const Lanes inv = dirs.col(k).inverse();
+			const Lanes t0 = (bmin[k] - eye[k]) * inv, t1 = (bmax[k] - eye[k]) * inv;
+			nearT = nearT.max(t0.min(t1));
+			farT = farT.min(t0.max(t1));
+		}
+		if (!inside) {
+			packet.active = packet.active && nearT >= 0 && nearT <= farT;
+		}
+		const Lanes startT = inside ? Lanes::Zero() : Lanes(packet.active.select(nearT, Lanes::Zero()));
+
+		for (int k = 0; k < 3; ++k) {
+			packet.starts.col(k) = (eye[k] + startT * dirs.col(k)).max(bmin[k]).min(bmax[k] - 0.001f * cellSize[k]);
+			packet.deltas.col(k) = cellSize[k] / dirs.col(k).abs();
+			packet.steps.col(k) = (dirs.col(k) >= 0).select(LaneInts::Constant(1), LaneInts::Constant(-1));
+		}
+
+		for (int l = 0; l < PacketSize; ++l) {
+			setupTraversal(packet, l);
+		}
+	}
+
+	void VolumeRaymarcher::setupTraversal(Packet& packet, int l) const
+	{
+		const v3f dir = packet.dirs.row(l).transpose().matrix();
+		const v3f p = (packet.starts.row(l).transpose().matrix() + packet.t[l] * dir).cwiseMax(bmin).cwiseMin(bmax - 0.001f * cellSize);
+		const v3f g = (p - bmin).cwiseQuotient(cellSize);
+		for (int k = 0; k < 3; ++k) {
+			const float cell = std::floor(g[k]), frac = g[k] - cell;
+			packet.cells(l, k) = static_cast<int>(cell);
+			packet.ts(l, k) = packet.t[l] + packet.deltas(l, k) * (dir[k] >= 0 ? 1.0f - frac : frac);
+		}
+	}
+
+	VolumeRaymarcher::LaneMask VolumeRaymarcher::skipMacroCells(Packet& packet, float threshold) const
+	{
+		LaneMask skipped = LaneMask::Constant(false);
+		if (macroCells.size().minCoeff() <= 0) {
+			return skipped;
+		}
+
+		const v3i volumeSize = values.size();
+		for (int l = 0; l < PacketSize; ++l) {
+			if (!packet.active[l]) {
+				continue;
+			}
+
+			const v3f dir = packet.dirs.row(l).transpose().matrix();
+			const v3f p = packet.starts.row(l).transpose().matrix() + packet.t[l] * dir;
+			const v3f uvw = (p - bmin).cwiseQuotient(bmax - bmin).cwiseMax(v3f::Zero()).cwiseMin(v3f::Ones());
+			const v3i macro = uvw.cwiseProduct(volumeSize.cast<float>()).cast<int>().cwiseMin(volumeSize - v3i::Ones()) / macroCellSize;
+			if (macroCells.at(macro)[1] / 255.0f > threshold) {
+				continue;
+			}
+
+			float skip = std::numeric_limits<float>::infinity();
+			for (int k = 0; k < 3; ++k) {
+				const float lo = bmin[k] + (bmax[k] - bmin[k]) * std::min(macro[k] * macroCellSize / float(volumeSize[k]), 1.0f);
+				const float hi = bmin[k] + (bmax[k] - bmin[k]) * std::min((macro[k] + 1) * macroCellSize / float(volumeSize[k]), 1.0f);
+				skip = std::min(skip, std::max((lo - p[k]) / dir[k], (hi - p[k]) / dir[k]));
+			}
+			if (!(skip > 0)) {
+				continue;
+			}
+
+			skipped[l] = true;
+			packet.t[l] += skip + 0.001f * cellSize.minCoeff();
+			if (insideBox(packet.starts.row(l).transpose().matrix() + packet.t[l] * dir)) {
+				setupTraversal(packet, l);
+			} else {
+				packet.active[l] = false;
+			}
+		}
+		return skipped;
+	}
+
+	void VolumeRaymarcher::traceDensity(Packet& packet, const VolumeRaymarchingParams& params, v4f* out, size_t& numSamples) const
+	{
+		const LaneMask valid = packet.active;
+		const float saturation = std::max(0.2f, 1.0f / std::max(params.intensity, 1e-3f));
+		const v3i last = values.size() - v3i::Ones();
+
+		Lanes alpha = Lanes::Zero();
+		while (packet.active.any()) {
+			const LaneMask skipped = params.useMacroCells ? skipMacroCells(packet, 0.0f) : LaneMask::Constant(false);
+			const LaneMask stepping = packet.active && !skipped;
+
+			// axis of the closest cell boundary
+			const LaneMask cx = packet.ts.col(0) <= packet.ts.col(1) && packet.ts.col(0) <= packet.ts.col(2);
+			const LaneMask cy = !cx && packet.ts.col(1) <= packet.ts.col(2);
+			const LaneMask cz = !cx && !cy;
+			const Lanes nextT = cx.select(packet.ts.col(0), cy.select(packet.ts.col(1), packet.ts.col(2)));
+			const Lanes deltaT = nextT - packet.t;
+			packet.t = stepping.select(nextT, packet.t);
+
+			const LaneMask axes[3] = { stepping && cx, stepping && cy, stepping && cz };
+			for (int k = 0; k < 3; ++k) {
+				packet.cells.col(k) += axes[k].select(packet.steps.col(k), 0);
+				packet.ts.col(k) += axes[k].select(packet.deltas.col(k), 0.0f);
+			}
+
+			// texel fetch, clamped to the border as by the texture sampler
+			Lanes densities = Lanes::Zero();
+			for (int l = 0; l < PacketSize; ++l) {
+				if (stepping[l]) {
+					const v3i cell = packet.cells.row(l).transpose().matrix().cwiseMax(v3i::Zero()).cwiseMin(last);
+					densities[l] = values.at(cell);
+					++numSamples;
+				}
+			}
+			alpha += stepping.select(deltaT * densities, 0.0f);
+
+			LaneMask outside = LaneMask::Constant(false);
+			for (int k = 0; k < 3; ++k) {
+				const int finalCell = values.size()[k];
+				outside = outside || (packet.steps.col(k) > 0).select(packet.cells.col(k) == finalCell, packet.cells.col(k) == -1);
+			}
+			packet.active = packet.active && !(stepping && (alpha >= saturation || outside));
+		}
+
+		for (int l = 0; l < PacketSize; ++l) {
+			if (valid[l]) {
+				const float a = std::min(params.intensity * alpha[l], 1.0f);
+				out[l] = v4f(1.0f, 1.0f, a, std::min(5.0f * alpha[l], 1.0f));
+			}
+		}
+	}
+
+	void VolumeRaymarcher::traceIsosurface(Packet& packet, const VolumeRaymarchingParams& params, v4f* out, size_t& numSamples) const
+	{
+		while (packet.active.any()) {
+			const LaneMask skipped = params.useMacroCells ? skipMacroCells(packet, 1.0f - params.sdfOffset) : LaneMask::Constant(false);
+			const LaneMask stepping = packet.active && !skipped;
+
+			const LaneMask cx = packet.ts.col(0) <= packet.ts.col(1) && packet.ts.col(0) <= packet.ts.col(2);
+			const LaneMask cy = !cx && packet.ts.col(1) <= packet.ts.col(2);
+			const LaneMask cz = !cx && !cy;
+			const Lanes nextT = cx.select(packet.ts.col(0), cy.select(packet.ts.col(1), packet.ts.col(2)));
+			const Lanes deltaT = nextT - packet.t;
+			packet.t = stepping.select(nextT, packet.t);
+
+			const LaneMask axes[3] = { stepping && cx, stepping && cy, stepping && cz };
+			for (int k = 0; k < 3; ++k) {
+				packet.cells.col(k) += axes[k].select(packet.steps.col(k), 0);
+				packet.ts.col(k) += axes[k].select(packet.deltas.col(k), 0.0f);
+			}
+
+			// trilinear samples, the hits are refined lane by lane
+			const LaneVecs points = packet.starts + packet.dirs * packet.t.replicate<1, 3>();
+			for (int l = 0; l < PacketSize; ++l) {
+				if (!stepping[l]) {
+					continue;
+				}
+
+				const v3f start = packet.starts.row(l).transpose().matrix(), dir = packet.dirs.row(l).transpose().matrix();
+				const float d = field(points.row(l).transpose().matrix(), params.mode);
+				++numSamples;
+				if (d < params.sdfOffset) {
+					const float previousD = field(start + (packet.t[l] - deltaT[l]) * dir, params.mode);
+					const float t = packet.t[l] - (d - params.sdfOffset) * deltaT[l] / (d - previousD);
+					out[l] = shade(start + t * dir, packet.eye, params);
+					numSamples += 5;
+					packet.active[l] = false;
+				}
+			}
+
+			LaneMask outside = LaneMask::Constant(false);
+			for (int k = 0; k < 3; ++k) {
+				const int finalCell = values.size()[k];
+				outside = outside || (packet.steps.col(k) > 0).select(packet.cells.col(k) == finalCell, packet.cells.col(k) == -1);
+			}
+			packet.active = packet.active && !(stepping && outside);
+		}
+	}
+
+	void VolumeRaymarcher::traceSpheres(Packet& packet, const VolumeRaymarchingParams& params, v4f* out, size_t& numSamples) const
+	{
+		const float minStep = 0.01f * cellSize.minCoeff();
+		for (int step = 0; step < params.maxSteps && packet.active.any(); ++step) {
+			const LaneVecs points = packet.starts + packet.dirs * packet.t.replicate<1, 3>();
+
+			Lanes distances = Lanes::Zero();
+			for (int l = 0; l < PacketSize; ++l) {
+				if (!packet.active[l]) {
+					continue;
+				}
+				const v3f p = points.row(l).transpose().matrix();
+				if (!insideBox(p)) {
+					packet.active[l] = false;
+					continue;
+				}
+				distances[l] = field(p, params.mode);
+				++numSamples;
+				if (distances[l] < params.epsilon) {
+					out[l] = shade(p, packet.eye, params);
+					numSamples += 4;
+					packet.active[l] = false;
+				}
+			}
+			packet.t += packet.active.select(distances.max(minStep), 0.0f);
+		}
+	}
+
+	float VolumeRaymarcher::field(const v3f& p, VolumeRenderMode mode) const
+	{
+		const float v = values.sample(p);
+		return mode == VolumeRenderMode::ISOSURFACE ? 1.0f - v : v;
+	}
+
+	v4f VolumeRaymarcher::shade(const v3f& p, const v3f& eye, const VolumeRaymarchingParams& params) const
+	{
+		// tetrahedral gradient and lighting of texture3D_sdf.frag
+		const float e = params.epsilon;
+		const v3f N = (
+			v3f(1, -1, -1) * field(p + e * v3f(1, -1, -1), params.mode) +
+			v3f(-1, -1, 1) * field(p + e * v3f(-1, -1, 1), params.mode) +
+			v3f(-1, 1, -1) * field(p + e * v3f(-1, 1, -1), params.mode) +
+			v3f(1, 1, 1) * field(p + e * v3f(1, 1, 1), params.mode)
+			).normalized();
+
+		const v3f L = (eye - p).normalized();
+		const v3f R = 2.0f * N.dot(L) * N - L;
+		const float diffuse = std::max(0.0f, L.dot(N));
+		const float specular = std::max(0.0f, R.dot(L));
+		const float c = 0.5f * 0.7f + 0.3f * diffuse + 0.2f * specular;
+		return v4f(c, c, c, 1.0f);
+	}
+
+	bool VolumeRaymarcher::insideBox(const v3f& p) const
+	{
+		return (p.array() >= bmin.array()).all() && (p.array() <= bmax.array()).all();
+	}
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "config.hpp"
+#include "Volume.hpp"
+#include "Image.hpp"
+#include "MacroCells.hpp"
+#include "Camera.hpp"
+
+namespace gloops {
+
+	// DENSITY: voxel_grid_raymarching.frag, absorption accumulated cell by cell along the grid traversal
+	// ISOSURFACE: texture3D_sdf.frag, first crossing of 1 - value below sdfOffset along the grid traversal
+	// SPHERE_TRACING: for volumes of world space distances such as meshToSDF outputs, surface at 0
+	enum class VolumeRenderMode { DENSITY, ISOSURFACE, SPHERE_TRACING };
+
+	struct VolumeRaymarchingParams {
+		VolumeRenderMode mode = VolumeRenderMode::DENSITY;
+		float intensity = 3.0f;		// DENSITY, as the intensity uniform
+		float sdfOffset = 0.5f;		// ISOSURFACE, as the sdf_offset uniform
+		float epsilon = 1e-3f;		// normals finite differences, and SPHERE_TRACING hit distance, in world units
+		int maxSteps = 256;			// SPHERE_TRACING
+		bool useMacroCells = true;
+		int maxNumThreads = 256;
+	};
+
+	// CPU counterpart of the demo volume shaders, as a reference without GPU and as a performance baseline
+	// the traversed grid is the voxel grid of the volume, as when the gridSize uniform matches the texture size
+	// rays go by packets of 8 consecutive pixels advancing in lockstep, the per ray arithmetic is done on Eigen arrays
+	// images are stored bottom to top as for GL upload, pixel (x, y) is seen through camera pixel (x + 0.5, h - y - 0.5),
+	// with the color and alpha written by the shaders, pixels they discard are transparent black
+	class VolumeRaymarcher {
+
+	public:
+		static constexpr int PacketSize = 8;
+
+		// values normalized to [0,1] as sampled from a R8 texture, with min max macro cells
+		VolumeRaymarcher(const Volume1b& volume, const MacroCellParams& macroParams = {});
+
+		// values as is, as sampled from a R32F texture, without macro cells
+		VolumeRaymarcher(const Volume1f& volume);
+
+		Image4f render(const RaycastingCameraf& cam, const VolumeRaymarchingParams& params = {});
+
+		// volume samples taken by the last render
+		size_t numSamples() const;
+
+		const Volume1f& volume() const;
+
+	protected:
+		using Lanes = Eigen::Array<float, PacketSize, 1>;
+		using LaneMask = Eigen::Array<bool, PacketSize, 1>;
+		using LaneVecs = Eigen::Array<float, PacketSize, 3>;
+		using LaneCells = Eigen::Array<int, PacketSize, 3>;
+		using LaneInts = Eigen::Array<int, PacketSize, 1>;
+
+		// grid traversal state, t is the distance from start
+		struct Packet {
+			v3f eye;
+			LaneVecs dirs, starts, deltas, ts;
+			LaneCells cells, steps;
+			Lanes t;
+			LaneMask active;
+		};
+
+		void setupPacket(Packet& packet, const v3f& eye, const LaneVecs& dirs, const LaneMask& valid) const;
+		void setupTraversal(Packet& packet, int lane) const;
+
+		// the lanes that jumped over a macro cell this iteration, the others may step
+		LaneMask skipMacroCells(Packet& packet, float threshold) const;
+
+		void traceDensity(Packet& packet, const VolumeRaymarchingParams& params, v4f* out, size_t& samples) const;
+		void traceIsosurface(Packet& packet, const VolumeRaymarchingParams& params, v4f* out, size_t& samples) const;
+		void traceSpheres(Packet& packet, const VolumeRaymarchingParams& params, v4f* out, size_t& samples) const;
+
+		// increasing outwards, as sampleTex in texture3D_sdf.frag
+		float field(const v3f& p, VolumeRenderMode mode) const;
+		v4f shade(const v3f& p, const v3f& eye, const VolumeRaymarchingParams& params) const;
+
+		bool insideBox(const v3f& p) const;
+
+		Volume1f values;
+		Volume<v2b> macroCells;
+		int macroCellSize = 0;
+		v3f bmin, bmax, cellSize;
+		size_t lastNumSamples = 0;
+	};
+
+}
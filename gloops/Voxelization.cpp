@@ -0,0 +1,212 @@
+#include "Voxelization.hpp"
+#include "Utils.hpp"
+
+namespace gloops {
+
+	bool triangleBoxOverlap(const v3f& center, const v3f& halfSize, const v3f& a, const v3f& b, const v3f& c)
+	{
+		const v3f v0 = a - center, v1 = b - center, v2 = c - center;
+
+		// box faces
+		const v3f vmin = v0.cwiseMin(v1).cwiseMin(v2), vmax = v0.cwiseMax(v1).cwiseMax(v2);
+		if ((vmin.array() > halfSize.array()).any() || (vmax.array() < -halfSize.array()).any()) {
+			return false;
+		}
+
+		// triangle plane
+		const v3f e0 = v1 - v0, e1 = v2 - v1, e2 = v0 - v2;
+		const v3f n = e0.cross(e1);
+		if (std::abs(n.dot(v0)) > halfSize.dot(n.cwiseAbs())) {
+			return false;
+		}
+
+		// cross products of the edges and the box axes
+		const v3f edges[3] = { e0, e1, e2 };
+		for (const v3f& e : edges) {
+			for (int i = 0; i < 3; ++i) {
+				const v3f axis = v3f::Unit(i).cross(e);
+				const float p0 = axis.dot(v0), p1 = axis.dot(v1), p2 = axis.dot(v2);
+				const float r = halfSize.dot(axis.cwiseAbs());
+				if (std::min(p0, std::min(p1, p2)) > r || std::max(p0, std::max(p1, p2)) < -r) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	BitVolume voxelizeOccupancy(const std::vector<Mesh>& meshes, const VoxelizationParams& params)
+	{
+		const int n = std::max(params.resolution, 1);
+		BitVolume out(n, n, n);
+
+		// world space triangles of all meshes
+		std::vector<v3f> positions;
+		std::vector<v3u> tris;
+		BBox3f meshesBox;
+		for (const Mesh& mesh : meshes) {
+			const uint offset = static_cast<uint>(positions.size());
+			for (const auto& v : mesh.getVertices()) {
+				positions.push_back((mesh.model() * v.homogeneous()).hnormalized());
+				meshesBox.extend(positions.back());
+			}
+			for (const auto& t : mesh.getTriangles()) {
+				tris.push_back(t + v3u::Constant(offset));
+			}
+		}
+
+		if (tris.empty()) {
+			addToLogs(LogType::WARNING, "cant voxelize empty meshes");
+			return out;
+		}
+
+		const float halfSide = 0.5f * meshesBox.sizes().maxCoeff() * (1 + 2 * params.padding);
+		const v3f halfDiag = v3f::Constant(std::max(halfSide, 1e-6f));
+		out.setBox(BBox3f(meshesBox.center() - halfDiag, meshesBox.center() + halfDiag));
+
+		// grid coordinates, voxel centers at integer positions
+		const float invCell = n / (2 * halfDiag[0]);
+		for (v3f& p : positions) {
+			p = (p - out.box().min()) * invCell - v3f::Constant(0.5f);
+		}
+
+		const int numTris = static_cast<int>(tris.size());
+		std::vector<v3i> triMin(numTris), triMax(numTris);
+		for (int t = 0; t < numTris; ++t) {
+			const v3f& a = positions[tris[t][0]], & b = positions[tris[t][1]], & c = positions[tris[t][2]];
+			const v3f pmin = a.cwiseMin(b).cwiseMin(c), pmax = a.cwiseMax(b).cwiseMax(c);
+			for (int k = 0; k < 3; ++k) {
+				triMin[t][k] = std::max(0, static_cast<int>(std::ceil(pmin[k] - 0.5f)));
+				triMax[t][k] = std::min(n - 1, static_cast<int>(std::floor(pmax[k] + 0.5f)));
+			}
+		}
+
+		// bricks own whole 64 bits words, so they can be processed in parallel
+		const int brickSize = std::max(4, 4 * ((params.brickSize + 3) / 4));
+		const int numBricks = (n + brickSize - 1) / brickSize;
+		std::vector<std::vector<int>> bins(static_cast<size_t>(numBricks) * numBricks * numBricks);
+		for (int t = 0; t < numTris; ++t) {
+			const v3i b0 = triMin[t] / brickSize, b1 = triMax[t] / brickSize;
+			for (int bz = b0[2]; bz <= b1[2]; ++bz) {
+				for (int by = b0[1]; by <= b1[1]; ++by) {
+					for (int bx = b0[0]; bx <= b1[0]; ++bx) {
+						bins[(static_cast<size_t>(bz) * numBricks + by) * numBricks + bx].push_back(t);
+					}
+				}
+			}
+		}
+
+		const v3f halfVoxel = v3f::Constant(0.5f);
+		parallelForEach(0, static_cast<int>(bins.size()), [&](int b) {
+			const v3i brickMin = brickSize * v3i(b % numBricks, (b / numBricks) % numBricks, b / (numBricks * numBricks));
+			const v3i brickMax = (brickMin + v3i::Constant(brickSize - 1)).cwiseMin(v3i::Constant(n - 1));
+
+			for (int t : bins[b]) {
+				const v3i vmin = triMin[t].cwiseMax(brickMin), vmax = triMax[t].cwiseMin(brickMax);
+				const v3f& p0 = positions[tris[t][0]], & p1 = positions[tris[t][1]], & p2 = positions[tris[t][2]];
+				for (int z = vmin[2]; z <= vmax[2]; ++z) {
+					for (int y = vmin[1]; y <= vmax[1]; ++y) {
+						for (int x = vmin[0]; x <= vmax[0]; ++x) {
+							if (!out.get(x, y, z) && triangleBoxOverlap(v3f(x, y, z), halfVoxel, p0, p1, p2)) {
+								out.set(x, y, z);
+							}
+						}
+					}
+				}
+			}
+		}, params.maxNumThreads);
+
+		if (!params.solid) {
+			return out;
+		}
+
+		// inside voxels have an odd number of crossings before them along +x, layers of 4 slices share words
+		std::vector<std::vector<int>> layers((n + 3) / 4);
+		for (int t = 0; t < numTris; ++t) {
+			for (int l = triMin[t][2] / 4; l <= triMax[t][2] / 4; ++l) {
+				layers[l].push_back(t);
+			}
+		}
+
+		parallelForEach(0, static_cast<int>(layers.size()), [&](int l) {
+			std::vector<int> crossings(n * static_cast<size_t>(n + 1));
+			for (int z = 4 * l; z < std::min(n, 4 * l + 4); ++z) {
+				std::fill(crossings.begin(), crossings.end(), 0);
+				for (int t : layers[l]) {
+					const v3f& a = positions[tris[t][0]], & b = positions[tris[t][1]], & c = positions[tris[t][2]];
+					const float area = (b[1] - a[1]) * (c[2] - a[2]) - (c[1] - a[1]) * (b[2] - a[2]);
+					if (area == 0) {
+						continue;
+					}
+					for (int y = triMin[t][1]; y <= triMax[t][1]; ++y) {
+						// slightly shifted lines, so that they do not go through shared edges and vertices
+						const float ly = y + 1.3e-4f, lz = z + 0.7e-4f;
+						const float wa = ((b[1] - ly) * (c[2] - lz) - (c[1] - ly) * (b[2] - lz)) / area;
+						const float wb = ((c[1] - ly) * (a[2] - lz) - (a[1] - ly) * (c[2] - lz)) / area;
+						const float wc = 1 - wa - wb;
+						if (wa < 0 || wb < 0 || wc < 0) {
+							continue;
+						}
+						const float x = wa * a[0] + wb * b[0] + wc * c[0];
+						++crossings[y * static_cast<size_t>(n + 1) + std::clamp(static_cast<int>(std::floor(x)) + 1, 0, n)];
+					}
+				}
+
+				for (int y = 0; y < n; ++y) {
+					int count = 0;
+					for (int x = 0; x < n; ++x) {
+						count += crossings[y * static_cast<size_t>(n + 1) + x];
+						if (count % 2) {
+							out.set(x, y, z);
+						}
+					}
+				}
+			}
+		}, params.maxNumThreads);
+
+		return out;
+	}
+
+	BitVolume voxelizeOccupancy(const Mesh& mesh, const VoxelizationParams& params)
+	{
+		return voxelizeOccupancy(std::vector<Mesh>{ mesh }, params);
+	}
+
+	Volume1b voxelizeDensity(const std::vector<Mesh>& meshes, const VoxelizationParams& params)
+	{
+		const int s = std::max(params.supersampling, 1);
+		const int n = std::max(params.resolution, 1);
+
+		VoxelizationParams fineParams = params;
+		fineParams.resolution = n * s;
+		const BitVolume fine = voxelizeOccupancy(meshes, fineParams);
+
+		Volume1b out(n, n, n, 0);
+		out.setBox(fine.box());
+
+		const float scale = 255.0f / (s * s * s);
+		parallelForEach(0, n, [&](int z) {
+			for (int y = 0; y < n; ++y) {
+				for (int x = 0; x < n; ++x) {
+					int count = 0;
+					for (int k = 0; k < s; ++k) {
+						for (int j = 0; j < s; ++j) {
+							for (int i = 0; i < s; ++i) {
+								count += fine.get(s * x + i, s * y + j, s * z + k) ? 1 : 0;
+							}
+						}
+					}
+					out.at(x, y, z) = saturate_cast<uchar>(std::round(scale * count));
+				}
+			}
+		}, params.maxNumThreads);
+
+		return out;
+	}
+
+	Volume1b voxelizeDensity(const Mesh& mesh, const VoxelizationParams& params)
+	{
+		return voxelizeDensity(std::vector<Mesh>{ mesh }, params);
+	}
+
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "config.hpp"
+#include "Mesh.hpp"
+#include "Volume.hpp"
+
+#include <vector>
+
+namespace gloops {
+
+	struct VoxelizationParams {
+		int resolution = 128;		// voxels along each axis, cells are cubic
+		float padding = 0.05f;		// margin around the meshes bounding box, relative to its largest side
+		int brickSize = 16;			// side of the parallel work units, rounded to a multiple of 4
+		bool solid = false;			// also fills the inside by parity along x, expects closed meshes
+		int supersampling = 1;		// density grids only, subvoxels per axis
+		int maxNumThreads = 256;
+	};
+
+	// voxels overlapped by a triangle, using the mesh model matrices
+	BitVolume voxelizeOccupancy(const std::vector<Mesh>& meshes, const VoxelizationParams& params = {});
+	BitVolume voxelizeOccupancy(const Mesh& mesh, const VoxelizationParams& params = {});
+
+	// fraction of occupied subvoxels, in [0,255], ready for Texture::update3D
+	Volume1b voxelizeDensity(const std::vector<Mesh>& meshes, const VoxelizationParams& params = {});
+	Volume1b voxelizeDensity(const Mesh& mesh, const VoxelizationParams& params = {});
+
+	// separating axis test, Akenine-Moller 2001
+	bool triangleBoxOverlap(const v3f& center, const v3f& halfSize, const v3f& a, const v3f& b, const v3f& c);
+
+}
@@ -569,6 +569,8 @@ namespace gloops {
 				updateFunc(input);
 			}
 
+			task.process(shouldUpdate ? timeBudget : 0.0);
+
 			framebuffer.clear(clearColor, (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 
 			if (renderingFunc) {
@@ -687,6 +689,12 @@ namespace gloops {
 		data->renderingFunc = renderFunc;
 	}
 
+	void SubWindow::setProgressiveTask(const ProgressiveTask& task, double budgetMs)
+	{
+		data->task = task;
+		data->timeBudget = budgetMs;
+	}
+
 	void SubWindow::show(const Window & win)
 	{
 		data->renderComponent->show(win);
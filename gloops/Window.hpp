@@ -3,6 +3,7 @@
 #include "config.hpp"
 #include "Debug.hpp"
 #include "Input.hpp"
+#include "Scheduler.hpp"
 #include "Texture.hpp"
 
 #include <string>
@@ -160,6 +161,9 @@ namespace gloops {
 		void setUpdateFunction(const UpdateFunc& upFunc);
 		void setRenderingFunction(const RenderingFunc& renderFunc);
 
+		// background work, the main thread helps for budgetMs per frame and completed passes are published before rendering
+		void setProgressiveTask(const ProgressiveTask& task, double budgetMs = 4.0);
+
 		void show(const Window & win);
 
 		void setFlags(WinFlags flags);
@@ -205,6 +209,9 @@ namespace gloops {
 			UpdateFunc updateFunc;
 			RenderingFunc renderingFunc;
 
+			ProgressiveTask task;
+			double timeBudget = 0;
+
 			std::string win_name;
 			v4f clearColor = { 0.1f, 0.1f, 0.1f, 1.0f };
 			v2f gui_render_size;
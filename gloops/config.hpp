@@ -30,6 +30,7 @@ namespace gloops {
 	template<typename T, int N>
 	using Vec = Eigen::Matrix<T, N, 1>;
 
+	using v2b = Vec<uchar, 2>;
 	using v3b = Vec<uchar, 3>;
 	using v4b = Vec<uchar, 4>;
 
@@ -37,6 +38,7 @@ namespace gloops {
 	using v3i = Vec<int, 3>;
 	using v4i = Vec<int, 4>;
 
+	using v2u = Vec<uint32_t, 2>;
 	using v3u = Vec<uint32_t, 3>;
 
 	using v2f = Vec<float, 2>;